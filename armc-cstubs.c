@@ -233,22 +233,20 @@ int wait( int *status )
 
 void outbyte( char b )
 {
-    RPI_AuxMiniUartWrite( b );
+    RPI_AuxMiniUartQueue( &b, 1 );
 }
 
 /* Write to a file. libc subroutines will use this system routine for output to
    all files, including stdout—so if you need to generate any output, for
    example to a serial port for debugging, you should make your minimal write
-   capable of doing this. The following minimal implementation is an
-   incomplete example; it relies on a outbyte subroutine (not shown; typically,
-   you must write this in assembler from examples provided by your hardware
-   manufacturer) to actually perform the output. */
+   capable of doing this. The bytes are queued for the mini UART's transmit
+   interrupt rather than written one at a time, so printf only waits for the
+   UART if the transmit ring is full and the policy is AUX_TX_BLOCK. Bytes
+   dropped by the other policies still count as written, otherwise newlib
+   would retry them. */
 int _write( int file, char *ptr, int len )
 {
-    int todo;
-
-    for( todo = 0; todo < len; todo++ )
-      outbyte(*ptr++);
+    RPI_AuxMiniUartQueue( ptr, len );
 
     return len;
 }
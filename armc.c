@@ -34,21 +34,53 @@
 
 #include "rpi-aux.h"
 #include "rpi-armtimer.h"
+#include "rpi-framebuffer.h"
 #include "rpi-gpio.h"
+#include "rpi-hal.h"
 #include "rpi-interrupts.h"
 #include "rpi-mailbox-interface.h"
+#include "rpi-mmu.h"
+#include "rpi-property-cache.h"
 #include "rpi-systimer.h"
 #include "rpi-uart.h"
 
+#include "jobs.h"
+#include "raycaster.h"
+#include "raycaster-pipeline.h"
+#include "raycaster-texture.h"
+#include "raycaster-blit.h"
 #include "sip.h"
 
-int dummy(uint8_t *payload, uint8_t payload_length)
+/* Set by CMake, the ray caster's lookup tables are built for the width */
+#define SCREEN_WIDTH RAYCASTER_SCREEN_WIDTH
+#define SCREEN_HEIGHT RAYCASTER_SCREEN_HEIGHT
+
+/* Draw into a column major buffer and transpose it into the framebuffer
+   when the frame is presented, rather than drawing down the framebuffer's
+   rows a pitch at a time */
+#ifndef RENDER_COLUMN_MAJOR
+#define RENDER_COLUMN_MAJOR 1
+#endif
+
+int dummy(uint8_t *payload, uint16_t payload_length, SIPResponse_t *response)
 {
 	printf("DID SOMETHING\r\n");
 
 	return 0;
 }
 
+// SIP responses share the mini UART with the debug output
+void sipTransmit(const uint8_t *frame, size_t length)
+{
+	RPI_AuxMiniUartQueue((const char *)frame, length);
+}
+
+// SIP queue latency and the render stage times in microseconds
+uint32_t sipClock(void)
+{
+	return RPI_REG_READ( RPI_GetSystemTimer()->counter_lo );
+}
+
 void timerHandler(uint32_t irq, void *args)
 {
 	static int lit = 0;
@@ -56,7 +88,7 @@ void timerHandler(uint32_t irq, void *args)
     /* Clear the ARM Timer interrupt - it's the only interrupt we have
        enabled, so we want don't have to work out which interrupt source
        caused us to interrupt */
-    RPI_GetArmTimer()->IRQClear = 1;
+    RPI_REG_WRITE( RPI_GetArmTimer()->IRQClear, 1 );
 
     /* Flip the LED */
     if( lit )
@@ -71,20 +103,12 @@ void timerHandler(uint32_t irq, void *args)
     }
 }
 
-void uartRxHandler(uint32_t irq, void *args)
-{
-	char ch;
-	RPI_AuxMiniUartNonBlockRead(&ch);
-
-	printf("RX:%c\r\n", ch);
-}
-
 /** Main function - we'll never return from here */
 void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
 {
 	/* Write 1 to the LED init nibble in the Function Select GPIO
 	   peripheral register to enable LED pin as an output */
-	RPI_GetGpio()->LED_GPFSEL |= LED_GPFBIT;
+	RPI_REG_WRITE( RPI_GetGpio()->LED_GPFSEL, RPI_REG_READ( RPI_GetGpio()->LED_GPFSEL ) | LED_GPFBIT );
 
 	// setup the interript controller
 	RPI_IrqControllerInit();
@@ -92,44 +116,56 @@ void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
 	/* Setup the system timer interrupt */
 	RPI_ArmTimerInit();
 
-	/* Initialise the UART */
-	RPI_AuxMiniUartInit( 115200, 8, false );
+	/* Initialise the UART. printf output is sent from the TX interrupt */
+	RPI_AuxMiniUartInit( 115200, 8, true );
 
 	/* Print to the UART using the standard libc functions */
 	printf( "Raspberry Pi Program Loader\r\n" );
 
-	RPI_PropertyInit();
-	RPI_PropertyAddTag( TAG_GET_BOARD_MODEL );
-	RPI_PropertyAddTag( TAG_GET_BOARD_REVISION );
-	RPI_PropertyAddTag( TAG_GET_FIRMWARE_VERSION );
-	RPI_PropertyAddTag( TAG_GET_BOARD_MAC_ADDRESS );
-	RPI_PropertyAddTag( TAG_GET_BOARD_SERIAL );
-	RPI_PropertyAddTag( TAG_GET_MAX_CLOCK_RATE, TAG_CLOCK_ARM );
-	RPI_PropertyProcess();
+	/* One round trip for everything about the board that can't change,
+	   anything asking again later is answered from RAM */
+	RPI_PropertyCacheInit();
+
+	/* RAM cached write-back and the peripherals as device memory from here
+	   on, which needs to know where the ARM's RAM ends */
+	if( RPI_MmuInit() == 0 )
+	{
+		printf( "MMU: on\r\n" );
+
+		/* The other cores share memory through the caches, so they're only
+		   started with the MMU on. They spin waiting for jobs from here */
+		printf( "Job workers: %d\r\n", JobsInit( JOBS_MAX_WORKERS ) );
+	}
+	else
+	{
+		printf( "MMU: off\r\n" );
+	}
+
+	rpi_property_transaction_t* t;
 
-	rpi_mailbox_property_t* mp;
-	mp = RPI_PropertyGet( TAG_GET_BOARD_MODEL );
+	const rpi_mailbox_property_t* mp;
+	mp = RPI_PropertyCacheGet( TAG_GET_BOARD_MODEL, 0 );
 
 	if( mp )
 		printf( "Board Model: 0x%x\r\n", mp->data.value_32 );
 	else
 		printf( "Board Model: NULL\r\n" );
 
-	mp = RPI_PropertyGet( TAG_GET_BOARD_REVISION );
+	mp = RPI_PropertyCacheGet( TAG_GET_BOARD_REVISION, 0 );
 
 	if( mp )
 		printf( "Board Revision: 0x%x\r\n", mp->data.value_32 );
 	else
 		printf( "Board Revision: NULL\r\n" );
 
-	mp = RPI_PropertyGet( TAG_GET_FIRMWARE_VERSION );
+	mp = RPI_PropertyCacheGet( TAG_GET_FIRMWARE_VERSION, 0 );
 
 	if( mp )
 		printf( "Firmware Version: 0x%x\r\n", mp->data.value_32 );
 	else
 		printf( "Firmware Version: NULL\r\n" );
 
-	mp = RPI_PropertyGet( TAG_GET_BOARD_MAC_ADDRESS );
+	mp = RPI_PropertyCacheGet( TAG_GET_BOARD_MAC_ADDRESS, 0 );
 
 	if( mp )
 		printf( "MAC Address: %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X\r\n",
@@ -138,7 +174,7 @@ void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
 	else
 		printf( "MAC Address: NULL\r\n" );
 
-	mp = RPI_PropertyGet( TAG_GET_BOARD_SERIAL );
+	mp = RPI_PropertyCacheGet( TAG_GET_BOARD_SERIAL, 0 );
 
 	if( mp )
 		printf( "Serial Number: %8.8X%8.8X\r\n",
@@ -146,47 +182,197 @@ void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
 	else
 		printf( "Serial Number: NULL\r\n" );
 
-	mp = RPI_PropertyGet( TAG_GET_MAX_CLOCK_RATE );
+	mp = RPI_PropertyCacheGet( TAG_GET_MAX_CLOCK_RATE, TAG_CLOCK_ARM );
 
 	if( mp )
 		printf( "Maximum ARM Clock Rate: %d MHz\r\n", mp->data.buffer_32[1] / (1000000));
 	else
 		printf( "Maximum ARM Clock Rate: NULL\r\n" );
 
-	/* Ensure the ARM is running at it's maximum rate */
-	RPI_PropertyInit();
-	RPI_PropertyAddTag( TAG_SET_CLOCK_RATE, TAG_CLOCK_ARM, mp->data.buffer_32[1] );
-	RPI_PropertyProcess();
+	/* Ensure the ARM is running at it's maximum rate. The current rate is
+	   cached until it's invalidated, so it has to be forgotten once changed */
+	if( mp )
+	{
+		t = RPI_PropertyInit();
+		RPI_PropertyAdd_SET_CLOCK_RATE( t, TAG_CLOCK_ARM, mp->data.buffer_32[1], 0 );
+		RPI_PropertyProcess();
 
-	RPI_PropertyInit();
-	RPI_PropertyAddTag( TAG_GET_CLOCK_RATE, TAG_CLOCK_ARM );
-	RPI_PropertyProcess();
+		RPI_PropertyCacheInvalidate( TAG_GET_CLOCK_RATE );
+	}
 
-	mp = RPI_PropertyGet( TAG_GET_CLOCK_RATE );
+	mp = RPI_PropertyCacheGet( TAG_GET_CLOCK_RATE, TAG_CLOCK_ARM );
 
 	if( mp )
 		printf( "Set ARM Clock Rate: %d MHz\r\n", mp->data.buffer_32[1] / (1000000));
 	else
 		printf( "Set ARM Clock Rate: NULL\r\n" );
 
+	printf( "Property cache: %u hits, %u misses, %u round trips\r\n",
+			(unsigned int)RPI_PropertyCacheStats()->hits,
+			(unsigned int)RPI_PropertyCacheStats()->misses,
+			(unsigned int)RPI_PropertyCacheStats()->round_trips );
+
 	SIP_t *sip = (SIP_t *)malloc(sizeof(SIP_t));
 	memset(sip, 0x0, sizeof(SIP_t));
 
 	SIPRegisterCommand(sip, 0x00, dummy);
+	SIPSetDeferred(sip, true, sipClock);
+	SIPSetTransmit(sip, sipTransmit);
 	IRQRegister(RPI_IRQ_ARM_TIMER, timerHandler, 0);
-	IRQRegister(RPI_IRQ_AUX_INT, uartRxHandler, 0);
+	IRQRegister(RPI_IRQ_AUX_INT, RPI_AuxMiniUartIRQHandler, 0);
+	IRQRegister(RPI_IRQ_ARM_MAILBOX, RPI_PropertyIRQHandler, 0);
+
+	/* Property answers are picked up by the interrupt from here on, the
+	   blocking calls above and in RPI_FramebufferInit still work */
+	RPI_PropertyEnableIrq();
+
+	RayCaster_t rc;
+	RayCasterSurface_t surface;
+	RayCasterSurface_t columns;
+	RayCasterSurface_t *target = &surface;
+
+	/* Each frame's rays are cast on a core of their own a frame ahead of it
+	   being drawn, the drawing is shared out between the rest. With just
+	   this core the stages take turns */
+	static RayCasterPipeline_t pipeline;
+
+	if( RPI_FramebufferInit( SCREEN_WIDTH, SCREEN_HEIGHT, 32 ) == 0 )
+	{
+		rpi_framebuffer_t *fb = RPI_GetFramebuffer();
+
+		printf( "Framebuffer: %dx%d pitch %d, %d page(s)\r\n",
+				(int)fb->width, (int)fb->height, (int)fb->pitch, (int)fb->pages );
+
+		/* The framebuffer is in the VideoCore's RAM, which isn't mapped
+		   until now. It's drawn to through the cache like any other
+		   memory, flipping cleans the finished page out to RAM */
+		RPI_MmuRemap( (uint32_t)fb->buffer, fb->size, RPI_MMU_WRITE_BACK );
+
+		surface.width = fb->width;
+		surface.height = fb->height;
+		surface.pitch = fb->pitch;
+		surface.layout = RAYCASTER_ROW_MAJOR;
+		surface.pixels = (uint32_t *)RPI_FramebufferGetBackBuffer();
+
+		if( RENDER_COLUMN_MAJOR )
+		{
+			columns.width = surface.width;
+			columns.height = surface.height;
+			columns.pitch = RAYCASTER_COLUMN_PITCH( surface.height );
+			columns.layout = RAYCASTER_COLUMN_MAJOR;
+			columns.pixels = (uint32_t *)malloc( columns.pitch * columns.width );
+
+			if( columns.pixels )
+				target = &columns;
+		}
+
+		printf( "Render target: %s\r\n", target == &columns ? "column major" : "framebuffer" );
+	}
+	else
+	{
+		/* No display, render off-screen so the frame rate can still be
+		   watched over the UART */
+		printf( "Framebuffer: NULL\r\n" );
+
+		surface.width = SCREEN_WIDTH;
+		surface.height = SCREEN_HEIGHT;
+		surface.pitch = SCREEN_WIDTH * 4;
+		surface.layout = RAYCASTER_ROW_MAJOR;
+		surface.pixels = (uint32_t *)malloc(surface.pitch * surface.height);
+	}
+
+	RayCasterInit(&rc, &RayCasterDemoMap);
+	rc.textures = RayCasterDemoTextures();
+	RayCasterPipelineInit(&pipeline, surface.width, RAYCASTER_SPLIT_ADAPTIVE, sipClock);
+
+	printf( "Cast stage: %s\r\n", RayCasterPipelineStart( &pipeline ) ? "own core" : "inline" );
+
+	RayCasterPipelineSubmit(&pipeline, &rc);
+	RayCasterRotate(&rc, RAYCASTER_TURN_COS, RAYCASTER_TURN_SIN);
+
+	uint32_t present_time = 0;
+
+	uint32_t frames = 0;
+	uint32_t ts = RPI_REG_READ( RPI_GetSystemTimer()->counter_lo );
+
+	/* The SoC temperature is asked for once a second without waiting */
+	rpi_property_transaction_t *temperature = NULL;
+	uint32_t millidegrees = 0;
 
 	/* Enable interrupts! */
 	_enable_interrupts();
 
 	while( 1 )
 	{
-		// fetch data from mini uart
-		char ch;
-		RPI_AuxMiniUartBlockRead(&ch);
-
-		printf("Poll:%c\r\n", ch);
-		
-		//SIPFeedInput(sip, ch);
+		/* Frame N+1 goes to the cast stage before frame N is drawn */
+		RayCasterPipelineSubmit(&pipeline, &rc);
+		RayCasterRotate(&rc, RAYCASTER_TURN_COS, RAYCASTER_TURN_SIN);
+
+		RayCasterPipelineDraw(&pipeline, target);
+
+		if( RPI_GetFramebuffer()->buffer )
+		{
+			uint32_t present = sipClock();
+
+			if( target == &columns )
+				RayCasterTranspose( &columns, &surface );
+
+			RPI_FramebufferFlip();
+			surface.pixels = (uint32_t *)RPI_FramebufferGetBackBuffer();
+			present_time = sipClock() - present;
+		}
+
+		frames++;
+
+		if( temperature && RPI_PropertyPoll( temperature ) )
+		{
+			mp = RPI_PropertyResult( temperature, TAG_GET_TEMPERATURE );
+
+			if( mp )
+				millidegrees = mp->data.buffer_32[1];
+
+			RPI_PropertyRelease( temperature );
+			temperature = NULL;
+		}
+
+		if( ( RPI_REG_READ( RPI_GetSystemTimer()->counter_lo ) - ts ) >= 1000000 )
+		{
+			printf("FPS:%u imbalance:%u%% cast:%uus draw:%uus stall:%uus present:%uus temp:%uC RX overruns:%u/%u SIP depth:%u latency:%uus dropped:%u bad CRC:%u\r\n",
+				   (unsigned int)frames,
+				   (unsigned int)RayCasterParallelImbalance(&pipeline.draw),
+				   (unsigned int)pipeline.times.cast,
+				   (unsigned int)pipeline.times.draw,
+				   (unsigned int)pipeline.times.stall,
+				   (unsigned int)present_time,
+				   (unsigned int)( millidegrees / 1000 ),
+				   (unsigned int)RPI_AuxMiniUartRxStats()->ring_overruns,
+				   (unsigned int)RPI_AuxMiniUartRxStats()->fifo_overruns,
+				   (unsigned int)sip->QueueStats.max_depth,
+				   (unsigned int)sip->QueueStats.latency_max,
+				   (unsigned int)sip->QueueStats.dropped,
+				   (unsigned int)sip->ErrorCount[INVALID_CS_ERROR]);
+			frames = 0;
+			ts = RPI_REG_READ( RPI_GetSystemTimer()->counter_lo );
+
+			if( ( temperature == NULL ) && ( ( temperature = RPI_PropertyBegin() ) != NULL ) )
+			{
+				RPI_PropertyAdd_GET_TEMPERATURE( temperature, 0 );
+
+				if( !RPI_PropertySubmit( temperature, NULL, NULL ) )
+				{
+					RPI_PropertyRelease( temperature );
+					temperature = NULL;
+				}
+			}
+		}
+
+		// pick up whatever the uart interrupt has received since the last frame
+		char rx[64];
+		int n = RPI_AuxMiniUartRead(rx, sizeof(rx));
+
+		SIPFeedBuffer(sip, rx, n);
+
+		// the parser only queues complete frames, their handlers run here
+		SIPProcessQueue(sip, -1);
 	}
 }
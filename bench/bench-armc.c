@@ -0,0 +1,619 @@
+/* Microbenchmarks that build both natively and into a kernel image, so the
+   same numbers can be taken on a PC and on the Pi. On the host time is the
+   monotonic clock and the results go to stdout; on the Pi it's the 1MHz
+   system timer and they go out of the mini UART.
+
+   Each benchmark doubles its iteration count until a run lasts at least
+   BENCH_MIN_NS, then reports the time per operation. After the table every
+   result is repeated as a BENCH,<platform>,<name>,<ops>,<ns per op> line
+   for scripts tracking regressions to pick out of the log */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rpi-aux.h"
+#include "rpi-cache.h"
+#include "rpi-hal.h"
+#include "rpi-interrupts.h"
+#include "rpi-mailbox-interface.h"
+#include "rpi-mmu.h"
+#include "rpi-systimer.h"
+#include "raycaster.h"
+#include "raycaster-texture.h"
+#include "raycaster-blit.h"
+#include "sip.h"
+
+#if defined( RPI_HOST )
+	#include <time.h>
+
+	#include "rpi-aux-sim.h"
+
+	#define BENCH_PLATFORM  "host"
+#elif defined( RPI2 )
+	#define BENCH_PLATFORM  "rpi2"
+#else
+	#define BENCH_PLATFORM  "rpi"
+#endif
+
+#define BENCH_MIN_NS        100000000ULL
+#define BENCH_MAX_RESULTS   24
+
+#define SIP_FRAMES          64
+#define SIP_PAYLOAD         32
+#define SIP_COMMAND         0x10
+
+#define UART_LINE           64
+
+#define MEMORY_BYTES        4096
+
+/* Cache maintenance is timed a KB at a time, walking through a buffer
+   bigger than the data cache */
+#define CACHE_KB            1024
+#define CACHE_BUFFER_KB     64
+
+/* A textured wall strip the height of a 640x480 screen, drawn down each
+   column of it in turn as a frame would */
+#define COLUMN_WIDTH        640
+#define COLUMN_HEIGHT       480
+
+/* The dispatch benchmark's handlers sit on interrupts nothing else uses */
+#define DISPATCH_BASE       RPI_IRQ_8
+#define DISPATCH_PENDING    0x0000000B
+
+typedef void (*bench_fn_t)(uint32_t iterations);
+
+typedef struct
+{
+	const char *name;
+	uint32_t ops;
+	uint64_t ns;
+} BenchResult_t;
+
+static BenchResult_t results[BENCH_MAX_RESULTS];
+static int result_count;
+
+static SIP_t sip;
+static char sip_text[SIP_FRAMES * SIP_TEXT_FRAME_LEN(SIP_PAYLOAD)];
+static size_t sip_text_length;
+static uint8_t sip_binary[SIP_FRAMES * SIP_BINARY_FRAME_LEN(SIP_PAYLOAD)];
+static size_t sip_binary_length;
+static volatile uint32_t sip_frames;
+
+static rpi_property_transaction_t *answered;
+
+static uint8_t memory_src[MEMORY_BYTES];
+static uint8_t memory_dst[MEMORY_BYTES];
+
+static uint8_t cache_buffer[CACHE_BUFFER_KB * CACHE_KB] RPI_CACHE_ALIGNED;
+static uint32_t cache_kb;
+
+static uint32_t column_surface[COLUMN_WIDTH * COLUMN_HEIGHT];
+static uint32_t column_x;
+static uint32_t ray_x;
+
+// the same screen column major, for the transpose into column_surface
+static uint32_t column_major[COLUMN_WIDTH * COLUMN_HEIGHT] RPI_CACHE_ALIGNED;
+
+static volatile uint32_t dispatched;
+static volatile uint32_t sink;
+
+static uint64_t now_ns(void)
+{
+#if defined( RPI_HOST )
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#else
+	rpi_sys_timer_t *timer = RPI_GetSystemTimer();
+	uint32_t hi, lo;
+
+	// the high word can tick over between the two reads
+	do
+	{
+		hi = RPI_REG_READ(timer->counter_hi);
+		lo = RPI_REG_READ(timer->counter_lo);
+	} while (hi != RPI_REG_READ(timer->counter_hi));
+
+	return (((uint64_t)hi << 32) | lo) * 1000;
+#endif
+}
+
+static void run(const char *name, bench_fn_t fn)
+{
+	uint32_t iterations = 1;
+	uint64_t elapsed;
+
+	// whatever has been printed so far goes out before the clock starts
+	RPI_AuxMiniUartFlush();
+
+	while (1)
+	{
+		uint64_t start = now_ns();
+
+		fn(iterations);
+		elapsed = now_ns() - start;
+
+		if (elapsed >= BENCH_MIN_NS || iterations >= 0x40000000)
+			break;
+
+		iterations <<= 1;
+	}
+
+	if (result_count < BENCH_MAX_RESULTS)
+	{
+		results[result_count].name = name;
+		results[result_count].ops = iterations;
+		results[result_count].ns = elapsed;
+		result_count++;
+	}
+
+	printf("%-22s %8u.%u ns/op %10u ops\r\n", name,
+		(unsigned int)(elapsed / iterations),
+		(unsigned int)(elapsed * 10 / iterations % 10), (unsigned int)iterations);
+}
+
+static int sip_count(uint8_t *payload, uint16_t payload_length,
+					 SIPResponse_t *response)
+{
+	sip_frames++;
+	return 0;
+}
+
+static void sip_setup(void)
+{
+	uint8_t payload[SIP_PAYLOAD];
+	int i;
+
+	for (i = 0; i < SIP_PAYLOAD; i++)
+		payload[i] = (uint8_t)(i * 7);
+
+	for (i = 0; i < SIP_FRAMES; i++)
+	{
+		payload[0] = (uint8_t)i;
+		sip_text_length += SIPEncodeText(&sip_text[sip_text_length], SIP_COMMAND, i,
+										 payload, SIP_PAYLOAD);
+		sip_binary_length += SIPEncodeBinary(&sip_binary[sip_binary_length], SIP_COMMAND, i,
+											 payload, SIP_PAYLOAD);
+	}
+
+	memset(&sip, 0, sizeof(sip));
+	SIPRegisterCommand(&sip, SIP_COMMAND, sip_count);
+}
+
+// one op is one frame
+static void bench_sip_text(uint32_t iterations)
+{
+	SIPSetMode(&sip, SIP_MODE_TEXT);
+
+	while (iterations > SIP_FRAMES)
+	{
+		SIPFeedBuffer(&sip, sip_text, sip_text_length);
+		iterations -= SIP_FRAMES;
+	}
+
+	SIPFeedBuffer(&sip, sip_text, sip_text_length * iterations / SIP_FRAMES);
+}
+
+static void bench_sip_binary(uint32_t iterations)
+{
+	SIPSetMode(&sip, SIP_MODE_BINARY);
+
+	while (iterations > SIP_FRAMES)
+	{
+		SIPFeedBuffer(&sip, (const char *)sip_binary, sip_binary_length);
+		iterations -= SIP_FRAMES;
+	}
+
+	SIPFeedBuffer(&sip, (const char *)sip_binary, sip_binary_length * iterations / SIP_FRAMES);
+}
+
+static void build_query(rpi_property_transaction_t *t)
+{
+	RPI_PropertyAdd_GET_BOARD_MODEL(t);
+	RPI_PropertyAdd_GET_BOARD_REVISION(t);
+	RPI_PropertyAdd_GET_FIRMWARE_VERSION(t);
+	RPI_PropertyAdd_GET_BOARD_MAC_ADDRESS(t);
+	RPI_PropertyAdd_GET_BOARD_SERIAL(t);
+	RPI_PropertyAdd_GET_MAX_CLOCK_RATE(t, TAG_CLOCK_ARM);
+}
+
+// one op is building the six tag board query
+static void bench_property_build(uint32_t iterations)
+{
+	rpi_property_transaction_t *t = NULL;
+
+	while (iterations--)
+	{
+		t = RPI_PropertyInit();
+		build_query(t);
+	}
+
+	sink = t->pt_index;
+}
+
+// one op is finding all six answers
+static void bench_property_lookup(uint32_t iterations)
+{
+	uint32_t sum = 0;
+
+	while (iterations--)
+	{
+		sum += RPI_PropertyResult(answered, TAG_GET_BOARD_MODEL)->tag;
+		sum += RPI_PropertyResult(answered, TAG_GET_BOARD_REVISION)->tag;
+		sum += RPI_PropertyResult(answered, TAG_GET_FIRMWARE_VERSION)->tag;
+		sum += RPI_PropertyResult(answered, TAG_GET_BOARD_MAC_ADDRESS)->tag;
+		sum += RPI_PropertyResult(answered, TAG_GET_BOARD_SERIAL)->tag;
+		sum += RPI_PropertyResult(answered, TAG_GET_MAX_CLOCK_RATE)->tag;
+	}
+
+	sink = sum;
+}
+
+// one op is queueing a line. Lines come far faster than the wire takes
+// them, so the oldest unsent bytes are overwritten and every call costs the
+// same: the copy and topping up the FIFO
+static void bench_uart_queue(uint32_t iterations)
+{
+	static const char line[UART_LINE] =
+		"0123456789abcdef0123456789abcdef0123456789abcdef0123456789abc\r\n";
+
+	while (iterations--)
+		RPI_AuxMiniUartQueue(line, UART_LINE);
+}
+
+static void dispatch_handler(uint32_t irq, void *args)
+{
+	dispatched++;
+}
+
+// one op is dispatching three pending interrupts
+static void bench_dispatch(uint32_t iterations)
+{
+	while (iterations--)
+		handleInterruptRange(DISPATCH_PENDING, DISPATCH_BASE);
+}
+
+static void bench_memcpy(uint32_t iterations)
+{
+	while (iterations--)
+	{
+		memcpy(memory_dst, memory_src, MEMORY_BYTES);
+		memory_src[iterations & (MEMORY_BYTES - 1)] = memory_dst[0];
+	}
+}
+
+static void bench_memset(uint32_t iterations)
+{
+	while (iterations--)
+		memset(memory_dst, (int)iterations, MEMORY_BYTES);
+
+	sink = memory_dst[MEMORY_BYTES - 1];
+}
+
+// dirty every line of the next KB, which is all cache_dirty_1k does. The
+// maintenance benchmarks do the same first, so the cost of the operation
+// itself is theirs less that one
+static uint8_t *cache_dirty(void)
+{
+	uint8_t *kb = &cache_buffer[cache_kb * CACHE_KB];
+	int i;
+
+	for (i = 0; i < CACHE_KB; i += RPI_CACHE_LINE)
+		kb[i] = (uint8_t)i;
+
+	cache_kb = (cache_kb + 1) % CACHE_BUFFER_KB;
+
+	return kb;
+}
+
+static void bench_cache_dirty(uint32_t iterations)
+{
+	while (iterations--)
+		cache_dirty();
+}
+
+static void bench_cache_clean(uint32_t iterations)
+{
+	while (iterations--)
+		RPI_CacheCleanRange(cache_dirty(), CACHE_KB);
+}
+
+static void bench_cache_invalidate(uint32_t iterations)
+{
+	while (iterations--)
+		RPI_CacheInvalidateRange(cache_dirty(), CACHE_KB);
+}
+
+static void bench_cache_flush(uint32_t iterations)
+{
+	while (iterations--)
+		RPI_CacheFlushRange(cache_dirty(), CACHE_KB);
+}
+
+typedef void (*texel_run_t)(uint32_t *dst, uint32_t stride, const uint32_t *texels,
+							uint32_t pos, uint32_t step, uint32_t count, uint32_t shade);
+
+// one op is one column, the texture stepped through once from top to bottom
+static void wall_columns(uint32_t iterations, texel_run_t texel_run)
+{
+	const RayCasterTexture_t *textures = RayCasterDemoTextures();
+	uint32_t step = (RAYCASTER_TEX_SIZE << FIXED_SHIFT) / COLUMN_HEIGHT;
+
+	while (iterations--)
+	{
+		texel_run(&column_surface[column_x], COLUMN_WIDTH,
+				  &textures[column_x & (RAYCASTER_WALL_COLOURS - 1)][(column_x & (RAYCASTER_TEX_SIZE - 1)) * RAYCASTER_TEX_SIZE],
+				  0, step, COLUMN_HEIGHT, column_x & 1);
+
+		column_x = (column_x + 1) % COLUMN_WIDTH;
+	}
+}
+
+// one op is casting one ray, a frame's worth at the width the lookup
+// tables were built for so the camera x comes from the table
+static void bench_ray_cast(uint32_t iterations)
+{
+	static RayCaster_t rc;
+	RayCasterHit_t hit;
+	uint32_t sum = 0;
+
+	if (rc.map == NULL)
+		RayCasterInit(&rc, &RayCasterDemoMap);
+
+	while (iterations--)
+	{
+		RayCasterCastColumn(&rc, ray_x, RAYCASTER_SCREEN_WIDTH, &hit);
+		sum += (uint32_t)hit.distance;
+
+		ray_x = (ray_x + 1) % RAYCASTER_SCREEN_WIDTH;
+	}
+
+	sink = sum;
+}
+
+static void bench_wall_column_scalar(uint32_t iterations)
+{
+	wall_columns(iterations, RayCasterTexelRunScalar);
+}
+
+#if defined( RAYCASTER_NEON )
+static void bench_wall_column_neon(uint32_t iterations)
+{
+	wall_columns(iterations, RayCasterTexelRunNeon);
+}
+#endif
+
+typedef void (*transpose_t)(const RayCasterSurface_t *src, RayCasterSurface_t *dst);
+
+// one op is a whole 640x480 frame
+static void transposes(uint32_t iterations, transpose_t transpose)
+{
+	RayCasterSurface_t src = { column_major, COLUMN_WIDTH, COLUMN_HEIGHT,
+							   RAYCASTER_COLUMN_PITCH(COLUMN_HEIGHT), RAYCASTER_COLUMN_MAJOR };
+	RayCasterSurface_t dst = { column_surface, COLUMN_WIDTH, COLUMN_HEIGHT,
+							   COLUMN_WIDTH * 4, RAYCASTER_ROW_MAJOR };
+
+	while (iterations--)
+		transpose(&src, &dst);
+}
+
+static void bench_transpose_scalar(uint32_t iterations)
+{
+	transposes(iterations, RayCasterTransposeScalar);
+}
+
+#if defined( RAYCASTER_NEON )
+static void bench_transpose_neon(uint32_t iterations)
+{
+	transposes(iterations, RayCasterTransposeNeon);
+}
+#endif
+
+#if defined( RAYCASTER_NEON )
+
+#define CHECK_RUN_MAX       40
+#define CHECK_RUN_STRIDE    3
+
+// FNV-1a over a row major surface's pixels
+static uint32_t surface_hash(const uint32_t *pixels, uint32_t width, uint32_t height)
+{
+	uint32_t hash = 2166136261u;
+	uint32_t x, y;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+			hash = (hash ^ pixels[y * COLUMN_WIDTH + x]) * 16777619u;
+	}
+
+	return hash;
+}
+
+// The NEON paths have to draw exactly what the scalar ones do. Texel runs
+// of every length either side of a whole number of vectors, down a column
+// and along a row, both shades, with a step that doesn't divide a texel.
+// Then the transpose of the full screen and of one whose edges aren't a
+// multiple of the 4x4 blocks
+static int check_neon(void)
+{
+	static uint32_t scalar[CHECK_RUN_MAX * CHECK_RUN_STRIDE];
+	static uint32_t neon[CHECK_RUN_MAX * CHECK_RUN_STRIDE];
+	static const uint32_t strides[] = { 1, CHECK_RUN_STRIDE };
+	static const uint32_t sizes[][2] = { { COLUMN_WIDTH, COLUMN_HEIGHT }, { 637, 477 } };
+	const RayCasterTexture_t *textures = RayCasterDemoTextures();
+	uint32_t stride, count, shade, i, j;
+	uint32_t runs_wrong = 0;
+	uint32_t transposes_wrong = 0;
+
+	for (j = 0; j < sizeof(strides) / sizeof(strides[0]); j++)
+	{
+		stride = strides[j];
+
+		for (count = 0; count <= CHECK_RUN_MAX; count++)
+		{
+			for (shade = 0; shade <= 1; shade++)
+			{
+				const uint32_t *texels = textures[count % RAYCASTER_WALL_COLOURS];
+				uint32_t pos = count * 0x1234;
+				uint32_t step = 0x17c3f + count * 0x301;
+
+				memset(scalar, 0, sizeof(scalar));
+				memset(neon, 0, sizeof(neon));
+
+				RayCasterTexelRunScalar(scalar, stride, texels, pos, step, count, shade);
+				RayCasterTexelRunNeon(neon, stride, texels, pos, step, count, shade);
+
+				if (memcmp(scalar, neon, sizeof(scalar)) != 0)
+					runs_wrong++;
+			}
+		}
+	}
+
+	for (i = 0; i < COLUMN_WIDTH * COLUMN_HEIGHT; i++)
+		column_major[i] = i * 2654435761u;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		RayCasterSurface_t src = { column_major, sizes[i][0], sizes[i][1],
+								   RAYCASTER_COLUMN_PITCH(COLUMN_HEIGHT), RAYCASTER_COLUMN_MAJOR };
+		RayCasterSurface_t dst = { column_surface, sizes[i][0], sizes[i][1],
+								   COLUMN_WIDTH * 4, RAYCASTER_ROW_MAJOR };
+		uint32_t expected;
+
+		memset(column_surface, 0, sizeof(column_surface));
+		RayCasterTransposeScalar(&src, &dst);
+		expected = surface_hash(column_surface, COLUMN_WIDTH, COLUMN_HEIGHT);
+
+		memset(column_surface, 0, sizeof(column_surface));
+		RayCasterTransposeNeon(&src, &dst);
+
+		if (surface_hash(column_surface, COLUMN_WIDTH, COLUMN_HEIGHT) != expected)
+			transposes_wrong++;
+	}
+
+	printf("neon texel runs %s, transposes %s\r\n",
+		runs_wrong ? "WRONG" : "ok", transposes_wrong ? "WRONG" : "ok");
+
+	return runs_wrong != 0 || transposes_wrong != 0;
+}
+
+#endif
+
+static void report(void)
+{
+	int i;
+
+	for (i = 0; i < result_count; i++)
+	{
+		printf("BENCH,%s,%s,%u,%u.%u\r\n", BENCH_PLATFORM, results[i].name,
+			(unsigned int)results[i].ops,
+			(unsigned int)(results[i].ns / results[i].ops),
+			(unsigned int)(results[i].ns * 10 / results[i].ops % 10));
+	}
+
+	RPI_AuxMiniUartFlush();
+}
+
+// returns non zero if a check failed, the benchmarks run either way
+static int bench_all(void)
+{
+	int failed = 0;
+	int i;
+
+	printf("armc_bench on %s, at least %u ms per benchmark\r\n", BENCH_PLATFORM,
+		(unsigned int)(BENCH_MIN_NS / 1000000));
+
+#if defined( RAYCASTER_NEON )
+	failed |= check_neon();
+#endif
+
+	sip_setup();
+
+	run("sip_text_frame", bench_sip_text);
+	run("sip_binary_frame", bench_sip_binary);
+
+	answered = RPI_PropertyBegin();
+	if (answered)
+	{
+		build_query(answered);
+		RPI_PropertySubmit(answered, NULL, NULL);
+
+		while (!RPI_PropertyPoll(answered)) { }
+
+		run("property_build", bench_property_build);
+
+		// a tag the firmware doesn't answer would make the lookups crash
+		if (RPI_PropertyResult(answered, TAG_GET_MAX_CLOCK_RATE) &&
+			RPI_PropertyResult(answered, TAG_GET_BOARD_SERIAL))
+			run("property_lookup", bench_property_lookup);
+
+		RPI_PropertyRelease(answered);
+	}
+
+	RPI_AuxMiniUartSetTxPolicy(AUX_TX_OVERWRITE);
+	run("uart_queue_line", bench_uart_queue);
+	RPI_AuxMiniUartSetTxPolicy(AUX_TX_BLOCK);
+
+	for (i = 0; i < 4; i++)
+		IRQRegister(DISPATCH_BASE + i, dispatch_handler, NULL);
+
+	run("irq_dispatch_3", bench_dispatch);
+
+	run("memcpy_4k", bench_memcpy);
+	run("memset_4k", bench_memset);
+
+	run("cache_dirty_1k", bench_cache_dirty);
+	run("cache_clean_1k", bench_cache_clean);
+	run("cache_invalidate_1k", bench_cache_invalidate);
+	run("cache_flush_1k", bench_cache_flush);
+
+	run("ray_cast", bench_ray_cast);
+	run("wall_column_scalar", bench_wall_column_scalar);
+#if defined( RAYCASTER_NEON )
+	run("wall_column_neon", bench_wall_column_neon);
+#endif
+
+	run("transpose_640x480", bench_transpose_scalar);
+#if defined( RAYCASTER_NEON )
+	run("transpose_640x480_neon", bench_transpose_neon);
+#endif
+
+	printf("sip frames %u, irqs %u\r\n", (unsigned int)sip_frames, (unsigned int)dispatched);
+
+	report();
+
+	return failed;
+}
+
+#if defined( RPI_HOST )
+
+int main(void)
+{
+	/* The mini UART model runs on virtual time, printf goes straight to
+	   stdout and the queue benchmark has the model to itself */
+	RPI_AuxSimReset(115200);
+	RPI_AuxMiniUartInit(115200, 8, true);
+
+	return bench_all();
+}
+
+#else
+
+void kernel_main(unsigned int r0, unsigned int r1, unsigned int atags)
+{
+	IRQRegister(RPI_IRQ_AUX_INT, RPI_AuxMiniUartIRQHandler, 0);
+	RPI_AuxMiniUartInit(115200, 8, true);
+
+	// measured with the caches on, the way the kernel runs
+	if (RPI_MmuInit() != 0)
+		printf("MMU off, numbers are uncached\r\n");
+
+	_enable_interrupts();
+
+	bench_all();
+
+	while (1) { }
+}
+
+#endif
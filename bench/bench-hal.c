@@ -0,0 +1,245 @@
+/* Host benchmark for the timer and interrupt paths, run against the
+   peripheral models behind rpi-hal.h. Time is the HAL's virtual time: every
+   register access costs what it would over the Pi's peripheral bus, so the
+   numbers only change when the drivers change how they talk to the
+   hardware.
+
+   The system timer busy wait is timed against what it was asked for, and
+   the ARM timer is checked to finish the countdown in progress when its
+   Reload is written. Then the ARM timer and a system timer compare channel
+   interrupt the main loop for a virtual second each, going through the
+   interrupt controller the way the IRQ vector does. Last, the mini UART receives at line rate with
+   its handler called straight from the model and through the controller */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rpi-armtimer.h"
+#include "rpi-aux.h"
+#include "rpi-aux-sim.h"
+#include "rpi-hal-sim.h"
+#include "rpi-interrupts.h"
+#include "rpi-systimer.h"
+
+#define SECOND_NS       1000000000ULL
+
+/* The system timer compare channel the tick runs on. 0 and 2 belong to the
+   VideoCore */
+#define TICK_CHANNEL    1
+#define TICK_US         1000
+
+#define BAUD            115200
+#define RX_BYTES        4096
+#define FRAME_NS        16666666ULL
+
+static uint32_t ticks;
+
+/* Let ns of virtual time pass, taking interrupts whenever the controller
+   has one pending. Returns the CPU time spent taking them */
+static uint64_t run_for(uint64_t ns, bool through_controller, uint32_t *taken)
+{
+	uint64_t end = RPI_HalSimTime() + ns;
+	uint64_t cpu = 0;
+
+	while (RPI_HalSimTime() < end)
+	{
+		bool pending = through_controller ? RPI_HalSimIrqPending() : RPI_AuxSimIrqPending();
+
+		if (pending)
+		{
+			uint64_t t = RPI_HalSimTime();
+
+			if (through_controller)
+				RPI_IrqDispatch();
+			else
+				RPI_AuxMiniUartIRQHandler(RPI_IRQ_AUX_INT, 0);
+
+			cpu += RPI_HalSimTime() - t;
+			(*taken)++;
+		}
+		else
+		{
+			uint64_t next = RPI_HalSimNextEvent();
+
+			if (next <= RPI_HalSimTime() || next > end)
+				next = end;
+
+			RPI_HalSimAdvance(next - RPI_HalSimTime());
+		}
+	}
+
+	return cpu;
+}
+
+static uint64_t accesses(void)
+{
+	return RPI_HalSimState()->reads + RPI_HalSimState()->writes;
+}
+
+static void bench_wait(void)
+{
+	static const uint32_t waits[] = { 1, 10, 100, 1000 };
+	unsigned int i;
+
+	RPI_HalSimReset();
+
+	for (i = 0; i < sizeof(waits) / sizeof(waits[0]); i++)
+	{
+		uint64_t t = RPI_HalSimTime();
+		uint64_t a = accesses();
+
+		RPI_WaitMicroSeconds(waits[i]);
+
+		printf("wait %4u us       took %8.3f us  %6llu reads\n", waits[i],
+			(RPI_HalSimTime() - t) / 1000.0, (unsigned long long)(accesses() - a));
+	}
+}
+
+static void arm_timer_tick(uint32_t irq, void *args)
+{
+	RPI_REG_WRITE(RPI_GetArmTimer()->IRQClear, 1);
+	ticks++;
+}
+
+static void systimer_tick(uint32_t irq, void *args)
+{
+	rpi_sys_timer_t *timer = RPI_GetSystemTimer();
+
+	RPI_REG_WRITE(timer->control_status, 1 << TICK_CHANNEL);
+	RPI_REG_WRITE(timer->compare1, RPI_REG_READ(timer->compare1) + TICK_US);
+	ticks++;
+}
+
+static void report_ticks(const char *name, uint64_t cpu, uint32_t taken, uint64_t a)
+{
+	printf("%-18s %6u irqs/sec  cpu %7.1f ns/irq  %4.1f accesses/irq  handled %u\n",
+		name, taken, taken ? (double)cpu / taken : 0.0,
+		taken ? (double)a / taken : 0.0, ticks);
+}
+
+static void bench_arm_timer(void)
+{
+	uint32_t taken = 0;
+	uint64_t cpu, a;
+
+	RPI_HalSimReset();
+	ticks = 0;
+
+	IRQRegister(RPI_IRQ_ARM_TIMER, arm_timer_tick, NULL);
+	RPI_ArmTimerInit();
+	RPI_EnableIrq(RPI_IRQ_ARM_TIMER);
+
+	a = accesses();
+	cpu = run_for(SECOND_NS, true, &taken);
+
+	report_ticks("arm timer", cpu, taken, accesses() - a);
+
+	RPI_DisableIrq(RPI_IRQ_ARM_TIMER);
+}
+
+/* Reload only sets what the next countdown starts from. Halving it a
+   quarter of the way through a period can't move the interrupt that's
+   due, only the ones after it */
+static int check_arm_timer_reload(void)
+{
+	rpi_arm_timer_t *timer = RPI_GetArmTimer();
+	uint64_t due, period, after;
+	int ok;
+
+	RPI_HalSimReset();
+	RPI_ArmTimerInit();
+
+	// from one expiry to the next is a whole period of Load
+	RPI_HalSimAdvance(RPI_HalSimNextEvent() - RPI_HalSimTime());
+	due = RPI_HalSimNextEvent();
+	period = due - RPI_HalSimTime();
+
+	RPI_HalSimAdvance(period / 4);
+	RPI_REG_WRITE(timer->Reload, RPI_REG_READ(timer->Load) / 2);
+
+	ok = RPI_HalSimNextEvent() == due;
+
+	RPI_HalSimAdvance(due - RPI_HalSimTime());
+	after = RPI_HalSimNextEvent() - due;
+
+	// Load + 1 timer clocks each, 0x801 of them before and 0x401 after
+	ok = ok && after * 0x801 == period * 0x401;
+
+	printf("%-18s period %8.1f us finished, then %8.1f us  %s\n", "arm timer reload",
+		period / 1000.0, after / 1000.0, ok ? "ok" : "WRONG");
+
+	return !ok;
+}
+
+static void bench_systimer(void)
+{
+	rpi_sys_timer_t *timer = RPI_GetSystemTimer();
+	uint32_t taken = 0;
+	uint64_t cpu, a;
+
+	RPI_HalSimReset();
+	ticks = 0;
+
+	IRQRegister(RPI_IRQ_0 + TICK_CHANNEL, systimer_tick, NULL);
+	RPI_REG_WRITE(timer->compare1, RPI_REG_READ(timer->counter_lo) + TICK_US);
+	RPI_EnableIrq(RPI_IRQ_0 + TICK_CHANNEL);
+
+	a = accesses();
+	cpu = run_for(SECOND_NS, true, &taken);
+
+	report_ticks("system timer", cpu, taken, accesses() - a);
+
+	RPI_DisableIrq(RPI_IRQ_0 + TICK_CHANNEL);
+}
+
+static void bench_uart_rx(const char *name, bool through_controller)
+{
+	static uint8_t incoming[RX_BYTES];
+	char buffer[AUX_RX_BUFFER_SIZE];
+	uint32_t taken = 0;
+	uint32_t got = 0;
+	uint64_t cpu = 0;
+
+	memset(incoming, 'r', sizeof(incoming));
+
+	RPI_HalSimReset();
+	RPI_AuxSimReset(BAUD);
+	IRQRegister(RPI_IRQ_AUX_INT, RPI_AuxMiniUartIRQHandler, NULL);
+	RPI_AuxMiniUartInit(BAUD, 8, true);
+
+	RPI_AuxSimReceive(incoming, sizeof(incoming));
+
+	while (got < RX_BYTES)
+	{
+		cpu += run_for(FRAME_NS, through_controller, &taken);
+		got += RPI_AuxMiniUartRead(buffer, sizeof(buffer));
+	}
+
+	printf("%-18s %6u irqs      cpu %7.1f ns/byte  read %u\n",
+		name, taken, (double)cpu / got, got);
+
+	RPI_DisableIrq(RPI_IRQ_AUX_INT);
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	printf("system timer busy wait\n");
+
+	bench_wait();
+
+	printf("timer interrupts for a virtual second\n");
+
+	failed |= check_arm_timer_reload();
+	bench_arm_timer();
+	bench_systimer();
+
+	printf("mini uart rx, %d bytes at %d baud\n", RX_BYTES, BAUD);
+
+	bench_uart_rx("uart direct", false);
+	bench_uart_rx("uart controller", true);
+
+	return failed;
+}
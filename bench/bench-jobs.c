@@ -0,0 +1,182 @@
+/* Host benchmark for the job system, with pthreads standing in for the
+   RPi2's cores. For 1 to JOBS_MAX_WORKERS workers a flat batch of small
+   jobs is run from the main thread, then a binary tree of jobs that each
+   submit their two children, so most of the work is found by stealing.
+   Both are checked against the answer worked out without the job system
+   and the benchmark fails if either is wrong. Times are real time, so
+   they depend on how many CPUs the host has to give the threads */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "jobs.h"
+
+#define FLAT_JOBS       4096
+#define FLAT_WORK       2000
+#define TREE_DEPTH      12
+#define PASSES          20
+
+typedef struct
+{
+	int depth;
+	uint32_t seed;
+} TreeNode_t;
+
+static uint32_t flat_results[FLAT_JOBS];
+static JobCounter_t tree_counter;
+static volatile uint32_t tree_leaves;
+static volatile uint32_t tree_sum;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t work(uint32_t x)
+{
+	int i;
+
+	for (i = 0; i < FLAT_WORK; i++)
+		x = x * 1664525u + 1013904223u;
+
+	return x;
+}
+
+static void flat_job(void *args)
+{
+	uint32_t i = (uint32_t)(uintptr_t)args;
+
+	flat_results[i] = work(i);
+}
+
+// a node's children live in a pool indexed like a heap, so nothing is
+// allocated while the tree runs
+static TreeNode_t tree_nodes[2 << TREE_DEPTH];
+
+static void tree_job(void *args)
+{
+	TreeNode_t *node = (TreeNode_t *)args;
+	uint32_t index = (uint32_t)(node - tree_nodes);
+
+	if (node->depth == TREE_DEPTH)
+	{
+		__atomic_add_fetch(&tree_leaves, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&tree_sum, work(node->seed), __ATOMIC_RELAXED);
+		return;
+	}
+
+	tree_nodes[2 * index + 1].depth = node->depth + 1;
+	tree_nodes[2 * index + 1].seed = 2 * index + 1;
+	tree_nodes[2 * index + 2].depth = node->depth + 1;
+	tree_nodes[2 * index + 2].seed = 2 * index + 2;
+
+	JobsSubmit(&tree_counter, tree_job, &tree_nodes[2 * index + 1]);
+	JobsSubmit(&tree_counter, tree_job, &tree_nodes[2 * index + 2]);
+}
+
+static uint32_t tree_expected(void)
+{
+	uint32_t first = (1u << TREE_DEPTH) - 1;
+	uint32_t sum = 0;
+	uint32_t i;
+
+	for (i = first; i < 2 * first + 1; i++)
+		sum += work(i);
+
+	return sum;
+}
+
+static uint32_t stolen(void)
+{
+	uint32_t total = 0;
+	int i;
+
+	for (i = 0; i < JobsWorkerCount(); i++)
+		total += JobsStats(i)->stolen;
+
+	return total;
+}
+
+static int bench(int workers, uint32_t flat_sum, uint32_t tree_sum_expected)
+{
+	uint64_t flat_ns = 0, tree_ns = 0;
+	uint32_t flat_stolen, tree_stolen;
+	int failed = 0;
+	int pass, i;
+
+	workers = JobsInit(workers);
+
+	flat_stolen = stolen();
+
+	for (pass = 0; pass < PASSES; pass++)
+	{
+		JobCounter_t counter = { 0 };
+		uint32_t sum = 0;
+		uint64_t t = now_ns();
+
+		for (i = 0; i < FLAT_JOBS; i++)
+			JobsSubmit(&counter, flat_job, (void *)(uintptr_t)i);
+
+		JobsWait(&counter);
+		flat_ns += now_ns() - t;
+
+		for (i = 0; i < FLAT_JOBS; i++)
+			sum += flat_results[i];
+
+		failed |= sum != flat_sum;
+	}
+
+	flat_stolen = stolen() - flat_stolen;
+	tree_stolen = stolen();
+
+	for (pass = 0; pass < PASSES; pass++)
+	{
+		uint64_t t = now_ns();
+
+		tree_leaves = 0;
+		tree_sum = 0;
+		tree_nodes[0].depth = 0;
+		tree_nodes[0].seed = 0;
+
+		JobsSubmit(&tree_counter, tree_job, &tree_nodes[0]);
+		JobsWait(&tree_counter);
+		tree_ns += now_ns() - t;
+
+		failed |= tree_leaves != (1u << TREE_DEPTH) || tree_sum != tree_sum_expected;
+	}
+
+	tree_stolen = stolen() - tree_stolen;
+
+	printf("%d worker(s)  flat %8.1f ns/job  %6u stolen   tree %8.1f ns/job  %6u stolen  %s\n",
+		workers,
+		(double)flat_ns / (PASSES * FLAT_JOBS), flat_stolen / PASSES,
+		(double)tree_ns / (PASSES * ((2u << TREE_DEPTH) - 1)), tree_stolen / PASSES,
+		failed ? "WRONG" : "ok");
+
+	JobsShutdown();
+
+	return failed;
+}
+
+int main(void)
+{
+	uint32_t flat_sum = 0;
+	uint32_t tree_sum_expected = tree_expected();
+	int failed = 0;
+	int i;
+
+	for (i = 0; i < FLAT_JOBS; i++)
+		flat_sum += work(i);
+
+	printf("%d flat jobs, a tree of %u jobs, %d passes each\n",
+		FLAT_JOBS, (2u << TREE_DEPTH) - 1, PASSES);
+
+	for (i = 1; i <= JOBS_MAX_WORKERS; i++)
+		failed |= bench(i, flat_sum, tree_sum_expected);
+
+	return failed;
+}
@@ -0,0 +1,589 @@
+/* Host benchmark for the mailbox property interface, run against the
+   scripted fake VideoCore in rpi-mailbox-host.c. Time is the fake's
+   virtual microseconds: rendering a frame is a fixed amount of it and
+   every status read while waiting for an answer costs one.
+
+   A frame loop flips pages and asks for the temperature now and again,
+   once with the blocking calls and once with the non-blocking ones, with
+   the answers picked up by polling and then by the mailbox interrupt.
+   Then a burst of independent requests is sent one after the other and
+   all at once. Last, kernel_main's six tag board query is built with the
+   varargs call and with the builders, and its answer looked up through
+   the index and with the old scan and copy, timed in real time. Finally a
+   handful of modules ask for the same board facts over and over, straight
+   from the VideoCore and through the property cache, which has to see a
+   changed clock rate once told and a changed temperature every time. The
+   board query
+   is sent a tag at a time and all together with the fake's latency set
+   from its model instead of a script. Last of all the fake is given a
+   60Hz display and flipped twice inside one refresh, which mustn't hand
+   back the page the first flip took off screen before the vblank */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "rpi-framebuffer.h"
+#include "rpi-interrupts.h"
+#include "rpi-mailbox.h"
+#include "rpi-mailbox-interface.h"
+#include "rpi-property-cache.h"
+
+#define BENCH_FRAMES        1000
+#define RENDER_US           4000
+
+/* How often the frame loop asks for the temperature */
+#define TEMPERATURE_FRAMES  60
+
+/* One buffer stays with the last framebuffer flip */
+#define BURST_REQUESTS      ( RPI_PROPERTY_SLOTS - 1 )
+
+#define LOOKUP_PASSES       1000000
+
+/* Modules each asking for the board facts they need this many times */
+#define CACHE_MODULES       4
+#define CACHE_ROUNDS        25
+
+/* What the fake's model charges once the script is out of the way */
+#define MODEL_REQUEST_US    250
+#define MODEL_TAG_US        20
+
+/* A 60Hz display */
+#define REFRESH_US          16667
+
+static const rpi_mailbox_tag_t boot_tags[] =
+{
+	TAG_GET_BOARD_MODEL,
+	TAG_GET_BOARD_REVISION,
+	TAG_GET_FIRMWARE_VERSION,
+	TAG_GET_BOARD_MAC_ADDRESS,
+	TAG_GET_BOARD_SERIAL,
+	TAG_GET_MAX_CLOCK_RATE,
+};
+
+#define BOOT_TAGS           ( sizeof(boot_tags) / sizeof(boot_tags[0]) )
+
+static uint32_t latency[2 * BENCH_FRAMES + BURST_REQUESTS];
+
+static uint32_t completions;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void script(void)
+{
+	uint32_t i;
+
+	// 200 to 600us, the firmware's answer times vary a lot
+	for (i = 0; i < sizeof(latency) / sizeof(latency[0]); i++)
+		latency[i] = 200 + (i * 137) % 400;
+
+	RPI_MailboxHostScript(latency, sizeof(latency) / sizeof(latency[0]));
+}
+
+static void complete(rpi_property_transaction_t *t, void *args)
+{
+	completions++;
+}
+
+static uint32_t current_offset(void)
+{
+	const rpi_mailbox_property_t *mp;
+
+	RPI_PropertyAdd_GET_VIRTUAL_OFFSET(RPI_PropertyInit());
+	RPI_PropertyProcess();
+
+	mp = RPI_PropertyGet(TAG_GET_VIRTUAL_OFFSET);
+
+	return mp ? mp->data.buffer_32[1] : 0xffffffff;
+}
+
+static void report(const char *name, uint64_t elapsed, uint64_t blocked)
+{
+	rpi_framebuffer_t *fb = RPI_GetFramebuffer();
+	uint32_t expected = fb->front * fb->height;
+
+	printf("%-16s %8.1f fps  %6.1f us blocked/frame  polls %6u  offset %s\n",
+		name,
+		BENCH_FRAMES / (elapsed / 1e6),
+		(double)blocked / BENCH_FRAMES,
+		RPI_MailboxHostStats()->polls,
+		current_offset() == expected ? "ok" : "WRONG");
+}
+
+static void frames_blocking(void)
+{
+	rpi_framebuffer_t *fb = RPI_GetFramebuffer();
+	uint64_t start = RPI_MailboxHostTime();
+	uint64_t blocked = 0;
+	uint64_t t;
+	int frame;
+
+	script();
+	RPI_MailboxHostStats()->polls = 0;
+
+	for (frame = 0; frame < BENCH_FRAMES; frame++)
+	{
+		RPI_MailboxHostAdvance(RENDER_US);
+		t = RPI_MailboxHostTime();
+
+		// the flip the way it was done before, waiting for the answer
+		fb->front ^= 1;
+		RPI_PropertyAdd_SET_VIRTUAL_OFFSET(RPI_PropertyInit(), 0, fb->front * fb->height);
+		RPI_PropertyProcess();
+
+		if ((frame % TEMPERATURE_FRAMES) == 0)
+		{
+			RPI_PropertyAdd_GET_TEMPERATURE(RPI_PropertyInit(), 0);
+			RPI_PropertyProcess();
+		}
+
+		blocked += RPI_MailboxHostTime() - t;
+	}
+
+	report("blocking", RPI_MailboxHostTime() - start, blocked);
+}
+
+static void frames_async(const char *name)
+{
+	rpi_property_transaction_t *temperature = NULL;
+	uint64_t start = RPI_MailboxHostTime();
+	uint64_t blocked = 0;
+	uint64_t t;
+	int frame;
+
+	script();
+	RPI_MailboxHostStats()->polls = 0;
+
+	for (frame = 0; frame < BENCH_FRAMES; frame++)
+	{
+		RPI_MailboxHostAdvance(RENDER_US);
+		t = RPI_MailboxHostTime();
+
+		RPI_FramebufferFlip();
+
+		if (temperature && RPI_PropertyPoll(temperature))
+		{
+			RPI_PropertyRelease(temperature);
+			temperature = NULL;
+		}
+
+		if (temperature == NULL && (frame % TEMPERATURE_FRAMES) == 0)
+		{
+			temperature = RPI_PropertyBegin();
+			RPI_PropertyAdd_GET_TEMPERATURE(temperature, 0);
+			RPI_PropertySubmit(temperature, NULL, NULL);
+		}
+
+		blocked += RPI_MailboxHostTime() - t;
+	}
+
+	// let the last flip land before checking where the screen is
+	RPI_MailboxHostAdvance(1000);
+
+	if (temperature)
+	{
+		while (!RPI_PropertyPoll(temperature)) { }
+		RPI_PropertyRelease(temperature);
+	}
+
+	report(name, RPI_MailboxHostTime() - start, blocked);
+}
+
+static void burst(bool async)
+{
+	rpi_property_transaction_t *t[BURST_REQUESTS];
+	uint32_t answered = 0;
+	uint64_t start;
+	int i;
+
+	script();
+	completions = 0;
+	start = RPI_MailboxHostTime();
+
+	if (async)
+	{
+		for (i = 0; i < BURST_REQUESTS; i++)
+		{
+			t[i] = RPI_PropertyBegin();
+			RPI_PropertyAdd_GET_TEMPERATURE(t[i], 0);
+			RPI_PropertySubmit(t[i], complete, NULL);
+		}
+
+		for (i = 0; i < BURST_REQUESTS; i++)
+		{
+			while (!RPI_PropertyPoll(t[i])) { }
+
+			if (RPI_PropertyResult(t[i], TAG_GET_TEMPERATURE) != NULL)
+				answered++;
+
+			RPI_PropertyRelease(t[i]);
+		}
+	}
+	else
+	{
+		for (i = 0; i < BURST_REQUESTS; i++)
+		{
+			RPI_PropertyAdd_GET_TEMPERATURE(RPI_PropertyInit(), 0);
+			RPI_PropertyProcess();
+
+			if (RPI_PropertyGet(TAG_GET_TEMPERATURE) != NULL)
+				answered++;
+		}
+	}
+
+	printf("%-16s %6u us for %d requests, %u answered, %u callbacks\n",
+		async ? "all at once" : "one at a time",
+		(unsigned int)(RPI_MailboxHostTime() - start), BURST_REQUESTS,
+		answered, completions);
+}
+
+// RPI_PropertyGet as it used to be, a scan from the first tag and a copy
+// of the value into one static result
+static const rpi_mailbox_property_t *lookup_copy(const int *pt, rpi_mailbox_tag_t tag)
+{
+	static rpi_mailbox_property_t property;
+	int index = 2;
+
+	while (index < (pt[PT_OSIZE] >> 2))
+	{
+		if (pt[index] == tag)
+		{
+			property.tag = tag;
+			property.response = pt[index + T_ORESPONSE];
+			memcpy(property.data.buffer_8, &pt[index + T_OVALUE], property.response & 0xffff);
+			return &property;
+		}
+
+		index += (pt[index + 1] >> 2) + 3;
+	}
+
+	return NULL;
+}
+
+static void build_boot_query(rpi_property_transaction_t *t)
+{
+	RPI_PropertyAdd_GET_BOARD_MODEL(t);
+	RPI_PropertyAdd_GET_BOARD_REVISION(t);
+	RPI_PropertyAdd_GET_FIRMWARE_VERSION(t);
+	RPI_PropertyAdd_GET_BOARD_MAC_ADDRESS(t);
+	RPI_PropertyAdd_GET_BOARD_SERIAL(t);
+	RPI_PropertyAdd_GET_MAX_CLOCK_RATE(t, TAG_CLOCK_ARM);
+}
+
+// the query built through the varargs call and the descriptor table, then
+// through the builders, both have to come out the same as the one sent
+static void build(const rpi_property_transaction_t *sent)
+{
+	int varargs_pt[RPI_PROPERTY_BUFFER_WORDS];
+	rpi_property_transaction_t *t;
+	uint64_t varargs_ns, builder_ns;
+	int same = 1;
+	unsigned int i;
+	int pass;
+
+	varargs_ns = now_ns();
+
+	for (pass = 0; pass < LOOKUP_PASSES; pass++)
+	{
+		t = RPI_PropertyInit();
+
+		for (i = 0; i < BOOT_TAGS; i++)
+			RPI_PropertyAddTag(boot_tags[i], TAG_CLOCK_ARM);
+	}
+
+	varargs_ns = now_ns() - varargs_ns;
+	memcpy(varargs_pt, t->pt, sizeof(varargs_pt));
+
+	builder_ns = now_ns();
+
+	for (pass = 0; pass < LOOKUP_PASSES; pass++)
+	{
+		t = RPI_PropertyInit();
+		build_boot_query(t);
+	}
+
+	builder_ns = now_ns() - builder_ns;
+
+	// the value buffers aren't written on the way out, only compare headers
+	same = t->pt_index == sent->pt_index;
+
+	for (i = 2; same && i < (unsigned int)t->pt_index; i += 3 + (t->pt[i + T_OVALUE_SIZE] >> 2))
+	{
+		same = t->pt[i] == sent->pt[i] && varargs_pt[i] == t->pt[i] &&
+			t->pt[i + T_OVALUE_SIZE] == varargs_pt[i + T_OVALUE_SIZE];
+	}
+
+	printf("%-16s %6.1f ns per build\n", "varargs", (double)varargs_ns / LOOKUP_PASSES);
+	printf("%-16s %6.1f ns per build  %.2fx  %u words %s\n", "builders",
+		(double)builder_ns / LOOKUP_PASSES, (double)varargs_ns / builder_ns,
+		t->pt_index + 1, same ? "same list" : "DIFFERENT LIST");
+}
+
+static void lookup(void)
+{
+	rpi_property_transaction_t *t = RPI_PropertyBegin();
+	volatile uint32_t sink = 0;
+	uint64_t copy_ns, index_ns;
+	uint32_t copy_sum = 0, index_sum = 0;
+	unsigned int i;
+	int pass;
+
+	for (i = 0; i < BOOT_TAGS; i++)
+		RPI_PropertyAdd(t, boot_tags[i], TAG_CLOCK_ARM);
+
+	build(t);
+
+	RPI_PropertySubmit(t, NULL, NULL);
+
+	while (!RPI_PropertyPoll(t)) { }
+
+	copy_ns = now_ns();
+
+	for (pass = 0; pass < LOOKUP_PASSES; pass++)
+	{
+		for (i = 0; i < BOOT_TAGS; i++)
+			copy_sum += lookup_copy(t->pt, boot_tags[i])->data.buffer_32[0];
+
+		sink = copy_sum;
+	}
+
+	copy_ns = now_ns() - copy_ns;
+	index_ns = now_ns();
+
+	for (pass = 0; pass < LOOKUP_PASSES; pass++)
+	{
+		for (i = 0; i < BOOT_TAGS; i++)
+			index_sum += RPI_PropertyResult(t, boot_tags[i])->data.buffer_32[0];
+
+		sink = index_sum;
+	}
+
+	index_ns = now_ns() - index_ns;
+	(void)sink;
+
+	printf("%-16s %6.1f ns per query\n", "scan and copy", (double)copy_ns / LOOKUP_PASSES);
+	printf("%-16s %6.1f ns per query  %.2fx  %s\n", "index",
+		(double)index_ns / LOOKUP_PASSES, (double)copy_ns / index_ns,
+		copy_sum == index_sum ? "same values" : "DIFFERENT VALUES");
+
+	RPI_PropertyRelease(t);
+}
+
+static const rpi_mailbox_tag_t module_tags[] =
+{
+	TAG_GET_BOARD_MODEL,
+	TAG_GET_BOARD_REVISION,
+	TAG_GET_BOARD_SERIAL,
+	TAG_GET_MAX_CLOCK_RATE,
+};
+
+#define MODULE_TAGS         ( sizeof(module_tags) / sizeof(module_tags[0]) )
+
+static void cache(void)
+{
+	rpi_property_cache_stats_t *stats = RPI_PropertyCacheStats();
+	const rpi_mailbox_property_t *mp;
+	uint32_t blocking_sum = 0, cached_sum = 0;
+	uint32_t blocking_trips = 0;
+	uint64_t blocking_us, cached_us;
+	unsigned int i;
+	int round, module;
+
+	script();
+	blocking_us = RPI_MailboxHostTime();
+
+	for (round = 0; round < CACHE_ROUNDS; round++)
+	{
+		for (module = 0; module < CACHE_MODULES; module++)
+		{
+			for (i = 0; i < MODULE_TAGS; i++)
+			{
+				RPI_PropertyInit();
+				RPI_PropertyAddTag(module_tags[i], TAG_CLOCK_ARM);
+				RPI_PropertyProcess();
+				blocking_trips++;
+
+				mp = RPI_PropertyGet(module_tags[i]);
+				blocking_sum += mp ? mp->data.buffer_32[0] : 0;
+			}
+		}
+	}
+
+	blocking_us = RPI_MailboxHostTime() - blocking_us;
+
+	script();
+	cached_us = RPI_MailboxHostTime();
+
+	RPI_PropertyCacheInit();
+
+	for (round = 0; round < CACHE_ROUNDS; round++)
+	{
+		for (module = 0; module < CACHE_MODULES; module++)
+		{
+			for (i = 0; i < MODULE_TAGS; i++)
+			{
+				mp = RPI_PropertyCacheGet(module_tags[i],
+					module_tags[i] == TAG_GET_MAX_CLOCK_RATE ? TAG_CLOCK_ARM : 0);
+				cached_sum += mp ? mp->data.buffer_32[0] : 0;
+			}
+		}
+	}
+
+	cached_us = RPI_MailboxHostTime() - cached_us;
+
+	printf("%-16s %6u round trips %8u us\n", "blocking",
+		blocking_trips, (unsigned int)blocking_us);
+	printf("%-16s %6u round trips %8u us  %u us saved  %u hits %u misses  %s\n", "cached",
+		stats->round_trips, (unsigned int)cached_us,
+		(unsigned int)(blocking_us - cached_us), stats->hits, stats->misses,
+		blocking_sum == cached_sum ? "same values" : "DIFFERENT VALUES");
+
+	// the clock is changed, the next read of its rate has to go back to
+	// the VideoCore and see the new one
+	mp = RPI_PropertyCacheGet(TAG_GET_CLOCK_RATE, TAG_CLOCK_ARM);
+	printf("%-16s %6u MHz", "arm clock", mp ? mp->data.buffer_32[1] / 1000000 : 0);
+
+	RPI_PropertyAdd_SET_CLOCK_RATE(RPI_PropertyInit(), TAG_CLOCK_ARM, 700000000, 0);
+	RPI_PropertyProcess();
+
+	mp = RPI_PropertyCacheGet(TAG_GET_CLOCK_RATE, TAG_CLOCK_ARM);
+	printf(", set to 700 MHz, still %u MHz from the cache", mp ? mp->data.buffer_32[1] / 1000000 : 0);
+
+	RPI_PropertyCacheInvalidate(TAG_GET_CLOCK_RATE);
+
+	mp = RPI_PropertyCacheGet(TAG_GET_CLOCK_RATE, TAG_CLOCK_ARM);
+	printf(", %u MHz once invalidated\n", mp ? mp->data.buffer_32[1] / 1000000 : 0);
+
+	// nothing tells the cache when the temperature changes, so every read
+	// has to go to the VideoCore
+	mp = RPI_PropertyCacheGet(TAG_GET_TEMPERATURE, 0);
+	printf("%-16s %6u C", "temperature", mp ? mp->data.buffer_32[1] / 1000 : 0);
+
+	RPI_MailboxHostModel()->temperature += 10000;
+
+	mp = RPI_PropertyCacheGet(TAG_GET_TEMPERATURE, 0);
+	printf(", warmed by 10 C, %u C read back  %u uncached\n",
+		mp ? mp->data.buffer_32[1] / 1000 : 0, stats->uncached);
+
+	RPI_MailboxHostModel()->temperature -= 10000;
+}
+
+// with a fixed cost per request the batch wins even though the firmware
+// has the same tags to answer
+static void model_latency(void)
+{
+	rpi_mailbox_host_model_t *model = RPI_MailboxHostModel();
+	rpi_property_transaction_t *t;
+	uint64_t single_us, batched_us;
+	unsigned int i;
+
+	RPI_MailboxHostScript(NULL, 0);
+	model->request_us = MODEL_REQUEST_US;
+	model->tag_us = MODEL_TAG_US;
+
+	single_us = RPI_MailboxHostTime();
+
+	for (i = 0; i < BOOT_TAGS; i++)
+	{
+		RPI_PropertyInit();
+		RPI_PropertyAddTag(boot_tags[i], TAG_CLOCK_ARM);
+		RPI_PropertyProcess();
+	}
+
+	single_us = RPI_MailboxHostTime() - single_us;
+	batched_us = RPI_MailboxHostTime();
+
+	t = RPI_PropertyInit();
+	build_boot_query(t);
+	RPI_PropertyProcess();
+
+	batched_us = RPI_MailboxHostTime() - batched_us;
+
+	printf("%-16s %6u us\n", "a tag at a time", (unsigned int)single_us);
+	printf("%-16s %6u us  %.2fx\n", "batched", (unsigned int)batched_us,
+		(double)single_us / batched_us);
+
+	model->request_us = 0;
+	model->tag_us = 0;
+}
+
+// the page the first flip took off screen is still being scanned out
+// until the vblank, so it can't be drawn into again before then
+static int vsync(void)
+{
+	rpi_mailbox_host_model_t *model = RPI_MailboxHostModel();
+	uint64_t start, vblank, elapsed;
+
+	RPI_MailboxHostScript(NULL, 0);
+	model->refresh_us = REFRESH_US;
+
+	// the flip left from the frame loops, then start just past a vblank
+	RPI_FramebufferFlip();
+	RPI_MailboxHostAdvance(REFRESH_US - RPI_MailboxHostTime() % REFRESH_US + 1);
+
+	start = RPI_MailboxHostTime();
+	vblank = (start / REFRESH_US + 1) * REFRESH_US;
+
+	RPI_FramebufferFlip();
+	RPI_FramebufferFlip();
+	RPI_FramebufferGetBackBuffer();
+
+	elapsed = RPI_MailboxHostTime() - start;
+
+	model->refresh_us = 0;
+
+	printf("%-16s %6u us  %s\n", "two flips", (unsigned int)elapsed,
+		start + elapsed >= vblank ? "ok" : "DRAWN ON SCREEN");
+
+	return start + elapsed >= vblank ? 0 : 1;
+}
+
+int main(void)
+{
+	if (RPI_FramebufferInit(640, 480, 32) != 0)
+	{
+		printf("no framebuffer\n");
+		return 1;
+	}
+
+	printf("%d frames of %d us, flip every frame, temperature every %d\n",
+		BENCH_FRAMES, RENDER_US, TEMPERATURE_FRAMES);
+
+	frames_blocking();
+	frames_async("polled");
+
+	IRQRegister(RPI_IRQ_ARM_MAILBOX, RPI_PropertyIRQHandler, NULL);
+	RPI_PropertyEnableIrq();
+
+	frames_async("interrupt");
+
+	printf("burst of %d temperature requests\n", BURST_REQUESTS);
+
+	burst(false);
+	burst(true);
+
+	printf("the %u tag board query, %d passes\n", (unsigned int)BOOT_TAGS, LOOKUP_PASSES);
+
+	lookup();
+
+	printf("%d modules asking for %u board facts %d times each\n",
+		CACHE_MODULES, (unsigned int)MODULE_TAGS, CACHE_ROUNDS);
+
+	cache();
+
+	printf("the board query at %d us a request and %d us a tag\n",
+		MODEL_REQUEST_US, MODEL_TAG_US);
+
+	model_latency();
+
+	printf("flipping on a %d us refresh\n", REFRESH_US);
+
+	return vsync();
+}
@@ -0,0 +1,206 @@
+/* Host benchmark for the translation table rpi-mmu.c builds. The table is
+   made from the fake VideoCore's idea of where the ARM's RAM is, exactly
+   as RPI_MmuInit does on the Pi, with the framebuffer then remapped the way
+   kernel_main does where the firmware would put it: at the top of the
+   VideoCore's RAM.
+
+   The fake's board is fitted to the peripheral base being built for first.
+   The map is printed as runs of sections and checked at the edges of
+   every region; any address that comes out mapped as something else
+   makes the benchmark fail. A board claiming RAM over the peripherals is
+   checked the same way. Last, building a whole table and looking
+   addresses up in it are timed in real time */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "rpi-base.h"
+#include "rpi-mailbox.h"
+#include "rpi-mmu.h"
+
+#define FB_BYTES            ( 640 * 480 * 4 * 2 )
+
+#define BUILD_PASSES        10000
+#define LOOKUP_PASSES       10000000
+
+typedef struct
+{
+	uint32_t address;
+	rpi_mmu_memory_t expected;
+} Probe_t;
+
+static const char *names[] =
+{
+	"fault",
+	"write-back",
+	"write-combine",
+	"device",
+	"strongly ordered",
+};
+
+static uint32_t table[RPI_MMU_TABLE_ENTRIES] __attribute__((aligned(RPI_MMU_TABLE_ALIGN)));
+static volatile uint32_t sink;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void print_map(const uint32_t *t)
+{
+	uint32_t start = 0;
+	uint32_t i;
+
+	for (i = 1; i <= RPI_MMU_TABLE_ENTRIES; i++)
+	{
+		rpi_mmu_memory_t type = RPI_MmuLookup(t, start << RPI_MMU_SECTION_SHIFT);
+
+		if (i < RPI_MMU_TABLE_ENTRIES &&
+			RPI_MmuLookup(t, i << RPI_MMU_SECTION_SHIFT) == type)
+			continue;
+
+		printf("  %08x-%08x %5u MB %s\n", start << RPI_MMU_SECTION_SHIFT,
+			(i << RPI_MMU_SECTION_SHIFT) - 1, i - start, names[type]);
+		start = i;
+	}
+}
+
+static int check(const uint32_t *t, const Probe_t *probes, int count)
+{
+	int failed = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		rpi_mmu_memory_t got = RPI_MmuLookup(t, probes[i].address);
+
+		if (got != probes[i].expected)
+		{
+			printf("  FAIL %08x is %s, wanted %s\n", probes[i].address,
+				names[got], names[probes[i].expected]);
+			failed++;
+		}
+	}
+
+	printf("  %d/%d probes as expected\n", count - failed, count);
+
+	return failed;
+}
+
+// the VideoCore's RAM ends where the peripherals start on the board
+// being built for, and the ARM has everything below it
+static rpi_mailbox_host_model_t *fit_board(void)
+{
+	rpi_mailbox_host_model_t *model = RPI_MailboxHostModel();
+
+	model->vc_memory[0] = PERIPHERAL_BASE - model->vc_memory[1];
+	model->arm_memory[0] = 0;
+	model->arm_memory[1] = model->vc_memory[0];
+
+	return model;
+}
+
+static int check_live(void)
+{
+	rpi_mailbox_host_model_t *model = fit_board();
+	uint32_t ram_end = model->arm_memory[0] + model->arm_memory[1];
+	uint32_t vc_end = model->vc_memory[0] + model->vc_memory[1];
+	uint32_t fb = (vc_end - FB_BYTES) & ~(RPI_MMU_SECTION_SIZE - 1);
+
+	const Probe_t probes[] =
+	{
+		{ 0x00000000,                               RPI_MMU_WRITE_BACK },
+		{ 0x00008000,                               RPI_MMU_WRITE_BACK },
+		{ ram_end - 1,                              RPI_MMU_WRITE_BACK },
+		{ ram_end,                                  RPI_MMU_FAULT },
+		{ fb - 1,                                   RPI_MMU_FAULT },
+		{ fb,                                       RPI_MMU_WRITE_BACK },
+		{ vc_end - 1,                               RPI_MMU_WRITE_BACK },
+		{ PERIPHERAL_BASE - 1,                      RPI_MMU_WRITE_BACK },
+		{ PERIPHERAL_BASE,                          RPI_MMU_DEVICE },
+		{ PERIPHERAL_BASE + 0x00215000,             RPI_MMU_DEVICE },
+		{ PERIPHERAL_BASE + 0x00FFFFFF,             RPI_MMU_DEVICE },
+		{ PERIPHERAL_BASE + 0x01000000,             RPI_MMU_FAULT },
+		{ 0xFFFFFFFF,                               RPI_MMU_FAULT },
+	};
+
+	if (RPI_MmuInit() != 0)
+	{
+		printf("  FAIL no ARM memory from the fake\n");
+		return 1;
+	}
+
+	RPI_MmuRemap(fb, FB_BYTES, RPI_MMU_WRITE_BACK);
+
+	printf("kernel layout, %u MB of ARM RAM, framebuffer at %08x\n",
+		(unsigned int)(model->arm_memory[1] >> 20), fb);
+	print_map(RPI_MmuGetTable());
+
+	return check(RPI_MmuGetTable(), probes, sizeof(probes) / sizeof(probes[0]));
+}
+
+// the peripherals stay device memory whatever the firmware says
+static int check_overlap(void)
+{
+	const rpi_mmu_layout_t layout = { 0, PERIPHERAL_BASE + 0x02000000 };
+
+	const Probe_t probes[] =
+	{
+		{ PERIPHERAL_BASE - 1,                      RPI_MMU_WRITE_BACK },
+		{ PERIPHERAL_BASE,                          RPI_MMU_DEVICE },
+		{ PERIPHERAL_BASE + 0x00FFFFFF,             RPI_MMU_DEVICE },
+		{ PERIPHERAL_BASE + 0x01000000,             RPI_MMU_WRITE_BACK },
+		{ PERIPHERAL_BASE + 0x02000000,             RPI_MMU_FAULT },
+	};
+
+	RPI_MmuBuildTable(table, &layout);
+
+	printf("RAM reported over the peripherals\n");
+	print_map(table);
+
+	return check(table, probes, sizeof(probes) / sizeof(probes[0]));
+}
+
+static void bench_build(void)
+{
+	const rpi_mmu_layout_t layout = { 0, 0x1C000000 };
+	uint64_t ns;
+	int i;
+
+	ns = now_ns();
+
+	for (i = 0; i < BUILD_PASSES; i++)
+	{
+		RPI_MmuBuildTable(table, &layout);
+		sink = table[i & (RPI_MMU_TABLE_ENTRIES - 1)];
+	}
+
+	ns = now_ns() - ns;
+
+	printf("build table       %8.1f ns\n", (double)ns / BUILD_PASSES);
+
+	ns = now_ns();
+
+	for (i = 0; i < LOOKUP_PASSES; i++)
+		sink += RPI_MmuLookup(table, (uint32_t)i * 0x9E3779B1u);
+
+	ns = now_ns() - ns;
+
+	printf("lookup            %8.1f ns\n", (double)ns / LOOKUP_PASSES);
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	failed += check_live();
+	failed += check_overlap();
+
+	bench_build();
+
+	return failed ? 1 : 0;
+}
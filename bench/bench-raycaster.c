@@ -0,0 +1,412 @@
+/* Host benchmark for the ray caster. Renders a fixed camera path into a
+   memory surface and reports frames/sec plus a checksum of the last frame so
+   a change in the rendered output shows up as well as a change in speed.
+   With the default screen the flat and textured frames have to match the
+   checksums pinned below. The column split renderer is then run with 1 to
+   JOBS_MAX_WORKERS threads standing in for the RPi2's cores, and the
+   cast/draw pipeline with and without a second worker for its cast stage.
+   Both checksums have to match the serial one. Last the walls are textured,
+   timed per column, then drawn into a column major surface and transposed,
+   which has to give the same frame as drawing the rows directly */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "jobs.h"
+#include "raycaster.h"
+#include "raycaster-parallel.h"
+#include "raycaster-pipeline.h"
+#include "raycaster-texture.h"
+#include "raycaster-blit.h"
+#include "rpi-framebuffer.h"
+
+// generated at build time, for the screen and field of view in use
+#include "raycaster-lut.h"
+
+#define BENCH_FRAMES 500
+#define PARALLEL_WIDTH 640
+#define PARALLEL_HEIGHT 480
+
+static const uint32_t resolutions[][2] =
+{
+	{ 320, 240 },
+	{ 640, 480 },
+	{ 1280, 720 },
+};
+
+/* The last frame at each resolution, flat and textured, with the lookup
+   tables built for the default 640 wide screen. Tables for another width
+   draw other frames, they're only checked against each other then. A
+   field of view other than the default's 43254 long camera plane fails */
+#define PINNED_PLANE 43254
+
+#if RAYCASTER_LUT_WIDTH == 640
+	#define BENCH_PINNED 1
+#endif
+
+static const uint32_t pinned[][2] =
+{
+	{ 0x50bb4415, 0x92bfbc87 },
+	{ 0x16bee90d, 0x99548ca6 },
+	{ 0xe043729d, 0x909bf74b },
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t clock_us(void)
+{
+	return (uint32_t)(now_ns() / 1000);
+}
+
+static uint32_t checksum(const RayCasterSurface_t *s)
+{
+	// FNV-1a over the visible pixels
+	uint32_t hash = 2166136261u;
+	uint32_t x, y;
+
+	for (y = 0; y < s->height; y++)
+	{
+		const uint32_t *row = s->pixels + y * (s->pitch >> 2);
+
+		for (x = 0; x < s->width; x++)
+		{
+			hash ^= row[x];
+			hash *= 16777619u;
+		}
+	}
+
+	return hash;
+}
+
+// "ok" or "WRONG" against the pinned checksum, counting a mismatch
+static const char *check_pinned(uint32_t sum, uint32_t expected, int *failed)
+{
+#if defined(BENCH_PINNED)
+	*failed |= sum != expected;
+
+	return sum == expected ? "ok" : "WRONG";
+#else
+	return "unpinned";
+#endif
+}
+
+// the same path as the serial pass, split between workers
+static int bench_parallel(int workers, RayCasterSplit_t split, uint32_t expected)
+{
+	static const char *names[] = { "interleaved", "adaptive" };
+	RayCaster_t rc;
+	RayCasterSurface_t surface;
+	RayCasterParallel_t *rp = malloc(sizeof(*rp));
+	uint64_t start, elapsed;
+	uint64_t imbalance = 0;
+	uint32_t sum;
+	int frame;
+
+	surface.width = PARALLEL_WIDTH;
+	surface.height = PARALLEL_HEIGHT;
+	surface.pitch = surface.width * 4;
+	surface.layout = RAYCASTER_ROW_MAJOR;
+	surface.pixels = malloc(surface.pitch * surface.height);
+
+	workers = JobsInit(workers);
+	RayCasterInit(&rc, &RayCasterDemoMap);
+	RayCasterParallelInit(rp, split, clock_us);
+
+	start = now_ns();
+
+	for (frame = 0; frame < BENCH_FRAMES; frame++)
+	{
+		RayCasterParallelRender(rp, &rc, &surface);
+		RayCasterRotate(&rc, RAYCASTER_TURN_COS, RAYCASTER_TURN_SIN);
+		imbalance += RayCasterParallelImbalance(rp);
+	}
+
+	elapsed = now_ns() - start;
+	JobsShutdown();
+
+	sum = checksum(&surface);
+
+	printf("%-11s %d worker(s) %8.1f frames/sec  imbalance %3u%%  checksum 0x%08x  %s\n",
+		names[split], workers,
+		BENCH_FRAMES * 1e9 / (double)elapsed,
+		(uint32_t)(imbalance / BENCH_FRAMES), sum,
+		sum == expected ? "ok" : "WRONG");
+
+	free(surface.pixels);
+	free(rp);
+
+	return sum != expected;
+}
+
+// the same path again, each frame cast a frame ahead of being drawn
+static int bench_pipeline(int workers, uint32_t expected)
+{
+	RayCaster_t rc;
+	RayCasterSurface_t surface;
+	RayCasterPipeline_t *pl = malloc(sizeof(*pl));
+	uint64_t start, elapsed;
+	uint64_t cast = 0, draw = 0, stall = 0;
+	uint64_t imbalance = 0;
+	uint32_t sum;
+	bool overlapped;
+	int frame;
+
+	surface.width = PARALLEL_WIDTH;
+	surface.height = PARALLEL_HEIGHT;
+	surface.pitch = surface.width * 4;
+	surface.layout = RAYCASTER_ROW_MAJOR;
+	surface.pixels = malloc(surface.pitch * surface.height);
+
+	workers = JobsInit(workers);
+	RayCasterInit(&rc, &RayCasterDemoMap);
+	RayCasterPipelineInit(pl, surface.width, RAYCASTER_SPLIT_ADAPTIVE, clock_us);
+	overlapped = RayCasterPipelineStart(pl);
+
+	start = now_ns();
+
+	RayCasterPipelineSubmit(pl, &rc);
+	RayCasterRotate(&rc, RAYCASTER_TURN_COS, RAYCASTER_TURN_SIN);
+
+	for (frame = 0; frame < BENCH_FRAMES; frame++)
+	{
+		if (frame + 1 < BENCH_FRAMES)
+		{
+			RayCasterPipelineSubmit(pl, &rc);
+			RayCasterRotate(&rc, RAYCASTER_TURN_COS, RAYCASTER_TURN_SIN);
+		}
+
+		RayCasterPipelineDraw(pl, &surface);
+		cast += pl->times.cast;
+		draw += pl->times.draw;
+		stall += pl->times.stall;
+		imbalance += RayCasterParallelImbalance(&pl->draw);
+	}
+
+	elapsed = now_ns() - start;
+	RayCasterPipelineStop(pl);
+	JobsShutdown();
+
+	sum = checksum(&surface);
+
+	printf("pipeline    %d worker(s) %8.1f frames/sec  imbalance %3u%%  cast %4uus draw %4uus stall %4uus%s  checksum 0x%08x  %s\n",
+		workers,
+		BENCH_FRAMES * 1e9 / (double)elapsed,
+		(uint32_t)(imbalance / BENCH_FRAMES),
+		(uint32_t)(cast / BENCH_FRAMES), (uint32_t)(draw / BENCH_FRAMES),
+		(uint32_t)(stall / BENCH_FRAMES), overlapped ? "" : " (inline)",
+		sum, sum == expected ? "ok" : "WRONG");
+
+	free(surface.pixels);
+	free(pl);
+
+	return sum != expected;
+}
+
+int main(void)
+{
+	uint32_t expected = 0;
+	unsigned int i;
+	int failed = 0;
+	int workers;
+
+	for (i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++)
+	{
+		RayCaster_t rc;
+		RayCasterSurface_t surface;
+		uint64_t start, elapsed;
+		int frame;
+
+		surface.width = resolutions[i][0];
+		surface.height = resolutions[i][1];
+		surface.pitch = surface.width * 4;
+		surface.layout = RAYCASTER_ROW_MAJOR;
+		surface.pixels = malloc(surface.pitch * surface.height);
+
+		RayCasterInit(&rc, &RayCasterDemoMap);
+
+		start = now_ns();
+
+		for (frame = 0; frame < BENCH_FRAMES; frame++)
+		{
+			RayCasterRenderFrame(&rc, &surface);
+			RayCasterRotate(&rc, RAYCASTER_TURN_COS, RAYCASTER_TURN_SIN);
+		}
+
+		elapsed = now_ns() - start;
+
+		printf("raycaster %4ux%-4u %8.1f frames/sec  checksum 0x%08x  %s\n",
+			surface.width, surface.height,
+			BENCH_FRAMES * 1e9 / (double)elapsed,
+			checksum(&surface), check_pinned(checksum(&surface), pinned[i][0], &failed));
+
+		if (surface.width == PARALLEL_WIDTH && surface.height == PARALLEL_HEIGHT)
+			expected = checksum(&surface);
+
+		free(surface.pixels);
+	}
+
+	/* The same again, but drawn into the page flipped framebuffer that the
+	   fake VideoCore hands out */
+	for (i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++)
+	{
+		RayCaster_t rc;
+		RayCasterSurface_t surface;
+		rpi_framebuffer_t *fb = RPI_GetFramebuffer();
+		uint64_t start, elapsed;
+		int frame;
+
+		if (RPI_FramebufferInit(resolutions[i][0], resolutions[i][1], 32) != 0)
+		{
+			printf("framebuffer %ux%u: allocation failed\n",
+				resolutions[i][0], resolutions[i][1]);
+			continue;
+		}
+
+		surface.width = fb->width;
+		surface.height = fb->height;
+		surface.pitch = fb->pitch;
+		surface.layout = RAYCASTER_ROW_MAJOR;
+
+		RayCasterInit(&rc, &RayCasterDemoMap);
+
+		start = now_ns();
+
+		for (frame = 0; frame < BENCH_FRAMES; frame++)
+		{
+			surface.pixels = RPI_FramebufferGetBackBuffer();
+			RayCasterRenderFrame(&rc, &surface);
+			RPI_FramebufferFlip();
+			RayCasterRotate(&rc, RAYCASTER_TURN_COS, RAYCASTER_TURN_SIN);
+		}
+
+		elapsed = now_ns() - start;
+
+		printf("flipped   %4ux%-4u %8.1f frames/sec  checksum 0x%08x  pages %u  %s\n",
+			surface.width, surface.height,
+			BENCH_FRAMES * 1e9 / (double)elapsed,
+			checksum(&surface), fb->pages,
+			check_pinned(checksum(&surface), pinned[i][0], &failed));
+	}
+
+	for (i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++)
+	{
+		RayCaster_t rc;
+		RayCasterSurface_t surface;
+		uint64_t start, elapsed;
+		int frame;
+
+		surface.width = resolutions[i][0];
+		surface.height = resolutions[i][1];
+		surface.pitch = surface.width * 4;
+		surface.layout = RAYCASTER_ROW_MAJOR;
+		surface.pixels = malloc(surface.pitch * surface.height);
+
+		RayCasterInit(&rc, &RayCasterDemoMap);
+		rc.textures = RayCasterDemoTextures();
+
+		start = now_ns();
+
+		for (frame = 0; frame < BENCH_FRAMES; frame++)
+		{
+			RayCasterRenderFrame(&rc, &surface);
+			RayCasterRotate(&rc, RAYCASTER_TURN_COS, RAYCASTER_TURN_SIN);
+		}
+
+		elapsed = now_ns() - start;
+
+		printf("textured  %4ux%-4u %8.1f frames/sec  %6.1f ns/column (%s)  checksum 0x%08x  %s\n",
+			surface.width, surface.height,
+			BENCH_FRAMES * 1e9 / (double)elapsed,
+			(double)elapsed / ((uint64_t)BENCH_FRAMES * surface.width),
+#if defined(RAYCASTER_NEON)
+			"neon",
+#else
+			"scalar",
+#endif
+			checksum(&surface), check_pinned(checksum(&surface), pinned[i][1], &failed));
+
+		free(surface.pixels);
+	}
+
+	for (i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++)
+	{
+		RayCaster_t rc;
+		RayCasterSurface_t columns, rows;
+		uint64_t start, elapsed, blit = 0;
+		uint32_t sum, direct;
+		int frame;
+
+		rows.width = columns.width = resolutions[i][0];
+		rows.height = columns.height = resolutions[i][1];
+		rows.pitch = rows.width * 4;
+		rows.layout = RAYCASTER_ROW_MAJOR;
+		rows.pixels = malloc(rows.pitch * rows.height);
+		columns.pitch = RAYCASTER_COLUMN_PITCH(columns.height);
+		columns.layout = RAYCASTER_COLUMN_MAJOR;
+		columns.pixels = malloc(columns.pitch * columns.width);
+
+		RayCasterInit(&rc, &RayCasterDemoMap);
+		rc.textures = RayCasterDemoTextures();
+
+		start = now_ns();
+
+		for (frame = 0; frame < BENCH_FRAMES; frame++)
+		{
+			uint64_t t;
+
+			RayCasterRenderFrame(&rc, &columns);
+
+			t = now_ns();
+			RayCasterTranspose(&columns, &rows);
+			blit += now_ns() - t;
+
+			if (frame + 1 < BENCH_FRAMES)
+				RayCasterRotate(&rc, RAYCASTER_TURN_COS, RAYCASTER_TURN_SIN);
+		}
+
+		elapsed = now_ns() - start;
+		sum = checksum(&rows);
+
+		// the last frame again, drawn straight into the rows
+		RayCasterRenderFrame(&rc, &rows);
+		direct = checksum(&rows);
+
+		printf("columns   %4ux%-4u %8.1f frames/sec  transpose %6.1f us  checksum 0x%08x  %s\n",
+			rows.width, rows.height,
+			BENCH_FRAMES * 1e9 / (double)elapsed,
+			(double)blit / (BENCH_FRAMES * 1000.0),
+			sum, sum == direct ? "ok" : "WRONG");
+
+		failed |= sum != direct;
+
+		free(rows.pixels);
+		free(columns.pixels);
+	}
+
+#if defined(BENCH_PINNED)
+	if (RAYCASTER_LUT_PLANE != PINNED_PLANE)
+		printf("checksums pinned for a camera plane of %d, this build's is %d\n",
+			PINNED_PLANE, RAYCASTER_LUT_PLANE);
+#endif
+
+	printf("parallel %ux%u\n", PARALLEL_WIDTH, PARALLEL_HEIGHT);
+
+	for (workers = 1; workers <= JOBS_MAX_WORKERS; workers++)
+	{
+		failed |= bench_parallel(workers, RAYCASTER_SPLIT_INTERLEAVED, expected);
+		failed |= bench_parallel(workers, RAYCASTER_SPLIT_ADAPTIVE, expected);
+	}
+
+	for (workers = 1; workers <= JOBS_MAX_WORKERS; workers++)
+		failed |= bench_pipeline(workers, expected);
+
+	return failed;
+}
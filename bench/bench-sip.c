@@ -0,0 +1,807 @@
+/* Host benchmark for the SIP parser. Builds a stream of frames with random
+   payload lengths, the odd bit of line noise, some truncated frames and some
+   with a corrupted payload, then
+   parses it one char at a time with SIPFeedInput and in chunks with
+   SIPFeedBuffer, in text and in binary mode. Every run has to dispatch
+   exactly the same frames and count the same errors. The CRC test compares
+   the byte at a time CRC-16 with the slice-by-4 one.
+
+   The upload test then sends a map sized block of data over the simulated
+   mini UART in each mode and measures how long it takes to arrive. The echo
+   test measures request/response round trips, one at a time and with
+   several requests in flight. The bulk test streams the same amount of data
+   into a bulk target with a window of chunks in flight, including a run
+   where a chunk is lost on the way.
+
+   Before any of that, frames declaring more payload than
+   SIP_MAX_PAYLOAD_LEN are checked to be dropped. sip_bench_short is the
+   same program built with a SIP_MAX_PAYLOAD_LEN below what a short length
+   can hold, and runs only that check */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "sip.h"
+#include "sip-crc.h"
+#include "rpi-aux.h"
+#include "rpi-aux-sim.h"
+#include "rpi-interrupts.h"
+
+#define BENCH_FRAMES    20000
+#define BENCH_PASSES    10
+
+#define BAUD            115200
+#define UPLOAD_BYTES    16384
+#define UPLOAD_COMMAND  0x10
+#define ECHO_COMMAND    0x11
+#define ECHO_REQUESTS   500
+#define ECHO_LENGTH     16
+
+/* Frames in the parse test carry up to this much, so about half of them
+   need an extended length */
+#define PARSE_MAX_LEN   511
+
+#define CRC_BYTES       65536
+#define CRC_PASSES      200
+
+/* The host gives up waiting for a bulk reply after this long */
+#define BULK_TIMEOUT_NS 500000000ULL
+
+/* How often the main loop picks up received data */
+#define POLL_NS         1000000ULL
+
+static const size_t chunk_sizes[] = { 1, 8, 64, 4096 };
+
+static uint32_t frames_seen;
+static uint32_t frames_hash;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int count_frame(uint8_t *payload, uint16_t payload_length,
+					   SIPResponse_t *response)
+{
+	// FNV-1a over the length and payload of every dispatched frame
+	uint32_t hash = frames_hash;
+	int i;
+
+	hash = (hash ^ (payload_length & 0xff)) * 16777619u;
+	hash = (hash ^ (payload_length >> 8)) * 16777619u;
+
+	for (i = 0; i < payload_length; i++)
+		hash = (hash ^ payload[i]) * 16777619u;
+
+	frames_hash = hash;
+	frames_seen++;
+
+	return 0;
+}
+
+static size_t build_stream(uint8_t *p, SIPMode_t mode)
+{
+	uint8_t *start = p;
+	uint8_t payload[PARSE_MAX_LEN];
+	int i, j;
+
+	srand(1);
+
+	for (i = 0; i < BENCH_FRAMES; i++)
+	{
+		uint16_t length = rand() % (PARSE_MAX_LEN + 1);
+		size_t n;
+
+		for (j = 0; j < length; j++)
+			payload[j] = rand() & 0xff;
+
+		// noise between frames, binary mode sees it as one bad frame
+		if ((i & 31) == 0)
+		{
+			memcpy(p, "\r\nnoise", 7);
+			p += 7;
+
+			if (mode == SIP_MODE_BINARY)
+				*p++ = 0;
+		}
+
+		if (mode == SIP_MODE_BINARY)
+			n = SIPEncodeBinary(p, i & 0x3, i, payload, length);
+		else
+			n = SIPEncodeText((char *)p, i & 0x3, i, payload, length);
+
+		// every so often cut a frame short, it must not be dispatched
+		if ((i % 97) == 0 && length > 4)
+		{
+			memmove(p + n / 2 - 4, p + n - 4, 4);
+			n = n / 2;
+		}
+		// and flip a payload bit in some others, the CRC has to catch it
+		else if ((i % 61) == 0 && length > 8)
+		{
+			if (mode == SIP_MODE_BINARY)
+				p[n / 2] = p[n / 2] == 0x55 ? 0xaa : 0x55;
+			else
+				p[n / 2] = p[n / 2] == '5' ? '6' : '5';
+		}
+
+		p += n;
+	}
+
+	return p - start;
+}
+
+static void report(const char *name, uint64_t elapsed, size_t bytes)
+{
+	double seconds = (double)elapsed / 1e9;
+
+	printf("%-16s %10.0f frames/sec %8.2f MB/s  frames %u  hash 0x%08x\n",
+		name,
+		(double)frames_seen / seconds,
+		(double)bytes * BENCH_PASSES / seconds / 1e6,
+		frames_seen / BENCH_PASSES, frames_hash);
+}
+
+static void report_errors(const SIP_t *sip)
+{
+	printf("%-16s good %u sflag %u eflag %u cmd %u checksum %u length %u\n", "errors",
+		sip->ErrorCount[NO_ERROR] / BENCH_PASSES,
+		sip->ErrorCount[INVALID_SFLAG_ERROR] / BENCH_PASSES,
+		sip->ErrorCount[INVALID_EFLAG_ERROR] / BENCH_PASSES,
+		sip->ErrorCount[INVALID_CMD_ERROR] / BENCH_PASSES,
+		sip->ErrorCount[INVALID_CS_ERROR] / BENCH_PASSES,
+		sip->ErrorCount[INVALID_LENGTH_ERROR] / BENCH_PASSES);
+}
+
+static void start(SIP_t *sip)
+{
+	int i;
+
+	memset(sip, 0, sizeof(SIP_t));
+
+	for (i = 0; i < 4; i++)
+		SIPRegisterCommand(sip, i, count_frame);
+
+	frames_seen = 0;
+	frames_hash = 2166136261u;
+}
+
+static void bench_parse(SIP_t *sip, SIPMode_t mode)
+{
+	// worst case is a full frame with noise in front of it
+	uint8_t *stream = malloc((size_t)BENCH_FRAMES * (SIP_TEXT_FRAME_LEN(PARSE_MAX_LEN) + 8));
+	size_t bytes = build_stream(stream, mode);
+	const char *prefix = mode == SIP_MODE_BINARY ? "binary" : "text";
+	char name[32];
+	uint64_t elapsed;
+	unsigned int i;
+	size_t j;
+	int pass;
+
+	printf("%s, %d frames in %u bytes, %d passes\n", prefix,
+		BENCH_FRAMES, (unsigned int)bytes, BENCH_PASSES);
+
+	start(sip);
+	SIPSetMode(sip, mode);
+	elapsed = now_ns();
+
+	for (pass = 0; pass < BENCH_PASSES; pass++)
+	{
+		for (j = 0; j < bytes; j++)
+			SIPFeedInput(sip, stream[j]);
+	}
+
+	snprintf(name, sizeof(name), "%s per char", prefix);
+	report(name, now_ns() - elapsed, bytes);
+	report_errors(sip);
+
+	for (i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+	{
+		start(sip);
+		SIPSetMode(sip, mode);
+		elapsed = now_ns();
+
+		for (pass = 0; pass < BENCH_PASSES; pass++)
+		{
+			for (j = 0; j < bytes; j += chunk_sizes[i])
+			{
+				size_t n = bytes - j;
+
+				if (n > chunk_sizes[i])
+					n = chunk_sizes[i];
+
+				SIPFeedBuffer(sip, (const char *)&stream[j], n);
+			}
+		}
+
+		snprintf(name, sizeof(name), "%s %u", prefix, (unsigned int)chunk_sizes[i]);
+		report(name, now_ns() - elapsed, bytes);
+	}
+
+	report_errors(sip);
+	free(stream);
+}
+
+// a frame declaring more payload than SIP_MAX_PAYLOAD_LEN has to be dropped
+// as a bad length before any of it is stored, and the frame after it still
+// has to arrive. Lengths that fit are skipped, so a short length is only
+// tried when SIP_MAX_PAYLOAD_LEN is built below SIP_LENGTH_EXTENDED
+static int check_oversize(SIP_t *sip)
+{
+	static const uint16_t lengths[] = { SIP_LENGTH_EXTENDED - 1, SIP_MAX_PAYLOAD_LEN + 1 };
+	static uint8_t payload[SIP_MAX_PAYLOAD_LEN + SIP_LENGTH_EXTENDED];
+	static uint8_t frame[SIP_TEXT_FRAME_LEN(SIP_MAX_PAYLOAD_LEN + SIP_LENGTH_EXTENDED)];
+	int failed = 0;
+	unsigned int i;
+	size_t n;
+
+	memset(payload, 0x55, sizeof(payload));
+
+	for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+	{
+		if (lengths[i] <= SIP_MAX_PAYLOAD_LEN)
+			continue;
+
+		start(sip);
+		SIPSetMode(sip, SIP_MODE_BINARY);
+
+		n = SIPEncodeBinary(frame, 0, 0, payload, lengths[i]);
+		SIPFeedBuffer(sip, (const char *)frame, n);
+		n = SIPEncodeBinary(frame, 1, 1, payload, 16);
+		SIPFeedBuffer(sip, (const char *)frame, n);
+
+		printf("oversize %-7s %4u bytes  length errors %u  frames after %u  %s\n",
+			lengths[i] < SIP_LENGTH_EXTENDED ? "short" : "extended", lengths[i],
+			sip->ErrorCount[INVALID_LENGTH_ERROR], frames_seen,
+			sip->ErrorCount[INVALID_LENGTH_ERROR] == 1 && frames_seen == 1 ? "ok" : "WRONG");
+
+		failed |= sip->ErrorCount[INVALID_LENGTH_ERROR] != 1 || frames_seen != 1;
+	}
+
+	return failed;
+}
+
+static void bench_crc(void)
+{
+	uint8_t *data = malloc(CRC_BYTES);
+	uint16_t bytewise = SIP_CRC16_INIT;
+	uint16_t sliced = SIP_CRC16_INIT;
+	uint64_t bytewise_ns, sliced_ns;
+	size_t i;
+	int pass;
+
+	srand(2);
+
+	for (i = 0; i < CRC_BYTES; i++)
+		data[i] = rand() & 0xff;
+
+	bytewise_ns = now_ns();
+
+	for (pass = 0; pass < CRC_PASSES; pass++)
+	{
+		for (i = 0; i < CRC_BYTES; i++)
+			bytewise = SIPCrc16Byte(bytewise, data[i]);
+	}
+
+	bytewise_ns = now_ns() - bytewise_ns;
+	sliced_ns = now_ns();
+
+	for (pass = 0; pass < CRC_PASSES; pass++)
+		sliced = SIPCrc16(sliced, data, CRC_BYTES);
+
+	sliced_ns = now_ns() - sliced_ns;
+
+	printf("crc-16 of %d bytes, %d passes\n", CRC_BYTES, CRC_PASSES);
+	printf("%-16s %8.3f ns/byte  crc 0x%04x\n", "byte at a time",
+		(double)bytewise_ns / CRC_BYTES / CRC_PASSES, bytewise);
+	printf("%-16s %8.3f ns/byte  crc 0x%04x  %.2fx\n", "slice-by-4",
+		(double)sliced_ns / CRC_BYTES / CRC_PASSES, sliced,
+		(double)bytewise_ns / sliced_ns);
+
+	free(data);
+}
+
+static uint32_t upload_received;
+
+static int upload_frame(uint8_t *payload, uint16_t payload_length,
+						SIPResponse_t *response)
+{
+	upload_received += payload_length;
+	return 0;
+}
+
+static uint32_t sim_clock_us(void)
+{
+	return (uint32_t)(RPI_HalSimTime() / 1000);
+}
+
+/* Send UPLOAD_BYTES in full frames over the simulated UART, switching to
+   binary mode first if asked to, and return the virtual time it took. With
+   deferred the parser is fed from the interrupt handler and the handlers run
+   from the queue once per poll */
+static uint64_t bench_upload(SIP_t *sip, SIPMode_t mode, bool deferred, uint32_t *link_bytes)
+{
+	static uint8_t line[UPLOAD_BYTES * 3];
+	uint8_t payload[255];
+	uint8_t *p = line;
+	uint32_t sent;
+	int i;
+
+	if (mode == SIP_MODE_BINARY)
+	{
+		uint8_t set_mode = SIP_MODE_BINARY;
+		p += SIPEncodeText((char *)p, SIP_CMD_SET_MODE, 0, &set_mode, 1);
+	}
+
+	srand(2);
+
+	for (sent = 0; sent < UPLOAD_BYTES; sent += sizeof(payload))
+	{
+		uint8_t length = UPLOAD_BYTES - sent < sizeof(payload) ? UPLOAD_BYTES - sent : sizeof(payload);
+
+		for (i = 0; i < length; i++)
+			payload[i] = rand() & 0xff;
+
+		if (mode == SIP_MODE_BINARY)
+			p += SIPEncodeBinary(p, UPLOAD_COMMAND, sent / sizeof(payload), payload, length);
+		else
+			p += SIPEncodeText((char *)p, UPLOAD_COMMAND, sent / sizeof(payload), payload, length);
+	}
+
+	*link_bytes = p - line;
+
+	memset(sip, 0, sizeof(SIP_t));
+	SIPRegisterCommand(sip, UPLOAD_COMMAND, upload_frame);
+	SIPSetDeferred(sip, deferred, sim_clock_us);
+	upload_received = 0;
+
+	RPI_HalSimReset();
+	RPI_AuxSimReset(BAUD);
+	RPI_AuxMiniUartInit(BAUD, 8, true);
+	RPI_AuxSimReceive(line, *link_bytes);
+
+	while (upload_received < UPLOAD_BYTES)
+	{
+		uint64_t end = RPI_HalSimTime() + POLL_NS;
+		char rx[AUX_RX_BUFFER_SIZE];
+		int n;
+
+		// let the line run, with the interrupt handler filling the ring
+		while (RPI_HalSimTime() < end)
+		{
+			if (RPI_AuxSimIrqPending())
+			{
+				RPI_AuxMiniUartIRQHandler(RPI_IRQ_AUX_INT, 0);
+
+				if (deferred)
+				{
+					n = RPI_AuxMiniUartRead(rx, sizeof(rx));
+					SIPFeedBuffer(sip, rx, n);
+				}
+			}
+			else
+			{
+				uint64_t next = RPI_HalSimNextEvent();
+
+				if (next <= RPI_HalSimTime() || next > end)
+					next = end;
+
+				RPI_HalSimAdvance(next - RPI_HalSimTime());
+			}
+		}
+
+		n = RPI_AuxMiniUartRead(rx, sizeof(rx));
+		SIPFeedBuffer(sip, rx, n);
+		SIPProcessQueue(sip, -1);
+	}
+
+	return RPI_HalSimTime();
+}
+
+/* Both ends of the simulated link. Frames the host sends go onto the receive
+   line of the simulated UART. Every frame the device sends is also kept in
+   device_wire, and the host parses it once the simulated transmitter has
+   actually sent it */
+static uint8_t host_line[65536];
+static uint32_t host_line_length;
+static uint8_t device_wire[65536];
+static uint32_t device_wire_length;
+static uint32_t host_parsed;
+
+static void host_send(const uint8_t *frame, size_t length)
+{
+	rpi_aux_sim_t *sim = RPI_AuxSimState();
+
+	memcpy(&host_line[host_line_length], frame, length);
+
+	if (sim->rx_line_length == 0)
+		RPI_AuxSimReceive(&host_line[host_line_length], length);
+	else
+		sim->rx_line_length += length;
+
+	host_line_length += length;
+}
+
+static void device_transmit(const uint8_t *frame, size_t length)
+{
+	memcpy(&device_wire[device_wire_length], frame, length);
+	device_wire_length += length;
+
+	RPI_AuxMiniUartQueue((const char *)frame, length);
+}
+
+/* Start a binary mode link with the device feeding its parser from the main
+   loop and running the handlers from the queue, like kernel_main */
+static void link_start(SIP_t *sip, SIP_t *host)
+{
+	memset(sip, 0, sizeof(SIP_t));
+	SIPSetMode(sip, SIP_MODE_BINARY);
+	SIPSetTransmit(sip, device_transmit);
+	SIPSetDeferred(sip, true, sim_clock_us);
+
+	memset(host, 0, sizeof(SIP_t));
+	SIPSetMode(host, SIP_MODE_BINARY);
+
+	host_line_length = 0;
+	device_wire_length = 0;
+	host_parsed = 0;
+
+	RPI_HalSimReset();
+	RPI_AuxSimReset(BAUD);
+	RPI_AuxMiniUartInit(BAUD, 8, true);
+	RPI_AuxMiniUartSetTxPolicy(AUX_TX_BLOCK);
+}
+
+/* Run one main loop poll worth of virtual time. The host gets to send
+   whenever anything happens */
+static void link_poll(SIP_t *sip, SIP_t *host, void (*host_step)(void))
+{
+	rpi_aux_sim_t *sim = RPI_AuxSimState();
+	uint64_t end = RPI_HalSimTime() + POLL_NS;
+	char rx[AUX_RX_BUFFER_SIZE];
+	int n;
+
+	while (RPI_HalSimTime() < end)
+	{
+		host_step();
+
+		if (RPI_AuxSimIrqPending())
+		{
+			RPI_AuxMiniUartIRQHandler(RPI_IRQ_AUX_INT, 0);
+		}
+		else
+		{
+			uint64_t next = RPI_HalSimNextEvent();
+
+			if (next <= RPI_HalSimTime() || next > end)
+				next = end;
+
+			RPI_HalSimAdvance(next - RPI_HalSimTime());
+		}
+
+		if (sim->tx_bytes > host_parsed)
+		{
+			SIPFeedBuffer(host, (const char *)&device_wire[host_parsed], sim->tx_bytes - host_parsed);
+			host_parsed = sim->tx_bytes;
+		}
+	}
+
+	n = RPI_AuxMiniUartRead(rx, sizeof(rx));
+	SIPFeedBuffer(sip, rx, n);
+	SIPProcessQueue(sip, -1);
+}
+
+static uint32_t echo_window;
+static uint32_t echo_requests;
+static uint32_t echo_replies;
+static uint32_t echo_mismatches;
+
+static int echo_request(uint8_t *payload, uint16_t payload_length,
+						SIPResponse_t *response)
+{
+	// written straight into the TX frame
+	memcpy(response->data, payload, payload_length);
+	response->length = payload_length;
+
+	return 0;
+}
+
+static int echo_reply(uint8_t *payload, uint16_t payload_length,
+					  SIPResponse_t *response)
+{
+	// replies come back in order, with the request's sequence and a status
+	if (response->sequence != (uint8_t)echo_replies || payload[0] != 0 ||
+		payload_length != ECHO_LENGTH + 1)
+	{
+		echo_mismatches++;
+	}
+
+	echo_replies++;
+
+	return 0;
+}
+
+static void echo_step(void)
+{
+	uint8_t frame[SIP_BINARY_FRAME_LEN(ECHO_LENGTH)];
+	uint8_t payload[ECHO_LENGTH];
+
+	memset(payload, 0x5a, sizeof(payload));
+
+	// the host sends whenever the window allows
+	while (echo_requests < ECHO_REQUESTS && echo_requests - echo_replies < echo_window)
+	{
+		host_send(frame, SIPEncodeBinary(frame, ECHO_COMMAND, echo_requests,
+										 payload, sizeof(payload)));
+		echo_requests++;
+	}
+}
+
+/* Send ECHO_REQUESTS requests with at most window of them waiting for a
+   reply, and return the virtual time it took to get all the replies */
+static uint64_t bench_echo(SIP_t *sip, SIP_t *host, uint32_t window)
+{
+	link_start(sip, host);
+	SIPRegisterCommand(sip, ECHO_COMMAND, echo_request);
+	SIPRegisterCommand(host, ECHO_COMMAND, echo_reply);
+
+	echo_window = window;
+	echo_requests = 0;
+	echo_replies = 0;
+	echo_mismatches = 0;
+
+	while (echo_replies < ECHO_REQUESTS)
+		link_poll(sip, host, echo_step);
+
+	return RPI_HalSimTime();
+}
+
+/* The host end of a bulk transfer: go back N with a window of chunks */
+static struct
+{
+	uint32_t window;
+	uint32_t chunk;
+	int32_t lose;				// drop this chunk on its first send, -1 for none
+
+	bool start_sent;
+	bool started;
+	uint32_t next;				// next offset to send
+	uint32_t acked;				// the device has everything before this
+	uint32_t in_flight;
+	uint32_t chunks_sent;
+	uint32_t rewinds;
+	uint8_t sequence;
+	uint8_t rewind_sequence;	// replies to anything older are stale
+	uint64_t last_reply_ns;
+	uint8_t data[UPLOAD_BYTES];
+} bulk;
+
+static SIPBulkTarget_t bulk_target;
+static uint8_t bulk_buffer[UPLOAD_BYTES];
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void bulk_rewind(uint32_t offset)
+{
+	bulk.next = offset;
+	bulk.in_flight = 0;
+	bulk.rewind_sequence = bulk.sequence;
+	bulk.rewinds++;
+}
+
+static int bulk_start_reply(uint8_t *payload, uint16_t payload_length,
+							SIPResponse_t *response)
+{
+	bulk.started = payload[0] == SIP_BULK_OK;
+	bulk.last_reply_ns = RPI_HalSimTime();
+
+	return 0;
+}
+
+static int bulk_data_reply(uint8_t *payload, uint16_t payload_length,
+						   SIPResponse_t *response)
+{
+	uint32_t received = get_be32(&payload[1]);
+
+	bulk.last_reply_ns = RPI_HalSimTime();
+
+	if (received > bulk.acked)
+		bulk.acked = received;
+
+	// everything sent before the last rewind has already been written off
+	if ((int8_t)(response->sequence - bulk.rewind_sequence) < 0)
+		return 0;
+
+	bulk.in_flight--;
+
+	if (payload[0] != SIP_BULK_OK)
+		bulk_rewind(received);
+
+	return 0;
+}
+
+static void bulk_step(void)
+{
+	uint8_t frame[SIP_BINARY_FRAME_LEN(SIP_MAX_PAYLOAD_LEN)];
+	uint8_t payload[SIP_MAX_PAYLOAD_LEN];
+
+	if (!bulk.start_sent)
+	{
+		payload[0] = 0;
+		put_be32(&payload[1], UPLOAD_BYTES);
+
+		host_send(frame, SIPEncodeBinary(frame, SIP_CMD_BULK_START, bulk.sequence++,
+										 payload, SIP_BULK_HEADER_LEN));
+		bulk.start_sent = true;
+		return;
+	}
+
+	if (!bulk.started)
+		return;
+
+	// a lost chunk at the end of the window is never refused, time it out
+	if (bulk.in_flight != 0 &&
+		RPI_HalSimTime() - bulk.last_reply_ns > BULK_TIMEOUT_NS)
+	{
+		bulk.last_reply_ns = RPI_HalSimTime();
+		bulk_rewind(bulk.acked);
+	}
+
+	while (bulk.in_flight < bulk.window && bulk.next < UPLOAD_BYTES)
+	{
+		uint32_t n = UPLOAD_BYTES - bulk.next;
+		size_t length;
+
+		if (n > bulk.chunk)
+			n = bulk.chunk;
+
+		payload[0] = 0;
+		put_be32(&payload[1], bulk.next);
+		memcpy(&payload[SIP_BULK_HEADER_LEN], &bulk.data[bulk.next], n);
+
+		length = SIPEncodeBinary(frame, SIP_CMD_BULK_DATA, bulk.sequence++,
+								 payload, SIP_BULK_HEADER_LEN + n);
+
+		if (bulk.chunks_sent++ != (uint32_t)bulk.lose)
+			host_send(frame, length);
+
+		bulk.next += n;
+		bulk.in_flight++;
+	}
+}
+
+/* Upload UPLOAD_BYTES into a bulk target in chunks of chunk bytes with up to
+   window of them in flight, and return the virtual time it took */
+static uint64_t bench_bulk(SIP_t *sip, SIP_t *host, uint32_t chunk, uint32_t window, int32_t lose)
+{
+	uint32_t i;
+
+	link_start(sip, host);
+	SIPRegisterCommand(host, SIP_CMD_BULK_START, bulk_start_reply);
+	SIPRegisterCommand(host, SIP_CMD_BULK_DATA, bulk_data_reply);
+
+	memset(&bulk, 0, sizeof(bulk));
+	bulk.chunk = chunk;
+	bulk.window = window;
+	bulk.lose = lose;
+
+	srand(3);
+
+	for (i = 0; i < UPLOAD_BYTES; i++)
+		bulk.data[i] = rand() & 0xff;
+
+	memset(bulk_buffer, 0, sizeof(bulk_buffer));
+	memset(&bulk_target, 0, sizeof(bulk_target));
+	bulk_target.buffer = bulk_buffer;
+	bulk_target.size = sizeof(bulk_buffer);
+	SIPRegisterBulkTarget(sip, 0, &bulk_target);
+
+	while (bulk.acked < UPLOAD_BYTES)
+		link_poll(sip, host, bulk_step);
+
+	return RPI_HalSimTime();
+}
+
+static void report_bulk(const char *name, uint64_t ns)
+{
+	double rate = UPLOAD_BYTES / (ns / 1e9);
+
+	printf("%-22s %8.0f bytes/sec %5.1f%% of the line  chunks %4u  refused %3u  rewinds %u  %s\n",
+		name, rate, 100.0 * rate / (BAUD / 10),
+		bulk.chunks_sent, bulk_target.refused, bulk.rewinds,
+		memcmp(bulk_buffer, bulk.data, UPLOAD_BYTES) == 0 ? "ok" : "CORRUPT");
+}
+
+int main(void)
+{
+	SIP_t *sip = malloc(sizeof(SIP_t));
+	SIP_t *host = malloc(sizeof(SIP_t));
+	uint32_t window;
+	uint32_t text_bytes, binary_bytes, deferred_bytes;
+	uint64_t text_ns, binary_ns, deferred_ns;
+	int failed;
+
+	failed = check_oversize(sip);
+
+#if SIP_MAX_PAYLOAD_LEN < PARSE_MAX_LEN
+	// built with a small SIP_MAX_PAYLOAD_LEN to try a short length that's
+	// too long, the frames the benchmarks send don't fit
+	free(host);
+	free(sip);
+
+	return failed;
+#endif
+
+	bench_crc();
+	bench_parse(sip, SIP_MODE_TEXT);
+	bench_parse(sip, SIP_MODE_BINARY);
+
+	text_ns = bench_upload(sip, SIP_MODE_TEXT, false, &text_bytes);
+	binary_ns = bench_upload(sip, SIP_MODE_BINARY, false, &binary_bytes);
+
+	printf("upload of %d bytes at %d baud\n", UPLOAD_BYTES, BAUD);
+	printf("%-16s %6u link bytes %8.0f payload bytes/sec\n", "text",
+		text_bytes, UPLOAD_BYTES / (text_ns / 1e9));
+	printf("%-16s %6u link bytes %8.0f payload bytes/sec\n", "binary",
+		binary_bytes, UPLOAD_BYTES / (binary_ns / 1e9));
+	printf("%-16s %6.2fx\n", "speedup", (double)text_ns / binary_ns);
+
+	deferred_ns = bench_upload(sip, SIP_MODE_BINARY, true, &deferred_bytes);
+
+	printf("%-16s %6u link bytes %8.0f payload bytes/sec\n", "binary deferred",
+		deferred_bytes, UPLOAD_BYTES / (deferred_ns / 1e9));
+	printf("%-16s queued %u executed %u dropped %u max depth %u latency avg %.1f max %u us\n",
+		"", sip->QueueStats.queued, sip->QueueStats.executed,
+		sip->QueueStats.dropped, sip->QueueStats.max_depth,
+		sip->QueueStats.executed ? (double)sip->QueueStats.latency_total / sip->QueueStats.executed : 0.0,
+		sip->QueueStats.latency_max);
+
+	printf("echo of %d byte payloads at %d baud, %d requests\n", ECHO_LENGTH, BAUD, ECHO_REQUESTS);
+
+	for (window = 1; window <= SIP_FRAME_POOL_SZ; window *= 2)
+	{
+		uint64_t ns = bench_echo(sip, host, window);
+
+		printf("in flight %-6u %8.0f requests/sec  %6.0f us round trip  mismatches %u  dropped %u\n",
+			window, ECHO_REQUESTS / (ns / 1e9), ns / 1e3 / ECHO_REQUESTS * window,
+			echo_mismatches, sip->QueueStats.dropped);
+	}
+
+	printf("bulk upload of %d bytes at %d baud\n", UPLOAD_BYTES, BAUD);
+
+	report_bulk("250 byte chunks, 1", bench_bulk(sip, host, 250, 1, -1));
+
+	for (window = 1; window <= SIP_FRAME_POOL_SZ; window *= 2)
+	{
+		char name[32];
+		uint64_t ns = bench_bulk(sip, host, SIP_BULK_CHUNK_MAX, window, -1);
+
+		snprintf(name, sizeof(name), "%d byte chunks, %u", SIP_BULK_CHUNK_MAX, window);
+		report_bulk(name, ns);
+	}
+
+	report_bulk("chunk 5 lost, 4", bench_bulk(sip, host, SIP_BULK_CHUNK_MAX, 4, 5));
+	report_bulk("last chunk lost, 4", bench_bulk(sip, host, SIP_BULK_CHUNK_MAX, 4,
+		(UPLOAD_BYTES + SIP_BULK_CHUNK_MAX - 1) / SIP_BULK_CHUNK_MAX - 1));
+
+	free(host);
+	free(sip);
+
+	return failed;
+}
@@ -0,0 +1,271 @@
+/* Host benchmark for the mini UART transmit and receive paths, run against the simulated
+   AUX block in rpi-aux-sim.c. CPU time is the virtual time the driver spends
+   on register accesses and busy waiting; the cost of copying into the ring
+   is measured on its own in host time */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "rpi-aux.h"
+#include "rpi-aux-sim.h"
+#include "rpi-interrupts.h"
+
+#define BAUD            115200
+#define LINE_LENGTH     64
+#define FRAMES          100
+#define BURST_LINES     32
+#define STREAM_BYTES    16384
+#define RX_BYTES        4096
+#define RX_FRAMES       40
+
+/* One debug line per 60Hz frame */
+#define FRAME_NS        16666666ULL
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Let ns of virtual time pass, running the interrupt handler whenever the
+   model raises the interrupt. Returns the CPU time spent in the handler */
+static uint64_t run_for(uint64_t ns)
+{
+	uint64_t end = RPI_HalSimTime() + ns;
+	uint64_t cpu = 0;
+
+	while (RPI_HalSimTime() < end)
+	{
+		if (RPI_AuxSimIrqPending())
+		{
+			uint64_t t = RPI_HalSimTime();
+
+			RPI_AuxMiniUartIRQHandler(RPI_IRQ_AUX_INT, 0);
+
+			cpu += RPI_HalSimTime() - t;
+		}
+		else
+		{
+			uint64_t next = RPI_HalSimNextEvent();
+
+			if (next <= RPI_HalSimTime() || next > end)
+				next = end;
+
+			RPI_HalSimAdvance(next - RPI_HalSimTime());
+		}
+	}
+
+	return cpu;
+}
+
+static void report(const char *name, uint64_t cpu, uint64_t bytes)
+{
+	printf("%-18s cpu %9.1f ns/byte  sent %6llu  dropped %6u\n",
+		name, bytes ? (double)cpu / bytes : 0.0,
+		(unsigned long long)RPI_AuxSimState()->tx_bytes,
+		RPI_AuxMiniUartTxStats()->dropped);
+}
+
+static void start(bool interrupt, aux_tx_policy_t policy)
+{
+	RPI_HalSimReset();
+	RPI_AuxSimReset(BAUD);
+	RPI_AuxMiniUartInit(BAUD, 8, interrupt);
+	RPI_AuxMiniUartSetTxPolicy(policy);
+	memset(RPI_AuxMiniUartTxStats(), 0, sizeof(aux_tx_stats_t));
+}
+
+/* Run until everything accepted has gone out on the wire */
+static uint64_t drain(void)
+{
+	uint64_t cpu = 0;
+
+	while (RPI_AuxSimState()->tx_level > 0 ||
+		   (rpiAuxSimRegisters.MU_IER & AUX_MUIER_TX_INT))
+		cpu += run_for(FRAME_NS);
+
+	return cpu;
+}
+
+/* Write lines_per_frame lines at once, then let that many frames pass so
+   the average rate is the same whatever the burst size */
+static void bench_frames(const char *name, bool queued, aux_tx_policy_t policy,
+						 int lines_per_frame)
+{
+	char line[LINE_LENGTH];
+	uint64_t cpu = 0;
+	int i, n, j;
+
+	memset(line, 'x', sizeof(line));
+	start(queued, policy);
+
+	for (i = 0; i < FRAMES; i++)
+	{
+		uint64_t t = RPI_HalSimTime();
+		uint64_t used;
+
+		for (n = 0; n < lines_per_frame; n++)
+		{
+			if (queued)
+				RPI_AuxMiniUartQueue(line, LINE_LENGTH);
+			else
+				for (j = 0; j < LINE_LENGTH; j++)
+					RPI_AuxMiniUartWrite(line[j]);
+		}
+
+		used = RPI_HalSimTime() - t;
+		cpu += used;
+
+		if (used < FRAME_NS * lines_per_frame)
+			cpu += run_for(FRAME_NS * lines_per_frame - used);
+	}
+
+	cpu += drain();
+
+	report(name, cpu, (uint64_t)FRAMES * lines_per_frame * LINE_LENGTH);
+}
+
+/* Push STREAM_BYTES as fast as the driver takes them and report the rate
+   they reach the wire */
+static void bench_stream(const char *name, bool queued)
+{
+	rpi_aux_sim_t *sim = RPI_AuxSimState();
+	char block[LINE_LENGTH];
+	int i, j;
+
+	memset(block, 'x', sizeof(block));
+	start(queued, AUX_TX_BLOCK);
+
+	for (i = 0; i < STREAM_BYTES / LINE_LENGTH; i++)
+	{
+		if (queued)
+		{
+			// leave room for the interrupt to run when the ring is full
+			while (RPI_AuxMiniUartTxStats()->queued - RPI_AuxMiniUartTxStats()->sent >
+				   AUX_TX_BUFFER_SIZE - LINE_LENGTH)
+				run_for(sim->byte_ns);
+
+			RPI_AuxMiniUartQueue(block, LINE_LENGTH);
+		}
+		else
+		{
+			for (j = 0; j < LINE_LENGTH; j++)
+				RPI_AuxMiniUartWrite(block[j]);
+		}
+	}
+
+	drain();
+
+	printf("%-18s %8.0f bytes/sec (line rate %d)\n", name,
+		sim->tx_bytes * 1e9 / RPI_HalSimTime(), BAUD / 10);
+}
+
+/* Host time to copy into the ring, with the FIFO kept full so that no
+   register accesses are made beyond the status check */
+static void bench_copy(void)
+{
+	char line[LINE_LENGTH];
+	uint64_t total = 0;
+	uint64_t bytes = 0;
+	int i, n;
+
+	memset(line, 'x', sizeof(line));
+
+	for (i = 0; i < 1000; i++)
+	{
+		uint64_t h;
+
+		start(true, AUX_TX_DROP);
+
+		h = now_ns();
+
+		for (n = 0; n < AUX_TX_BUFFER_SIZE / LINE_LENGTH; n++)
+			RPI_AuxMiniUartQueue(line, LINE_LENGTH);
+
+		total += now_ns() - h;
+		bytes += AUX_TX_BUFFER_SIZE;
+	}
+
+	printf("%-18s host %8.2f ns/byte\n", "queue copy", (double)total / bytes);
+}
+
+/* Data arrives at line rate while the main loop picks it up once every
+   read_every frames, either polling the FIFO itself or reading the ring the
+   interrupt handler fills */
+static void bench_rx(const char *name, bool interrupt, int read_every)
+{
+	static uint8_t incoming[RX_BYTES];
+	rpi_aux_sim_t *sim = RPI_AuxSimState();
+	aux_rx_stats_t *stats = RPI_AuxMiniUartRxStats();
+	char buffer[AUX_RX_BUFFER_SIZE];
+	uint64_t cpu = 0;
+	uint32_t got = 0;
+	int frame;
+
+	memset(incoming, 'r', sizeof(incoming));
+	start(interrupt, AUX_TX_BLOCK);
+	memset(stats, 0, sizeof(*stats));
+
+	RPI_AuxSimReceive(incoming, sizeof(incoming));
+
+	for (frame = 0; frame < RX_FRAMES; frame++)
+	{
+		uint64_t t = RPI_HalSimTime();
+
+		if ((frame % read_every) == 0)
+		{
+			if (interrupt)
+			{
+				got += RPI_AuxMiniUartRead(buffer, sizeof(buffer));
+			}
+			else
+			{
+				while (RPI_REG_READ(RPI_GetAux()->MU_LSR) & AUX_MULSR_DATA_READY)
+				{
+					RPI_AuxMiniUartBlockRead(buffer);
+					got++;
+				}
+			}
+		}
+
+		cpu += RPI_HalSimTime() - t;
+		cpu += run_for(FRAME_NS);
+	}
+
+	printf("%-18s cpu %9.1f ns/byte  read %5u  fifo lost %5llu  ring overruns %5u\n",
+		name, got ? (double)cpu / got : 0.0, got,
+		(unsigned long long)sim->rx_lost, stats->ring_overruns);
+}
+
+int main(void)
+{
+	printf("mini uart tx at %d baud, %d byte lines, %llu us frames\n",
+		BAUD, LINE_LENGTH, FRAME_NS / 1000);
+
+	bench_frames("blocking", false, AUX_TX_BLOCK, 1);
+	bench_frames("queued", true, AUX_TX_BLOCK, 1);
+
+	bench_copy();
+
+	bench_stream("stream blocking", false);
+	bench_stream("stream queued", true);
+
+	printf("bursts of %d lines every %d frames into a %d byte ring\n",
+		BURST_LINES, BURST_LINES, AUX_TX_BUFFER_SIZE);
+
+	bench_frames("burst block", true, AUX_TX_BLOCK, BURST_LINES);
+	bench_frames("burst drop", true, AUX_TX_DROP, BURST_LINES);
+	bench_frames("burst overwrite", true, AUX_TX_OVERWRITE, BURST_LINES);
+
+	printf("mini uart rx, %d bytes at line rate into a %d byte ring\n",
+		RX_BYTES, AUX_RX_BUFFER_SIZE);
+
+	bench_rx("rx polled", false, 1);
+	bench_rx("rx ring", true, 1);
+	bench_rx("rx ring, slow", true, 4);
+
+	return 0;
+}
@@ -0,0 +1,289 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "jobs.h"
+
+#if defined(RPI_HOST)
+	#include <pthread.h>
+	#include <sched.h>
+
+	#define JOBS_RELAX() sched_yield()
+#else
+	#include "rpi-smp.h"
+
+	#if defined(RPI2)
+		#define JOBS_RELAX() __asm volatile("yield" ::: "memory")
+	#else
+		#define JOBS_RELAX() do { } while (0)
+	#endif
+#endif
+
+#define JOBS_DEQUE_MASK (JOBS_DEQUE_SZ - 1)
+
+// each worker's deque and counters on lines of their own, so one core
+// pushing doesn't keep taking the line away from the others
+typedef struct
+{
+	JobDeque_t deque;
+	JobWorkerStats_t stats;
+} __attribute__((aligned(64))) JobWorker_t;
+
+static JobWorker_t workers[JOBS_MAX_WORKERS];
+static volatile int workerCount = 1;
+static volatile bool stopping;
+
+#if defined(RPI_HOST)
+static pthread_t threads[JOBS_MAX_WORKERS];
+static __thread int self;
+#endif
+
+// only ever called by the deque's own worker
+static bool deque_push(JobDeque_t *d, const Job_t *job)
+{
+	uint32_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+	uint32_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+	if (b - t >= JOBS_DEQUE_SZ)
+		return false;
+
+	d->jobs[b & JOBS_DEQUE_MASK] = *job;
+
+	// the job is in its slot before a thief can see the new bottom
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+
+	return true;
+}
+
+// only ever called by the deque's own worker, takes the newest job
+static bool deque_pop(JobDeque_t *d, Job_t *job)
+{
+	uint32_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+	uint32_t t;
+	bool got = true;
+
+	__atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+	if ((int32_t)(b - t) < 0)
+	{
+		// empty, put bottom back
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	*job = d->jobs[b & JOBS_DEQUE_MASK];
+
+	if (b == t)
+	{
+		// the last job, which a thief may be after too
+		got = __atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+										  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+
+	return got;
+}
+
+// any worker, takes the oldest job
+static bool deque_steal(JobDeque_t *d, Job_t *job)
+{
+	uint32_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	uint32_t b;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+
+	if ((int32_t)(b - t) <= 0)
+		return false;
+
+	*job = d->jobs[t & JOBS_DEQUE_MASK];
+
+	// losing the race to the owner or another thief means the copy may be
+	// of a slot that has since been reused, it's thrown away
+	return __atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+									   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static void job_run(const Job_t *job)
+{
+	job->func(job->args);
+
+	// everything the job wrote is visible before the count drops
+	__atomic_sub_fetch(&job->counter->pending, 1, __ATOMIC_RELEASE);
+}
+
+// run one job, our own newest if there is one, else one stolen from the
+// next worker along that has any
+static bool run_one(int me)
+{
+	Job_t job;
+	int count = workerCount;
+	int i;
+
+	if (deque_pop(&workers[me].deque, &job))
+	{
+		workers[me].stats.executed++;
+		job_run(&job);
+		return true;
+	}
+
+	for (i = 1; i < count; i++)
+	{
+		int victim = (me + i) % count;
+
+		if (deque_steal(&workers[victim].deque, &job))
+		{
+			workers[me].stats.executed++;
+			workers[me].stats.stolen++;
+			job_run(&job);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int JobsSelf(void)
+{
+#if defined(RPI_HOST)
+	return self;
+#else
+	return (int)RPI_CoreId();
+#endif
+}
+
+int JobsWorkerCount(void)
+{
+	return workerCount;
+}
+
+JobWorkerStats_t *JobsStats(int worker)
+{
+	return &workers[worker].stats;
+}
+
+void JobsRelax(void)
+{
+	JOBS_RELAX();
+}
+
+void JobsSubmit(JobCounter_t *counter, JobFunc_t func, void *args)
+{
+	int me = JobsSelf();
+	Job_t job;
+
+	job.func = func;
+	job.args = args;
+	job.counter = counter;
+
+	__atomic_add_fetch(&counter->pending, 1, __ATOMIC_RELAXED);
+
+	if (!deque_push(&workers[me].deque, &job))
+	{
+		workers[me].stats.overflowed++;
+		workers[me].stats.executed++;
+		job_run(&job);
+	}
+}
+
+void JobsWait(JobCounter_t *counter)
+{
+	int me = JobsSelf();
+
+	while (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) != 0)
+	{
+		if (!run_one(me))
+			JOBS_RELAX();
+	}
+}
+
+void JobsWorkerMain(uint32_t worker)
+{
+	while (!stopping)
+	{
+		if (!run_one((int)worker))
+			JOBS_RELAX();
+	}
+}
+
+#if defined(RPI_HOST)
+
+static void *worker_thread(void *args)
+{
+	self = (int)(intptr_t)args;
+	JobsWorkerMain((uint32_t)self);
+
+	return NULL;
+}
+
+int JobsInit(int count)
+{
+	int i;
+
+	if (count > JOBS_MAX_WORKERS)
+		count = JOBS_MAX_WORKERS;
+
+	stopping = false;
+	self = 0;
+
+	// the deques are visible to every thread before any of them starts
+	workerCount = count < 1 ? 1 : count;
+
+	for (i = 1; i < workerCount; i++)
+	{
+		if (pthread_create(&threads[i], NULL, worker_thread, (void *)(intptr_t)i) != 0)
+			break;
+	}
+
+	workerCount = i;
+
+	return workerCount;
+}
+
+void JobsShutdown(void)
+{
+	int i;
+
+	stopping = true;
+
+	for (i = 1; i < workerCount; i++)
+		pthread_join(threads[i], NULL);
+
+	workerCount = 1;
+}
+
+#else
+
+int JobsInit(int count)
+{
+	int core;
+
+	if (count > (int)RPI_CoreCount())
+		count = (int)RPI_CoreCount();
+
+	if (count > JOBS_MAX_WORKERS)
+		count = JOBS_MAX_WORKERS;
+
+	stopping = false;
+	workerCount = count < 1 ? 1 : count;
+
+	// a core that doesn't come up ends the list, worker n is always core n
+	for (core = 1; core < workerCount; core++)
+	{
+		if (!RPI_SmpStartCore((uint32_t)core, JobsWorkerMain))
+			break;
+	}
+
+	workerCount = core;
+
+	return workerCount;
+}
+
+void JobsShutdown(void)
+{
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// One worker per core. On the RPi2 core 0 is the one that submits and the
+// other three are started by JobsInit, on host each extra worker is a thread
+#define JOBS_MAX_WORKERS 4
+
+// Jobs each worker can have queued, a power of 2. A submit that finds its
+// deque full runs the job there and then
+#ifndef JOBS_DEQUE_SZ
+#define JOBS_DEQUE_SZ 256
+#endif
+
+typedef void (*JobFunc_t)(void *args);
+
+// Counts the jobs submitted against it that haven't finished yet.
+// Zero it before the first submit
+typedef struct
+{
+	volatile uint32_t pending;
+} JobCounter_t;
+
+typedef struct
+{
+	JobFunc_t func;
+	void *args;
+	JobCounter_t *counter;
+} Job_t;
+
+// A Chase-Lev deque. Its worker pushes and pops at the bottom, everybody
+// else steals from the top
+typedef struct
+{
+	volatile uint32_t top;
+	volatile uint32_t bottom;
+	Job_t jobs[JOBS_DEQUE_SZ];
+} JobDeque_t;
+
+typedef struct
+{
+	uint32_t executed;
+	uint32_t stolen;
+	uint32_t overflowed;
+} JobWorkerStats_t;
+
+// Starts workers - 1 more workers, capped at what the platform has. Returns
+// how many there are in total, core 0 or the calling thread included
+int JobsInit(int workers);
+
+// Stops and joins the host threads. The cores on the Pi never stop
+void JobsShutdown(void);
+
+int JobsWorkerCount(void);
+
+// The calling worker's index, 0 for the one that called JobsInit
+int JobsSelf(void);
+
+// Queue func(args) on the calling worker's deque. Any worker can submit,
+// including from inside a job
+void JobsSubmit(JobCounter_t *counter, JobFunc_t func, void *args);
+
+// Run and steal jobs until everything submitted against counter is done
+void JobsWait(JobCounter_t *counter);
+
+// What a worker that isn't waiting on anything runs, forever or until
+// JobsShutdown. Started on each extra core or thread by JobsInit
+void JobsWorkerMain(uint32_t worker);
+
+JobWorkerStats_t *JobsStats(int worker);
+
+// What a worker does while it spins with nothing to run, for anything else
+// that has to spin waiting on another core
+void JobsRelax(void);
+
+#endif
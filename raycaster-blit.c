@@ -0,0 +1,103 @@
+#include <stdint.h>
+
+#include "raycaster.h"
+#include "raycaster-blit.h"
+
+#if defined(RAYCASTER_NEON)
+	#include <arm_neon.h>
+#endif
+
+typedef void (*transpose_tile_t)(const uint32_t *src, uint32_t src_stride,
+								 uint32_t *dst, uint32_t dst_stride,
+								 uint32_t width, uint32_t height);
+
+// pixel x, y of the tile is src[x * src_stride + y] and dst[y * dst_stride + x]
+static void transpose_tile_scalar(const uint32_t *src, uint32_t src_stride,
+								  uint32_t *dst, uint32_t dst_stride,
+								  uint32_t width, uint32_t height)
+{
+	uint32_t x, y;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+			dst[y * dst_stride + x] = src[x * src_stride + y];
+	}
+}
+
+#if defined(RAYCASTER_NEON)
+
+static void transpose_tile_neon(const uint32_t *src, uint32_t src_stride,
+								uint32_t *dst, uint32_t dst_stride,
+								uint32_t width, uint32_t height)
+{
+	uint32_t blocks_w = width & ~3u;
+	uint32_t blocks_h = height & ~3u;
+	uint32_t x, y;
+
+	for (y = 0; y < blocks_h; y += 4)
+	{
+		for (x = 0; x < blocks_w; x += 4)
+		{
+			const uint32_t *s = src + x * src_stride + y;
+			uint32_t *d = dst + y * dst_stride + x;
+
+			// four columns of four pixels in, four rows out
+			uint32x4x2_t t01 = vtrnq_u32(vld1q_u32(s), vld1q_u32(s + src_stride));
+			uint32x4x2_t t23 = vtrnq_u32(vld1q_u32(s + 2 * src_stride), vld1q_u32(s + 3 * src_stride));
+
+			vst1q_u32(d, vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0])));
+			vst1q_u32(d + dst_stride, vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1])));
+			vst1q_u32(d + 2 * dst_stride, vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0])));
+			vst1q_u32(d + 3 * dst_stride, vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1])));
+		}
+	}
+
+	// the right and bottom edges when the tile isn't a multiple of 4
+	if (blocks_w < width)
+		transpose_tile_scalar(src + blocks_w * src_stride, src_stride,
+							  dst + blocks_w, dst_stride, width - blocks_w, blocks_h);
+
+	if (blocks_h < height)
+		transpose_tile_scalar(src + blocks_h, src_stride,
+							  dst + blocks_h * dst_stride, dst_stride, width, height - blocks_h);
+}
+
+#endif
+
+static void transpose(const RayCasterSurface_t *src, RayCasterSurface_t *dst,
+					  transpose_tile_t tile)
+{
+	uint32_t width = src->width < dst->width ? src->width : dst->width;
+	uint32_t height = src->height < dst->height ? src->height : dst->height;
+	uint32_t src_stride = src->pitch >> 2;
+	uint32_t dst_stride = dst->pitch >> 2;
+	uint32_t x, y;
+
+	for (y = 0; y < height; y += RAYCASTER_BLIT_TILE)
+	{
+		uint32_t h = height - y < RAYCASTER_BLIT_TILE ? height - y : RAYCASTER_BLIT_TILE;
+
+		for (x = 0; x < width; x += RAYCASTER_BLIT_TILE)
+		{
+			uint32_t w = width - x < RAYCASTER_BLIT_TILE ? width - x : RAYCASTER_BLIT_TILE;
+
+			tile(src->pixels + x * src_stride + y, src_stride,
+				 dst->pixels + y * dst_stride + x, dst_stride, w, h);
+		}
+	}
+}
+
+void RayCasterTransposeScalar(const RayCasterSurface_t *src, RayCasterSurface_t *dst)
+{
+	transpose(src, dst, transpose_tile_scalar);
+}
+
+#if defined(RAYCASTER_NEON)
+
+void RayCasterTransposeNeon(const RayCasterSurface_t *src, RayCasterSurface_t *dst)
+{
+	transpose(src, dst, transpose_tile_neon);
+}
+
+#endif
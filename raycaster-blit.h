@@ -0,0 +1,30 @@
+#ifndef RAYCASTER_BLIT_H_
+#define RAYCASTER_BLIT_H_
+
+#include <stdint.h>
+
+#include "raycaster.h"
+#include "raycaster-texture.h"
+
+/* The transpose works through the surfaces a square tile at a time, small
+   enough that a tile of each stays in the L1 data cache while it's done */
+#define RAYCASTER_BLIT_TILE     32
+
+/* Column pitch in bytes for a column major surface height pixels high,
+   rounded so every column starts on a 16 byte boundary */
+#define RAYCASTER_COLUMN_PITCH(height)  ((((height) + 3) & ~3u) * 4)
+
+/* Copy a column major surface into a row major one, the framebuffer's back
+   buffer usually. Both are the size of the smaller of the two */
+void RayCasterTransposeScalar(const RayCasterSurface_t *src, RayCasterSurface_t *dst);
+
+#if defined(RAYCASTER_NEON)
+// The same, a 4x4 block of pixels at a time
+void RayCasterTransposeNeon(const RayCasterSurface_t *src, RayCasterSurface_t *dst);
+
+	#define RayCasterTranspose RayCasterTransposeNeon
+#else
+	#define RayCasterTranspose RayCasterTransposeScalar
+#endif
+
+#endif
@@ -0,0 +1,178 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "jobs.h"
+#include "raycaster.h"
+#include "raycaster-parallel.h"
+
+static uint32_t no_clock(void)
+{
+	return 0;
+}
+
+static void render_chunk(RayCasterParallel_t *rp, RayCasterWorker_t *w,
+						 uint32_t first, uint32_t count)
+{
+	uint32_t x;
+
+	if (rp->hits)
+	{
+		for (x = first; x < first + count; x++)
+			RayCasterDrawColumn(rp->rc, rp->surface, x, &rp->hits[x]);
+	}
+	else
+	{
+		RayCasterRenderColumns(rp->rc, rp->surface, first, count, w->scratch);
+	}
+
+	w->columns += count;
+	w->chunks++;
+}
+
+// the slot's chunks are every slots'th one, starting with its own
+static void interleaved_job(void *args)
+{
+	RayCasterSlot_t *slot = (RayCasterSlot_t *)args;
+	RayCasterParallel_t *rp = slot->rp;
+	RayCasterWorker_t *w = &rp->workers[JobsSelf()];
+	uint32_t width = rp->surface->width;
+	uint32_t stride = rp->slots * RAYCASTER_CHUNK_ALIGN;
+	uint32_t start = rp->clock();
+	uint32_t x;
+
+	for (x = slot->slot * RAYCASTER_CHUNK_ALIGN; x < width; x += stride)
+		render_chunk(rp, w, x, width - x < RAYCASTER_CHUNK_ALIGN ? width - x : RAYCASTER_CHUNK_ALIGN);
+
+	w->busy += rp->clock() - start;
+}
+
+// guided self-scheduling: each chunk is half of what's left divided between
+// the slots, so the last few are small enough to even out the finish
+static void adaptive_job(void *args)
+{
+	RayCasterSlot_t *slot = (RayCasterSlot_t *)args;
+	RayCasterParallel_t *rp = slot->rp;
+	RayCasterWorker_t *w = &rp->workers[JobsSelf()];
+	uint32_t width = rp->surface->width;
+	uint32_t start = rp->clock();
+	uint32_t first, count;
+
+	while (1)
+	{
+		first = __atomic_load_n(&rp->next_column, __ATOMIC_RELAXED);
+
+		do
+		{
+			if (first >= width)
+				goto done;
+
+			count = (width - first) / (2 * rp->slots);
+			count -= count % RAYCASTER_CHUNK_ALIGN;
+
+			if (count < RAYCASTER_CHUNK_ALIGN)
+				count = RAYCASTER_CHUNK_ALIGN;
+			else if (count > RAYCASTER_CHUNK_MAX)
+				count = RAYCASTER_CHUNK_MAX;
+
+			if (count > width - first)
+				count = width - first;
+		} while (!__atomic_compare_exchange_n(&rp->next_column, &first, first + count,
+											  false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+		render_chunk(rp, w, first, count);
+	}
+
+done:
+	w->busy += rp->clock() - start;
+}
+
+void RayCasterParallelInit(RayCasterParallel_t *rp, RayCasterSplit_t split,
+						   RayCasterClock_t clock)
+{
+	uint32_t i;
+
+	memset(rp, 0, sizeof(*rp));
+
+	rp->split = split;
+	rp->clock = clock ? clock : no_clock;
+	rp->reserved = -1;
+
+	for (i = 0; i < JOBS_MAX_WORKERS; i++)
+	{
+		rp->slot_args[i].rp = rp;
+		rp->slot_args[i].slot = i;
+	}
+}
+
+static void run_frame(RayCasterParallel_t *rp, const RayCaster_t *rc,
+					  RayCasterSurface_t *surface, const RayCasterHit_t *hits)
+{
+	JobFunc_t job = rp->split == RAYCASTER_SPLIT_ADAPTIVE ? adaptive_job : interleaved_job;
+	uint32_t start;
+	uint32_t i;
+
+	// nothing is in flight between frames, so the stats are ours to reset
+	for (i = 0; i < JOBS_MAX_WORKERS; i++)
+	{
+		rp->workers[i].busy = 0;
+		rp->workers[i].columns = 0;
+		rp->workers[i].chunks = 0;
+	}
+
+	rp->rc = rc;
+	rp->surface = surface;
+	rp->hits = hits;
+	rp->worker_count = (uint32_t)JobsWorkerCount();
+	rp->slots = rp->worker_count;
+	rp->next_column = 0;
+
+	if (rp->reserved >= 0 && rp->slots > 1)
+		rp->slots--;
+
+	start = rp->clock();
+
+	for (i = 0; i < rp->slots; i++)
+		JobsSubmit(&rp->frame, job, &rp->slot_args[i]);
+
+	// the frame barrier, this core renders too until every column is done
+	JobsWait(&rp->frame);
+
+	rp->frame_time = rp->clock() - start;
+	rp->max_busy = 0;
+
+	for (i = 0; i < rp->worker_count; i++)
+	{
+		if ((int)i != rp->reserved && rp->workers[i].busy > rp->max_busy)
+			rp->max_busy = rp->workers[i].busy;
+	}
+}
+
+void RayCasterParallelRender(RayCasterParallel_t *rp, const RayCaster_t *rc,
+							 RayCasterSurface_t *surface)
+{
+	run_frame(rp, rc, surface, NULL);
+}
+
+void RayCasterParallelDraw(RayCasterParallel_t *rp, const RayCaster_t *rc,
+						   RayCasterSurface_t *surface, const RayCasterHit_t *hits)
+{
+	run_frame(rp, rc, surface, hits);
+}
+
+uint32_t RayCasterParallelImbalance(const RayCasterParallel_t *rp)
+{
+	uint64_t total = 0;
+	uint32_t i;
+
+	for (i = 0; i < rp->worker_count; i++)
+	{
+		if ((int)i != rp->reserved)
+			total += rp->workers[i].busy;
+	}
+
+	if (total == 0)
+		return 0;
+
+	// (max - mean) / mean, with the mean kept as total / slots
+	return (uint32_t)(((uint64_t)rp->max_busy * rp->slots - total) * 100 / total);
+}
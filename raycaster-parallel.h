@@ -0,0 +1,92 @@
+#ifndef RAYCASTER_PARALLEL_H_
+#define RAYCASTER_PARALLEL_H_
+
+#include <stdint.h>
+
+#include "jobs.h"
+#include "raycaster.h"
+
+/* Columns are handed out in chunks that are a multiple of this, so two
+   cores never write the same 64 byte cache line of a row */
+#define RAYCASTER_CHUNK_ALIGN   16
+
+/* Widest chunk, and so the size of each worker's scratch */
+#define RAYCASTER_CHUNK_MAX     256
+
+typedef enum
+{
+	// chunk n of RAYCASTER_CHUNK_ALIGN columns always goes to slot
+	// n % workers, fixed before the frame starts
+	RAYCASTER_SPLIT_INTERLEAVED,
+	// workers take the next chunk as they finish one, starting big and
+	// shrinking as the frame runs out so they all finish together
+	RAYCASTER_SPLIT_ADAPTIVE,
+} RayCasterSplit_t;
+
+// free running time source for the per worker timing, any unit
+typedef uint32_t (*RayCasterClock_t)(void);
+
+// What one worker did in the last frame. The scratch holds the hits of the
+// chunk it's drawing, so the workers never share one
+typedef struct
+{
+	uint32_t busy;
+	uint32_t columns;
+	uint32_t chunks;
+	RayCasterHit_t scratch[RAYCASTER_CHUNK_MAX];
+} __attribute__((aligned(64))) RayCasterWorker_t;
+
+struct RayCasterParallel_s;
+
+// the argument of the job run for each slot
+typedef struct
+{
+	struct RayCasterParallel_s *rp;
+	uint32_t slot;
+} RayCasterSlot_t;
+
+typedef struct RayCasterParallel_s
+{
+	RayCasterSplit_t split;
+	RayCasterClock_t clock;
+
+	// a worker that's busy with something else for whole frames, like the
+	// pipeline's cast stage. It gets no slot and isn't counted in the
+	// imbalance. -1 for none
+	int reserved;
+
+	// the frame being rendered, hits is set when its rays have been cast
+	const RayCaster_t *rc;
+	RayCasterSurface_t *surface;
+	const RayCasterHit_t *hits;
+	uint32_t worker_count;
+	uint32_t slots;
+	volatile uint32_t next_column;
+
+	// submitted jobs that haven't finished, the frame ends when it's 0
+	JobCounter_t frame;
+
+	// time the whole frame took and the longest any worker was busy
+	uint32_t frame_time;
+	uint32_t max_busy;
+
+	RayCasterSlot_t slot_args[JOBS_MAX_WORKERS];
+	RayCasterWorker_t workers[JOBS_MAX_WORKERS];
+} RayCasterParallel_t;
+
+void RayCasterParallelInit(RayCasterParallel_t *rp, RayCasterSplit_t split,
+						   RayCasterClock_t clock);
+
+// Render a frame with every job worker, returns once all of it is drawn
+void RayCasterParallelRender(RayCasterParallel_t *rp, const RayCaster_t *rc,
+							 RayCasterSurface_t *surface);
+
+// The same for a frame whose rays have already been cast, hits[x] being
+// column x's. The chunks are only drawn
+void RayCasterParallelDraw(RayCasterParallel_t *rp, const RayCaster_t *rc,
+						   RayCasterSurface_t *surface, const RayCasterHit_t *hits);
+
+// How much longer the busiest worker took than the average, in percent
+uint32_t RayCasterParallelImbalance(const RayCasterParallel_t *rp);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "jobs.h"
+#include "raycaster.h"
+#include "raycaster-pipeline.h"
+
+#define PIPELINE_MASK (RAYCASTER_PIPELINE_DEPTH - 1)
+
+static uint32_t no_clock(void)
+{
+	return 0;
+}
+
+static void cast_frame(RayCasterPipeline_t *pl, RayCasterFrame_t *frame)
+{
+	uint32_t start = pl->clock();
+	uint32_t x;
+
+	for (x = 0; x < pl->width; x++)
+		RayCasterCastColumn(&frame->camera, x, pl->width, &frame->hits[x]);
+
+	frame->cast_time = pl->clock() - start;
+}
+
+// the cast stage, runs on its worker until stopped
+static void cast_stage(void *args)
+{
+	RayCasterPipeline_t *pl = (RayCasterPipeline_t *)args;
+	uint32_t cast = pl->cast;
+
+	// the draw stage leaves this worker out until the stage stops
+	pl->draw.reserved = JobsSelf();
+	__atomic_store_n(&pl->running, true, __ATOMIC_RELEASE);
+
+	while (!__atomic_load_n(&pl->stopping, __ATOMIC_ACQUIRE))
+	{
+		// the camera is in its slot before submitted moves past it
+		if (__atomic_load_n(&pl->submitted, __ATOMIC_ACQUIRE) == cast)
+		{
+			JobsRelax();
+			continue;
+		}
+
+		cast_frame(pl, &pl->frames[cast & PIPELINE_MASK]);
+
+		// and the hits are before cast does
+		__atomic_store_n(&pl->cast, ++cast, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&pl->running, false, __ATOMIC_RELEASE);
+}
+
+void RayCasterPipelineInit(RayCasterPipeline_t *pl, uint32_t width,
+						   RayCasterSplit_t split, RayCasterClock_t clock)
+{
+	memset(pl, 0, sizeof(*pl));
+
+	pl->clock = clock ? clock : no_clock;
+	pl->width = width > RAYCASTER_PIPELINE_MAX_WIDTH ? RAYCASTER_PIPELINE_MAX_WIDTH : width;
+
+	RayCasterParallelInit(&pl->draw, split, clock);
+}
+
+bool RayCasterPipelineStart(RayCasterPipeline_t *pl)
+{
+	if (pl->running || JobsWorkerCount() < 2)
+		return pl->running;
+
+	pl->stopping = false;
+	JobsSubmit(&pl->stage, cast_stage, pl);
+
+	// don't return until another worker has stolen it, a JobsWait on this
+	// one would otherwise pop it and never come back
+	while (!__atomic_load_n(&pl->running, __ATOMIC_ACQUIRE))
+		JobsRelax();
+
+	return true;
+}
+
+void RayCasterPipelineStop(RayCasterPipeline_t *pl)
+{
+	if (!pl->running)
+		return;
+
+	__atomic_store_n(&pl->stopping, true, __ATOMIC_RELEASE);
+	JobsWait(&pl->stage);
+
+	pl->draw.reserved = -1;
+}
+
+void RayCasterPipelineSubmit(RayCasterPipeline_t *pl, const RayCaster_t *rc)
+{
+	uint32_t submitted = pl->submitted;
+	RayCasterFrame_t *frame;
+
+	// the slot is free once the frame that had it has been drawn
+	while (submitted - __atomic_load_n(&pl->drawn, __ATOMIC_ACQUIRE) >= RAYCASTER_PIPELINE_DEPTH)
+		JobsRelax();
+
+	frame = &pl->frames[submitted & PIPELINE_MASK];
+	frame->camera = *rc;
+
+	if (!pl->running)
+	{
+		cast_frame(pl, frame);
+		pl->cast = submitted + 1;
+	}
+
+	__atomic_store_n(&pl->submitted, submitted + 1, __ATOMIC_RELEASE);
+}
+
+void RayCasterPipelineDraw(RayCasterPipeline_t *pl, RayCasterSurface_t *surface)
+{
+	uint32_t drawn = pl->drawn;
+	RayCasterSurface_t clipped = *surface;
+	RayCasterFrame_t *frame;
+	uint32_t start;
+
+	// nothing submitted, nothing to draw
+	if (drawn == pl->submitted)
+		return;
+
+	start = pl->clock();
+
+	while (__atomic_load_n(&pl->cast, __ATOMIC_ACQUIRE) == drawn)
+		JobsRelax();
+
+	pl->times.stall = pl->clock() - start;
+
+	// only the columns there are hits for
+	if (clipped.width > pl->width)
+		clipped.width = pl->width;
+
+	frame = &pl->frames[drawn & PIPELINE_MASK];
+	RayCasterParallelDraw(&pl->draw, &frame->camera, &clipped, frame->hits);
+
+	pl->times.draw = pl->draw.frame_time;
+	pl->times.cast = frame->cast_time;
+
+	// the cast stage can have the slot back
+	__atomic_store_n(&pl->drawn, drawn + 1, __ATOMIC_RELEASE);
+}
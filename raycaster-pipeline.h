@@ -0,0 +1,84 @@
+#ifndef RAYCASTER_PIPELINE_H_
+#define RAYCASTER_PIPELINE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jobs.h"
+#include "raycaster.h"
+#include "raycaster-parallel.h"
+
+/* Frames in flight between the stages, a power of 2. Two lets the rays of
+   frame N+1 be cast while frame N is drawn */
+#define RAYCASTER_PIPELINE_DEPTH        2
+
+/* Widest surface the hit buffers have room for */
+#define RAYCASTER_PIPELINE_MAX_WIDTH    1920
+
+// A frame on its way through the pipeline: the camera it was submitted with
+// and, once cast, a hit per column
+typedef struct
+{
+	RayCaster_t camera;
+	uint32_t cast_time;
+	RayCasterHit_t hits[RAYCASTER_PIPELINE_MAX_WIDTH];
+} __attribute__((aligned(64))) RayCasterFrame_t;
+
+// Times of the last frame drawn, in the clock's units. stall is how long the
+// draw stage waited on the cast stage
+typedef struct
+{
+	uint32_t cast;
+	uint32_t draw;
+	uint32_t stall;
+} RayCasterStageTimes_t;
+
+/* The frames move through three counters that each have a single writer, so
+   the stages hand off without a lock:
+     submitted - by the caller once a frame's camera is in its slot
+     cast      - by the cast stage once the slot's hits are written
+     drawn     - by the caller once the hits have been drawn and the slot
+                 can be reused
+   Each lives on a line of its own as the two cores poll the other's */
+typedef struct
+{
+	RayCasterClock_t clock;
+	uint32_t width;
+
+	volatile uint32_t submitted __attribute__((aligned(64)));
+	volatile uint32_t cast __attribute__((aligned(64)));
+	volatile uint32_t drawn __attribute__((aligned(64)));
+
+	// the cast stage's job, and whether it's running on another worker
+	JobCounter_t stage;
+	volatile bool running;
+	volatile bool stopping;
+
+	// the draw stage's columns are split between the workers that aren't
+	// casting, its imbalance is that of the last frame drawn
+	RayCasterParallel_t draw;
+
+	RayCasterStageTimes_t times;
+	RayCasterFrame_t frames[RAYCASTER_PIPELINE_DEPTH];
+} RayCasterPipeline_t;
+
+// Prepare for frames width columns wide, drawn with split
+void RayCasterPipelineInit(RayCasterPipeline_t *pl, uint32_t width,
+						   RayCasterSplit_t split, RayCasterClock_t clock);
+
+// Give the cast stage a worker of its own. With only the one worker there's
+// no second core to overlap with, the frames are cast as they're submitted
+// instead. Returns true if the stage is running on another worker
+bool RayCasterPipelineStart(RayCasterPipeline_t *pl);
+
+// Wait for the cast stage to return its worker to the job system
+void RayCasterPipelineStop(RayCasterPipeline_t *pl);
+
+// Queue the next frame's camera for casting, waits while every slot is in use
+void RayCasterPipelineSubmit(RayCasterPipeline_t *pl, const RayCaster_t *rc);
+
+// Draw the oldest submitted frame, waiting for its rays if need be. The
+// columns are drawn by whichever workers aren't busy with the cast stage
+void RayCasterPipelineDraw(RayCasterPipeline_t *pl, RayCasterSurface_t *surface);
+
+#endif
@@ -0,0 +1,161 @@
+#include <stdint.h>
+
+#include "raycaster.h"
+#include "raycaster-texture.h"
+
+#if defined(RAYCASTER_NEON)
+	#include <arm_neon.h>
+#endif
+
+#define TEX_MASK (RAYCASTER_TEX_SIZE - 1)
+
+// a y side is half as bright, which is a shift and dropping what fell into
+// the next channel down
+#define SHADE_MASK(shade) ((shade) ? 0x007f7f7fu : 0xffffffffu)
+
+static RayCasterTexture_t demo_textures[RAYCASTER_WALL_COLOURS];
+static int demo_textures_built;
+
+// scale each channel of colour by level / 256
+static uint32_t tint(uint32_t colour, uint32_t level)
+{
+	uint32_t r = ((colour >> 16) & 0xff) * level >> 8;
+	uint32_t g = ((colour >> 8) & 0xff) * level >> 8;
+	uint32_t b = (colour & 0xff) * level >> 8;
+
+	return (r << 16) | (g << 8) | b;
+}
+
+// brightness of texel u, v for each kind of wall
+static uint32_t pattern(uint32_t kind, uint32_t u, uint32_t v)
+{
+	switch (kind & 3)
+	{
+	case 0:
+		// bricks, every other row offset by half a brick
+		if ((v & 15) == 0 || (((u + ((v & 16) ? 8 : 0)) & 15) == 0))
+			return 96;
+		return 224 + ((u ^ v) & 31);
+
+	case 1:
+		// planks with a grain
+		if ((u & 15) == 0)
+			return 80;
+		return 176 + ((v * 3 + u * 5) & 63);
+
+	case 2:
+		return 128 + ((u ^ v) << 1);
+
+	default:
+		// big stone blocks
+		if ((u & 31) == 0 || (v & 31) == 0)
+			return 112;
+		return 208 + ((u * v) & 31);
+	}
+}
+
+const RayCasterTexture_t *RayCasterDemoTextures(void)
+{
+	RayCaster_t rc;
+	uint32_t i, u, v;
+
+	if (demo_textures_built)
+		return demo_textures;
+
+	// the default colours
+	RayCasterInit(&rc, &RayCasterDemoMap);
+
+	for (i = 0; i < RAYCASTER_WALL_COLOURS; i++)
+	{
+		for (u = 0; u < RAYCASTER_TEX_SIZE; u++)
+		{
+			for (v = 0; v < RAYCASTER_TEX_SIZE; v++)
+			{
+				uint32_t level = pattern(i, u, v);
+
+				demo_textures[i][u * RAYCASTER_TEX_SIZE + v] =
+					tint(rc.wall_colour[i], level > 255 ? 255 : level);
+			}
+		}
+	}
+
+	demo_textures_built = 1;
+
+	return demo_textures;
+}
+
+void RayCasterTexelRunScalar(uint32_t *dst, uint32_t stride, const uint32_t *texels,
+							 uint32_t pos, uint32_t step, uint32_t count, uint32_t shade)
+{
+	uint32_t mask = SHADE_MASK(shade);
+
+	while (count--)
+	{
+		*dst = (texels[(pos >> FIXED_SHIFT) & TEX_MASK] >> shade) & mask;
+		dst += stride;
+		pos += step;
+	}
+}
+
+#if defined(RAYCASTER_NEON)
+
+void RayCasterTexelRunNeon(uint32_t *dst, uint32_t stride, const uint32_t *texels,
+						   uint32_t pos, uint32_t step, uint32_t count, uint32_t shade)
+{
+	static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+	uint32x4_t vstep = vdupq_n_u32(step);
+	uint32x4_t pos_lo = vmlaq_u32(vdupq_n_u32(pos), vld1q_u32(lanes), vstep);
+	uint32x4_t pos_hi = vaddq_u32(pos_lo, vshlq_n_u32(vstep, 2));
+	uint32x4_t advance = vshlq_n_u32(vstep, 3);
+	uint32x4_t wrap = vdupq_n_u32(TEX_MASK);
+	uint32x4_t mask = vdupq_n_u32(SHADE_MASK(shade));
+	int32x4_t shift = vdupq_n_s32(-(int32_t)shade);
+	uint32_t run[8];
+
+	for (; count >= 8; count -= 8)
+	{
+		uint32x4_t lo, hi;
+
+		// the next run of 8 texel indices
+		vst1q_u32(run, vandq_u32(vshrq_n_u32(pos_lo, FIXED_SHIFT), wrap));
+		vst1q_u32(run + 4, vandq_u32(vshrq_n_u32(pos_hi, FIXED_SHIFT), wrap));
+		pos_lo = vaddq_u32(pos_lo, advance);
+		pos_hi = vaddq_u32(pos_hi, advance);
+
+		// NEON has no gather, the texels go in a lane at a time
+		lo = vld1q_dup_u32(&texels[run[0]]);
+		lo = vld1q_lane_u32(&texels[run[1]], lo, 1);
+		lo = vld1q_lane_u32(&texels[run[2]], lo, 2);
+		lo = vld1q_lane_u32(&texels[run[3]], lo, 3);
+		hi = vld1q_dup_u32(&texels[run[4]]);
+		hi = vld1q_lane_u32(&texels[run[5]], hi, 1);
+		hi = vld1q_lane_u32(&texels[run[6]], hi, 2);
+		hi = vld1q_lane_u32(&texels[run[7]], hi, 3);
+
+		lo = vandq_u32(vshlq_u32(lo, shift), mask);
+		hi = vandq_u32(vshlq_u32(hi, shift), mask);
+
+		if (stride == 1)
+		{
+			vst1q_u32(dst, lo);
+			vst1q_u32(dst + 4, hi);
+			dst += 8;
+		}
+		else
+		{
+			vst1q_lane_u32(dst, lo, 0); dst += stride;
+			vst1q_lane_u32(dst, lo, 1); dst += stride;
+			vst1q_lane_u32(dst, lo, 2); dst += stride;
+			vst1q_lane_u32(dst, lo, 3); dst += stride;
+			vst1q_lane_u32(dst, hi, 0); dst += stride;
+			vst1q_lane_u32(dst, hi, 1); dst += stride;
+			vst1q_lane_u32(dst, hi, 2); dst += stride;
+			vst1q_lane_u32(dst, hi, 3); dst += stride;
+		}
+	}
+
+	// what's left of the strip
+	RayCasterTexelRunScalar(dst, stride, texels, vgetq_lane_u32(pos_lo, 0), step, count, shade);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef RAYCASTER_TEXTURE_H_
+#define RAYCASTER_TEXTURE_H_
+
+#include <stdint.h>
+
+#include "raycaster.h"
+
+/* The RPi2's toolchain file builds with -mfpu=neon-vfpv4, the ARMv6 parts
+   and the host get the plain C version only */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define RAYCASTER_NEON 1
+#endif
+
+// Wall textures made up from the default wall colours, built on first use
+const RayCasterTexture_t *RayCasterDemoTextures(void);
+
+/* The inner loop of a textured wall strip: count pixels from dst on, each
+   stride words after the last. pos is where in the texture column the first
+   pixel is and step how far each pixel moves down it, both 16.16 texels.
+   shade is 1 to draw at half brightness, for the y facing sides */
+void RayCasterTexelRunScalar(uint32_t *dst, uint32_t stride, const uint32_t *texels,
+							 uint32_t pos, uint32_t step, uint32_t count, uint32_t shade);
+
+#if defined(RAYCASTER_NEON)
+// The same, 8 pixels at a time
+void RayCasterTexelRunNeon(uint32_t *dst, uint32_t stride, const uint32_t *texels,
+						   uint32_t pos, uint32_t step, uint32_t count, uint32_t shade);
+
+	#define RayCasterTexelRun RayCasterTexelRunNeon
+#else
+	#define RayCasterTexelRun RayCasterTexelRunScalar
+#endif
+
+#endif
@@ -0,0 +1,333 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "raycaster.h"
+#include "raycaster-texture.h"
+
+// generated at build time for RAYCASTER_SCREEN_WIDTH, see tools/
+#include "raycaster-lut.h"
+
+#if RAYCASTER_LUT_ANGLES != RAYCASTER_ANGLES
+	#error "raycaster-lut.h was generated for a different RAYCASTER_ANGLES"
+#endif
+
+#define DEMO_MAP_WIDTH 16
+#define DEMO_MAP_HEIGHT 16
+
+static const uint8_t demo_cells[DEMO_MAP_WIDTH * DEMO_MAP_HEIGHT] =
+{
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,
+	1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,
+	1,0,0,2,2,2,0,0,0,0,3,0,3,0,0,1,
+	1,0,0,2,0,2,0,0,0,0,0,0,0,0,0,1,
+	1,0,0,2,0,2,0,0,0,0,3,0,3,0,0,1,
+	1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,
+	1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,
+	1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,
+	1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,
+	1,0,0,4,4,0,0,0,0,0,5,5,5,5,0,1,
+	1,0,0,4,0,0,0,0,0,0,5,0,0,5,0,1,
+	1,0,0,0,0,0,0,0,0,0,5,0,0,5,0,1,
+	1,0,0,0,0,0,0,0,0,0,5,5,0,5,0,1,
+	1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+};
+
+const RayCasterMap_t RayCasterDemoMap =
+{
+	DEMO_MAP_WIDTH,
+	DEMO_MAP_HEIGHT,
+	demo_cells
+};
+
+static const uint32_t default_wall_colour[RAYCASTER_WALL_COLOURS] =
+{
+	0x00ffffff,
+	0x00c04040,
+	0x0040c040,
+	0x004040c0,
+	0x00c0c040,
+	0x00c040c0,
+	0x0040c0c0,
+	0x00808080,
+};
+
+static inline fixed_t fixed_abs(fixed_t v)
+{
+	return v < 0 ? -v : v;
+}
+
+/* 2^32 / v, to within 0.002% and saturated at 0xffffffff. Neither ARM has
+   a 64 bit divide, this is a table lookup, one Newton step and a shift: v
+   is normalised to m in [0.5, 1), the table's seed for 1/m is refined to
+   y(2 - my) and scaled back */
+static inline uint32_t recip(uint32_t v)
+{
+	uint32_t n, m, y, e;
+
+	if (v <= 1)
+		return 0xffffffff;
+
+	n = (uint32_t)__builtin_clz(v);
+	m = v << n;
+
+	y = RayCasterLutRecip[(m >> (31 - RAYCASTER_LUT_RECIP_BITS)) & ((1 << RAYCASTER_LUT_RECIP_BITS) - 1)];
+
+	// 2 - my in Q1.31, my is just below or above 1.0 so this can't wrap
+	e = (uint32_t)(0 - (uint32_t)(((uint64_t)m * y) >> 32));
+	y = (uint32_t)(((uint64_t)y * e) >> 31);
+
+	return y >> (31 - n);
+}
+
+/* 1 / |ray| for the DDA step length, saturated so a ray parallel to an axis
+   never steps along it */
+static inline fixed_t delta_dist(fixed_t ray)
+{
+	uint32_t delta = recip((uint32_t)fixed_abs(ray));
+
+	return delta > FIXED_FAR ? FIXED_FAR : (fixed_t)delta;
+}
+
+void RayCasterInit(RayCaster_t *rc, const RayCasterMap_t *map)
+{
+	int i;
+
+	rc->map = map;
+
+	rc->textures = NULL;
+
+	rc->ceiling_colour = 0x00383838;
+	rc->floor_colour = 0x00707070;
+
+	for (i = 0; i < RAYCASTER_WALL_COLOURS; i++)
+	{
+		rc->wall_colour[i] = default_wall_colour[i];
+	}
+
+	// stand in the middle of the map looking along +x
+	RayCasterSetCamera(rc,
+		INT_TO_FIXED(map->width) / 2 + FIXED_HALF,
+		INT_TO_FIXED(map->height) / 2 + FIXED_HALF,
+		FIXED_ONE, 0, RAYCASTER_LUT_PLANE);
+}
+
+void RayCasterSetCamera(RayCaster_t *rc, fixed_t pos_x, fixed_t pos_y,
+						fixed_t dir_x, fixed_t dir_y, fixed_t plane_scale)
+{
+	rc->pos_x = pos_x;
+	rc->pos_y = pos_y;
+	rc->dir_x = dir_x;
+	rc->dir_y = dir_y;
+
+	// the camera plane is perpendicular to the view direction, its length
+	// sets the field of view
+	rc->plane_x = FixedMul(-dir_y, plane_scale);
+	rc->plane_y = FixedMul(dir_x, plane_scale);
+}
+
+void RayCasterSetHeading(RayCaster_t *rc, uint32_t angle)
+{
+	angle &= RAYCASTER_ANGLES - 1;
+
+	RayCasterSetCamera(rc, rc->pos_x, rc->pos_y,
+		RayCasterLutSin[angle + RAYCASTER_ANGLES / 4], RayCasterLutSin[angle],
+		RAYCASTER_LUT_PLANE);
+}
+
+void RayCasterRotate(RayCaster_t *rc, fixed_t cos_a, fixed_t sin_a)
+{
+	fixed_t x;
+
+	x = rc->dir_x;
+	rc->dir_x = FixedMul(x, cos_a) - FixedMul(rc->dir_y, sin_a);
+	rc->dir_y = FixedMul(x, sin_a) + FixedMul(rc->dir_y, cos_a);
+
+	x = rc->plane_x;
+	rc->plane_x = FixedMul(x, cos_a) - FixedMul(rc->plane_y, sin_a);
+	rc->plane_y = FixedMul(x, sin_a) + FixedMul(rc->plane_y, cos_a);
+}
+
+void RayCasterCastColumn(const RayCaster_t *rc, uint32_t x, uint32_t width,
+						 RayCasterHit_t *hit)
+{
+	const RayCasterMap_t *map = rc->map;
+
+	// camera space x, -1 on the left of the screen to +1 on the right
+	fixed_t camera_x = width == RAYCASTER_LUT_WIDTH ? RayCasterLutCameraX[x] :
+		(fixed_t)(((int64_t)(2 * x) << FIXED_SHIFT) / width) - FIXED_ONE;
+
+	fixed_t ray_x = rc->dir_x + FixedMul(rc->plane_x, camera_x);
+	fixed_t ray_y = rc->dir_y + FixedMul(rc->plane_y, camera_x);
+
+	int32_t map_x = FIXED_TO_INT(rc->pos_x);
+	int32_t map_y = FIXED_TO_INT(rc->pos_y);
+
+	fixed_t delta_x = delta_dist(ray_x);
+	fixed_t delta_y = delta_dist(ray_y);
+
+	fixed_t side_x;
+	fixed_t side_y;
+	fixed_t wall;
+	int32_t step_x;
+	int32_t step_y;
+	uint8_t side = 0;
+	uint8_t cell = 0;
+
+	if (ray_x < 0)
+	{
+		step_x = -1;
+		side_x = FixedMul(rc->pos_x & FIXED_FRAC_MASK, delta_x);
+	}
+	else
+	{
+		step_x = 1;
+		side_x = FixedMul(FIXED_ONE - (rc->pos_x & FIXED_FRAC_MASK), delta_x);
+	}
+
+	if (ray_y < 0)
+	{
+		step_y = -1;
+		side_y = FixedMul(rc->pos_y & FIXED_FRAC_MASK, delta_y);
+	}
+	else
+	{
+		step_y = 1;
+		side_y = FixedMul(FIXED_ONE - (rc->pos_y & FIXED_FRAC_MASK), delta_y);
+	}
+
+	// walk the grid one cell boundary at a time until a wall is found
+	while (1)
+	{
+		if (side_x < side_y)
+		{
+			side_x += delta_x;
+			map_x += step_x;
+			side = 0;
+		}
+		else
+		{
+			side_y += delta_y;
+			map_y += step_y;
+			side = 1;
+		}
+
+		// treat anything off the map as solid, a broken map must not
+		// walk the ray through memory
+		if ((uint32_t)map_x >= map->width || (uint32_t)map_y >= map->height)
+		{
+			cell = 1;
+			break;
+		}
+
+		cell = map->cells[map_y * map->width + map_x];
+
+		if (cell != 0)
+			break;
+	}
+
+	// perpendicular rather than euclidean distance avoids the fisheye effect
+	if (side == 0)
+		hit->distance = side_x - delta_x;
+	else
+		hit->distance = side_y - delta_y;
+
+	if (hit->distance <= 0)
+		hit->distance = 1;
+
+	if (side == 0)
+		wall = rc->pos_y + FixedMul(hit->distance, ray_y);
+	else
+		wall = rc->pos_x + FixedMul(hit->distance, ray_x);
+
+	hit->tex_u = (uint16_t)(wall & FIXED_FRAC_MASK);
+	hit->side = side;
+	hit->cell = cell;
+}
+
+void RayCasterDrawColumn(const RayCaster_t *rc, RayCasterSurface_t *surface,
+						 uint32_t x, const RayCasterHit_t *hit)
+{
+	uint32_t stride = surface->pitch >> 2;
+	uint32_t *p = surface->pixels + x;
+	uint32_t height = surface->height;
+	int64_t line_height;
+	uint32_t start;
+	uint32_t end;
+	uint32_t colour;
+	uint32_t y;
+
+	line_height = ((int64_t)height * recip((uint32_t)hit->distance)) >> FIXED_SHIFT;
+
+	if (line_height >= height)
+	{
+		start = 0;
+		end = height;
+	}
+	else
+	{
+		start = (height - (uint32_t)line_height) >> 1;
+		end = start + (uint32_t)line_height;
+	}
+
+	if (surface->layout == RAYCASTER_COLUMN_MAJOR)
+	{
+		p = surface->pixels + x * stride;
+		stride = 1;
+	}
+
+	colour = rc->wall_colour[hit->cell & (RAYCASTER_WALL_COLOURS - 1)];
+
+	// y sides are drawn darker so corners are visible without lighting
+	if (hit->side)
+		colour = (colour >> 1) & 0x007f7f7f;
+
+	for (y = 0; y < start; y++, p += stride)
+		*p = rc->ceiling_colour;
+
+	if (rc->textures)
+	{
+		const uint32_t *texels = rc->textures[hit->cell & (RAYCASTER_WALL_COLOURS - 1)] +
+			(hit->tex_u >> (FIXED_SHIFT - RAYCASTER_TEX_SHIFT)) * RAYCASTER_TEX_SIZE;
+
+		// a whole wall is RAYCASTER_TEX_SIZE texels high, the texture is
+		// lined up with its top even when that's off the screen
+		uint32_t step = (uint32_t)((((uint64_t)hit->distance << RAYCASTER_TEX_SHIFT) * recip(height)) >> 32);
+		int64_t top = ((int64_t)height - line_height) / 2;
+		uint32_t pos = (uint32_t)((start - top) * step);
+
+		RayCasterTexelRun(p, stride, texels, pos, step, end - start, hit->side);
+		p += (end - start) * stride;
+		y = end;
+	}
+
+	for (; y < end; y++, p += stride)
+		*p = colour;
+
+	for (; y < height; y++, p += stride)
+		*p = rc->floor_colour;
+}
+
+void RayCasterRenderFrame(const RayCaster_t *rc, RayCasterSurface_t *surface)
+{
+	RayCasterHit_t hit;
+	uint32_t x;
+
+	for (x = 0; x < surface->width; x++)
+	{
+		RayCasterCastColumn(rc, x, surface->width, &hit);
+		RayCasterDrawColumn(rc, surface, x, &hit);
+	}
+}
+
+void RayCasterRenderColumns(const RayCaster_t *rc, RayCasterSurface_t *surface,
+							uint32_t first, uint32_t count, RayCasterHit_t *hits)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		RayCasterCastColumn(rc, first + i, surface->width, &hits[i]);
+
+	for (i = 0; i < count; i++)
+		RayCasterDrawColumn(rc, surface, first + i, &hits[i]);
+}
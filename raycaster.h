@@ -0,0 +1,131 @@
+#ifndef RAYCASTER_H_
+#define RAYCASTER_H_
+
+#include <stdint.h>
+
+/* Q16.16 fixed point. Everything in the cast and draw loops uses integer
+   arithmetic only so the same code runs unchanged on the VFPv2 parts, the
+   Cortex-A7 and the host */
+typedef int32_t fixed_t;
+
+#define FIXED_SHIFT         16
+#define FIXED_ONE           ( 1 << FIXED_SHIFT )
+#define FIXED_HALF          ( 1 << ( FIXED_SHIFT - 1 ) )
+#define FIXED_FRAC_MASK     ( FIXED_ONE - 1 )
+
+#define INT_TO_FIXED(x)     ( (fixed_t)( (x) << FIXED_SHIFT ) )
+#define FIXED_TO_INT(x)     ( (int32_t)( (x) >> FIXED_SHIFT ) )
+
+/* Used when a ray runs (almost) parallel to a grid axis. Small enough that a
+   couple of additions can never overflow, large enough that such a side is
+   never picked over a real one inside an enclosed map */
+#define FIXED_FAR           ( INT_TO_FIXED( 0x2000 ) )
+
+#define RAYCASTER_WALL_COLOURS  8
+
+/* Wall textures are square and column major, so the texels of a wall strip
+   are next to each other */
+#define RAYCASTER_TEX_SHIFT     6
+#define RAYCASTER_TEX_SIZE      ( 1 << RAYCASTER_TEX_SHIFT )
+
+typedef uint32_t RayCasterTexture_t[RAYCASTER_TEX_SIZE * RAYCASTER_TEX_SIZE];
+
+/* Angle units in a whole turn, for RayCasterSetHeading */
+#define RAYCASTER_ANGLES        1024
+
+/* A turn of ~3.6 degrees for RayCasterRotate. cos^2 + sin^2 is as close to
+   1.0 as Q16.16 allows so repeated turns don't shrink the camera */
+#define RAYCASTER_TURN_COS      65408
+#define RAYCASTER_TURN_SIN      4094
+
+static inline fixed_t FixedMul(fixed_t a, fixed_t b)
+{
+	return (fixed_t)(((int64_t)a * b) >> FIXED_SHIFT);
+}
+
+static inline fixed_t FixedDiv(fixed_t a, fixed_t b)
+{
+	return (fixed_t)(((int64_t)a << FIXED_SHIFT) / b);
+}
+
+/* A grid map, row major. Cell value 0 is empty, anything else is a wall and
+   selects the wall colour. The outer border must be solid */
+typedef struct
+{
+	uint32_t width;
+	uint32_t height;
+	const uint8_t *cells;
+} RayCasterMap_t;
+
+/* The result of casting a single ray */
+typedef struct
+{
+	fixed_t distance;	// perpendicular distance to the wall
+	uint16_t tex_u;		// where along the wall face the ray hit, 0.16
+	uint8_t side;		// 0: hit an x facing side, 1: hit a y facing side
+	uint8_t cell;		// map cell value of the wall
+} RayCasterHit_t;
+
+typedef enum
+{
+	// rows one after another, the way the framebuffer is scanned out
+	RAYCASTER_ROW_MAJOR,
+	// columns one after another, so a wall strip is drawn to consecutive
+	// words. Has to be transposed into the framebuffer to be seen
+	RAYCASTER_COLUMN_MAJOR,
+} RayCasterLayout_t;
+
+/* A 32bpp render target. pitch is in bytes so a framebuffer with padded rows
+   can be drawn to directly. For a column major surface it's the bytes from
+   one column to the next instead */
+typedef struct
+{
+	uint32_t *pixels;
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;
+	RayCasterLayout_t layout;
+} RayCasterSurface_t;
+
+typedef struct
+{
+	const RayCasterMap_t *map;
+
+	// camera
+	fixed_t pos_x;
+	fixed_t pos_y;
+	fixed_t dir_x;
+	fixed_t dir_y;
+	fixed_t plane_x;
+	fixed_t plane_y;
+
+	uint32_t ceiling_colour;
+	uint32_t floor_colour;
+	uint32_t wall_colour[RAYCASTER_WALL_COLOURS];
+
+	// one per wall colour, walls are drawn flat while it's NULL
+	const RayCasterTexture_t *textures;
+} RayCaster_t;
+
+extern const RayCasterMap_t RayCasterDemoMap;
+
+void RayCasterInit(RayCaster_t *rc, const RayCasterMap_t *map);
+void RayCasterSetCamera(RayCaster_t *rc, fixed_t pos_x, fixed_t pos_y,
+						fixed_t dir_x, fixed_t dir_y, fixed_t plane_scale);
+// Look along angle / RAYCASTER_ANGLES of a turn anticlockwise from +x, with
+// the field of view the lookup tables were built for
+void RayCasterSetHeading(RayCaster_t *rc, uint32_t angle);
+void RayCasterRotate(RayCaster_t *rc, fixed_t cos_a, fixed_t sin_a);
+
+void RayCasterCastColumn(const RayCaster_t *rc, uint32_t x, uint32_t width,
+						 RayCasterHit_t *hit);
+void RayCasterDrawColumn(const RayCaster_t *rc, RayCasterSurface_t *surface,
+						 uint32_t x, const RayCasterHit_t *hit);
+void RayCasterRenderFrame(const RayCaster_t *rc, RayCasterSurface_t *surface);
+
+/* Render count columns from first on. All of their rays are cast into hits,
+   which has room for count, before any of them is drawn */
+void RayCasterRenderColumns(const RayCaster_t *rc, RayCasterSurface_t *surface,
+							uint32_t first, uint32_t count, RayCasterHit_t *hits);
+
+#endif
@@ -1,23 +1,24 @@
 
 #include <stdint.h>
 #include "rpi-armtimer.h"
-
-static rpi_arm_timer_t* rpiArmTimer = (rpi_arm_timer_t*)RPI_ARMTIMER_BASE;
+#include "rpi-hal.h"
 
 rpi_arm_timer_t* RPI_GetArmTimer(void)
 {
-    return rpiArmTimer;
+    return RPI_HAL_BLOCK( rpi_arm_timer_t, RPI_ARMTIMER_BASE );
 }
 
 void RPI_ArmTimerInit(void)
 {
+	rpi_arm_timer_t* rpiArmTimer = RPI_GetArmTimer();
+
 	/* Timer frequency = Clk/256 * 0x400 */
-	rpiArmTimer->Load = 0x800;
+	RPI_REG_WRITE( rpiArmTimer->Load, 0x800 );
 
 	/* Setup the ARM Timer */
-	rpiArmTimer->Control =
+	RPI_REG_WRITE( rpiArmTimer->Control,
 		RPI_ARMTIMER_CTRL_23BIT |
 		RPI_ARMTIMER_CTRL_ENABLE |
 		RPI_ARMTIMER_CTRL_INT_ENABLE |
-		RPI_ARMTIMER_CTRL_PRESCALE_256;
+		RPI_ARMTIMER_CTRL_PRESCALE_256 );
 }
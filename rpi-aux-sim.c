@@ -0,0 +1,214 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rpi-aux.h"
+#include "rpi-aux-sim.h"
+#include "rpi-interrupts.h"
+
+#define SIM_REG( reg )          offsetof( aux_t, reg )
+
+aux_t rpiAuxSimRegisters;
+
+static rpi_aux_sim_t sim;
+
+
+rpi_aux_sim_t* RPI_AuxSimState( void )
+{
+    return &sim;
+}
+
+
+/**
+    @brief Empty the model and restart the clock. One byte is a start bit,
+    8 data bits and a stop bit on the wire
+*/
+void RPI_AuxSimReset( uint32_t baud )
+{
+    memset( (void*)&rpiAuxSimRegisters, 0, sizeof( rpiAuxSimRegisters ) );
+    memset( &sim, 0, sizeof( sim ) );
+
+    sim.byte_ns = (uint32_t)( 10000000000ULL / baud );
+}
+
+
+/* A reset of the whole simulation keeps the baud rate */
+static void sim_reset( void )
+{
+    uint32_t byte_ns = sim.byte_ns;
+
+    memset( (void*)&rpiAuxSimRegisters, 0, sizeof( rpiAuxSimRegisters ) );
+    memset( &sim, 0, sizeof( sim ) );
+
+    sim.byte_ns = byte_ns;
+}
+
+
+/* Retire whatever the transmitter has finished with by now and take in
+   whatever the receiver has */
+static void sim_update( void )
+{
+    uint64_t now = RPI_HalSimTime();
+
+    while( ( sim.tx_level > 0 ) && ( now >= sim.tx_done_ns ) )
+    {
+        sim.tx_level--;
+        sim.tx_bytes++;
+        sim.tx_done_ns += sim.byte_ns;
+    }
+
+    while( ( sim.rx_line_length > 0 ) && ( now >= sim.rx_next_ns ) )
+    {
+        if( sim.rx_level < AUX_MU_FIFO_DEPTH )
+        {
+            sim.rx_fifo[sim.rx_level++] = *sim.rx_line;
+        }
+        else
+        {
+            sim.rx_overrun = true;
+            sim.rx_lost++;
+        }
+
+        sim.rx_line++;
+        sim.rx_line_length--;
+        sim.rx_next_ns += sim.byte_ns;
+    }
+}
+
+
+/**
+    @brief Start data arriving on the receive line at the configured baud
+    rate. The data isn't copied and must stay valid until it has arrived
+*/
+void RPI_AuxSimReceive( const void* data, uint32_t length )
+{
+    sim.rx_line = data;
+    sim.rx_line_length = length;
+    sim.rx_next_ns = RPI_HalSimTime() + sim.byte_ns;
+}
+
+
+static uint32_t sim_read( volatile uint32_t* reg, uint32_t offset )
+{
+    uint32_t value;
+
+    switch( offset )
+    {
+        case SIM_REG( MU_LSR ):
+            value = 0;
+
+            if( sim.tx_level < AUX_MU_FIFO_DEPTH )
+                value |= AUX_MULSR_TX_EMPTY;
+
+            if( sim.tx_level == 0 )
+                value |= AUX_MULSR_TX_IDLE;
+
+            if( sim.rx_level > 0 )
+                value |= AUX_MULSR_DATA_READY;
+
+            if( sim.rx_overrun )
+                value |= AUX_MULSR_RX_OVERRUN;
+
+            sim.rx_overrun = false;
+
+            return value;
+
+        case SIM_REG( MU_IO ):
+            if( sim.rx_level == 0 )
+                return 0;
+
+            value = sim.rx_fifo[0];
+            memmove( sim.rx_fifo, sim.rx_fifo + 1, --sim.rx_level );
+
+            return value;
+
+        case SIM_REG( MU_IIR ):
+            if( ( rpiAuxSimRegisters.MU_IER & AUX_MUIER_RX_INT ) && ( sim.rx_level > 0 ) )
+                return AUX_MUIIR_ID_RX;
+
+            if( RPI_AuxSimIrqPending() )
+                return AUX_MUIIR_ID_TX;
+
+            return AUX_MUIIR_NO_PENDING;
+
+        case SIM_REG( MU_STAT ):
+            return ( sim.tx_level << 24 ) | ( sim.rx_level << 16 ) |
+                   ( sim.rx_level > 0 ? AUX_MUSTAT_SYMBOL_AV : 0 ) |
+                   ( sim.tx_level < AUX_MU_FIFO_DEPTH ? AUX_MUSTAT_SPACE_AV : 0 ) |
+                   ( sim.tx_level == 0 ? AUX_MUSTAT_TX_EMPTY | AUX_MUSTAT_TX_DONE : 0 );
+
+        default:
+            return *reg;
+    }
+}
+
+
+static void sim_write( volatile uint32_t* reg, uint32_t offset, uint32_t value )
+{
+    switch( offset )
+    {
+        case SIM_REG( MU_IO ):
+            /* Like the real FIFO, a write when it's full is lost */
+            if( sim.tx_level >= AUX_MU_FIFO_DEPTH )
+                break;
+
+            if( sim.tx_level++ == 0 )
+                sim.tx_done_ns = RPI_HalSimTime() + sim.byte_ns;
+            break;
+
+        case SIM_REG( MU_IIR ):
+            if( value & AUX_MUIIR_CLEAR_TX_FIFO )
+                sim.tx_level = 0;
+
+            if( value & AUX_MUIIR_CLEAR_RX_FIFO )
+                sim.rx_level = 0;
+            break;
+
+        default:
+            *reg = value;
+            break;
+    }
+}
+
+
+/**
+    @brief The virtual time at which the model next changes state on its own
+*/
+static uint64_t sim_next_event( void )
+{
+    uint64_t next = UINT64_MAX;
+
+    if( sim.tx_level > 0 )
+        next = sim.tx_done_ns;
+
+    if( ( sim.rx_line_length > 0 ) && ( sim.rx_next_ns < next ) )
+        next = sim.rx_next_ns;
+
+    return next;
+}
+
+
+/**
+    @brief The mini UART's TX interrupt is asserted while the transmit FIFO
+    is empty, the RX interrupt while the receive FIFO holds anything
+*/
+bool RPI_AuxSimIrqPending( void )
+{
+    uint32_t ier = rpiAuxSimRegisters.MU_IER;
+
+    return ( ( ier & AUX_MUIER_TX_INT ) && ( sim.tx_level == 0 ) ) ||
+           ( ( ier & AUX_MUIER_RX_INT ) && ( sim.rx_level > 0 ) );
+}
+
+
+static uint32_t sim_irq_lines( void )
+{
+    return RPI_AuxSimIrqPending() ? 1 : 0;
+}
+
+
+const rpi_hal_backend_t rpiAuxSimBackend = {
+    "mini uart", AUX_BASE, (void*)&rpiAuxSimRegisters, sizeof( rpiAuxSimRegisters ),
+    sim_read, sim_write, sim_reset, sim_update, sim_next_event,
+    sim_irq_lines, RPI_IRQ_AUX_INT,
+    };
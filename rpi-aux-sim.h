@@ -0,0 +1,49 @@
+#ifndef RPI_AUX_SIM_H
+#define RPI_AUX_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rpi-aux.h"
+#include "rpi-hal-sim.h"
+
+/** @brief A model of the mini UART for host builds, the backend rpi-hal-sim.c
+    uses for the AUX block. It runs on the HAL's virtual clock and the
+    transmitter shifts a byte out of the FIFO every byte_ns of it */
+typedef struct {
+    uint32_t byte_ns;
+
+    /** Bytes waiting in the TX FIFO and when the oldest finishes sending */
+    uint32_t tx_level;
+    uint64_t tx_done_ns;
+
+    /** Bytes that have gone out on the wire */
+    uint64_t tx_bytes;
+
+    /** The receive FIFO */
+    uint8_t rx_fifo[AUX_MU_FIFO_DEPTH];
+    uint32_t rx_level;
+    bool rx_overrun;
+
+    /** Bytes on their way in over the wire and when the next one lands in
+        the FIFO */
+    const uint8_t* rx_line;
+    uint32_t rx_line_length;
+    uint64_t rx_next_ns;
+
+    /** Bytes lost because the FIFO was full when they arrived */
+    uint64_t rx_lost;
+    } rpi_aux_sim_t;
+
+/* The register block the driver talks to on host builds */
+extern aux_t rpiAuxSimRegisters;
+extern const rpi_hal_backend_t rpiAuxSimBackend;
+
+/* RPI_AuxSimReset empties the model and sets the baud rate, it leaves the
+   HAL's clock alone */
+extern rpi_aux_sim_t* RPI_AuxSimState( void );
+extern void RPI_AuxSimReset( uint32_t baud );
+extern void RPI_AuxSimReceive( const void* data, uint32_t length );
+extern bool RPI_AuxSimIrqPending( void );
+
+#endif
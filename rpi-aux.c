@@ -1,15 +1,45 @@
 
+#include <string.h>
+
 #include "rpi-aux.h"
 #include "rpi-base.h"
 #include "rpi-gpio.h"
+#include "rpi-hal.h"
 #include "rpi-interrupts.h"
 
-static aux_t* auxillary = (aux_t*)AUX_BASE;
+/* On the host the mini UART is the model in rpi-aux-sim.c, which sees every
+   access to keep its FIFOs up to date */
+#define AUX_READ( reg )         RPI_REG_READ( RPI_GetAux()->reg )
+#define AUX_WRITE( reg, value ) RPI_REG_WRITE( RPI_GetAux()->reg, ( value ) )
+
+#define AUX_TX_MASK     ( AUX_TX_BUFFER_SIZE - 1 )
+#define AUX_RX_MASK     ( AUX_RX_BUFFER_SIZE - 1 )
+
+/* Transmit ring. The indices run freely and are masked on use so that
+   head - tail is always the number of bytes queued */
+static char txBuffer[AUX_TX_BUFFER_SIZE];
+static volatile uint32_t txHead = 0;
+static volatile uint32_t txTail = 0;
+
+/* Receive ring. Single producer (the interrupt handler) and single consumer
+   (RPI_AuxMiniUartRead), each only ever writes its own index so no locking
+   is needed */
+static char rxBuffer[AUX_RX_BUFFER_SIZE];
+static volatile uint32_t rxHead = 0;
+static volatile uint32_t rxTail = 0;
+static aux_rx_stats_t rxStats;
+
+static aux_tx_policy_t txPolicy = AUX_TX_BLOCK;
+static aux_tx_stats_t txStats;
+
+/* Shadow of MU_IER so the TX interrupt can be switched without a read */
+static uint32_t auxIER = 0;
+static bool txInterrupt = false;
 
 
 aux_t* RPI_GetAux( void )
 {
-    return auxillary;
+    return RPI_HAL_BLOCK( aux_t, AUX_BASE );
 }
 
 /* Define the system clock frequency in MHz for the baud rate calculation.
@@ -27,82 +57,327 @@ void RPI_AuxMiniUartInit( int baud, int bits, bool interrupt)
 
        If the enable bits are clear you will have no access to a
        peripheral. You can not even read or write the registers */
-    auxillary->ENABLES = AUX_ENA_MINIUART;
+    AUX_WRITE( ENABLES, AUX_ENA_MINIUART );
 
     // disable interrupt services
-    auxillary->MU_IER = 0;
+    auxIER = 0;
+    AUX_WRITE( MU_IER, auxIER );
 
     // clear all control flags
-    auxillary->MU_CNTL = 0;
+    AUX_WRITE( MU_CNTL, 0 );
 
     /* Decide between seven or eight-bit mode */
     if( bits == 8 )
-        auxillary->MU_LCR = AUX_MULCR_8BIT_MODE;
+        AUX_WRITE( MU_LCR, AUX_MULCR_8BIT_MODE );
     else
-        auxillary->MU_LCR = 0;
+        AUX_WRITE( MU_LCR, 0 );
 
-    auxillary->MU_MCR = 0;
+    AUX_WRITE( MU_MCR, 0 );
+
+    /* The TX interrupt is only switched on while there's something queued,
+       the FIFO is empty most of the time and it would fire continuously */
+    txInterrupt = interrupt;
+    txHead = txTail = 0;
+    rxHead = rxTail = 0;
 
-    
     if (interrupt)
     {
         // enable RX interrupt
-        auxillary->MU_IER = 0x5;
+        auxIER = AUX_MUIER_INT_ENABLE | AUX_MUIER_RX_INT;
+        AUX_WRITE( MU_IER, auxIER );
         RPI_EnableIrq(RPI_IRQ_AUX_INT);
     }
-    else
-    {
-        // keep interrupt disabled
-        auxillary->MU_IER = 0;
-    }
 
     // clear FIFO
-    auxillary->MU_IIR = 0xC6;
+    AUX_WRITE( MU_IIR, 0xC6 );
 
     /* Transposed calculation from Section 2.2.1 of the ARM peripherals
        manual */
-    auxillary->MU_BAUD = ( SYS_FREQ / ( 8 * baud ) ) - 1;
+    AUX_WRITE( MU_BAUD, ( SYS_FREQ / ( 8 * baud ) ) - 1 );
 
+#if !defined( RPI_HOST )
      /* Setup GPIO 14 and 15 as alternative function 5 which is
         UART 1 TXD/RXD. These need to be set before enabling the UART */
     RPI_SetGpioPinFunction( RPI_GPIO15, FS_ALT5 );
     RPI_SetGpioPinFunction( RPI_GPIO14, FS_ALT5 );
-    
-    RPI_GetGpio()->GPPUD = 0;
+
+    RPI_REG_WRITE( RPI_GetGpio()->GPPUD, 0 );
     for( i=0; i<150; i++ ) { }
-    RPI_GetGpio()->GPPUDCLK0 = ( 1 << 14 ) | ( 1 << 15 );
+    RPI_REG_WRITE( RPI_GetGpio()->GPPUDCLK0, ( 1 << 14 ) | ( 1 << 15 ) );
     for( i=0; i<150; i++ ) { }
-    RPI_GetGpio()->GPPUDCLK0 = 0;
+    RPI_REG_WRITE( RPI_GetGpio()->GPPUDCLK0, 0 );
+#else
+    (void)i;
+#endif
 
     // enable tx and rx, keep other features disabled
-    auxillary->MU_CNTL = (AUX_MUCNTL_TX_ENABLE | AUX_MUCNTL_RX_ENABLE);
+    AUX_WRITE( MU_CNTL, AUX_MUCNTL_TX_ENABLE | AUX_MUCNTL_RX_ENABLE );
 }
 
 
 void RPI_AuxMiniUartWrite( char c )
 {
     /* Wait until the UART has an empty space in the FIFO */
-    while( ( auxillary->MU_LSR & AUX_MULSR_TX_EMPTY ) == 0 ) { }
+    while( ( AUX_READ( MU_LSR ) & AUX_MULSR_TX_EMPTY ) == 0 ) { }
 
     /* Write the character to the FIFO for transmission */
-    auxillary->MU_IO = c;
+    AUX_WRITE( MU_IO, c );
+}
+
+
+/**
+    @brief Move as much of the transmit ring into the FIFO as it will take.
+    Must be called with IRQs blocked or from the interrupt handler
+*/
+static void aux_tx_fill( void )
+{
+    uint32_t tail = txTail;
+
+    while( ( tail != txHead ) && ( AUX_READ( MU_LSR ) & AUX_MULSR_TX_EMPTY ) )
+    {
+        AUX_WRITE( MU_IO, txBuffer[tail & AUX_TX_MASK] );
+        tail++;
+    }
+
+    txStats.sent += tail - txTail;
+    txTail = tail;
+
+    /* Nothing left to send, stop the TX interrupt until there is */
+    if( txInterrupt )
+    {
+        uint32_t ier = auxIER;
+
+        if( tail == txHead )
+            ier &= ~AUX_MUIER_TX_INT;
+        else
+            ier |= AUX_MUIER_TX_INT;
+
+        if( ier != auxIER )
+        {
+            auxIER = ier;
+            AUX_WRITE( MU_IER, ier );
+        }
+    }
+}
+
+
+void RPI_AuxMiniUartSetTxPolicy( aux_tx_policy_t policy )
+{
+    txPolicy = policy;
+}
+
+
+/**
+    @brief Queue bytes for transmission and return without waiting for the
+    UART, unless the ring is full and the policy is AUX_TX_BLOCK
+
+    @return The number of bytes queued
+*/
+int RPI_AuxMiniUartQueue( const char* data, int len )
+{
+    int done = 0;
+
+    IRQBlock();
+
+    while( done < len )
+    {
+        uint32_t space = AUX_TX_BUFFER_SIZE - ( txHead - txTail );
+        uint32_t offset = txHead & AUX_TX_MASK;
+        uint32_t n;
+
+        if( space == 0 )
+        {
+            if( txPolicy == AUX_TX_DROP )
+            {
+                txStats.dropped += len - done;
+                break;
+            }
+            else if( txPolicy == AUX_TX_OVERWRITE )
+            {
+                /* Make room by giving up the oldest bytes that haven't
+                   reached the FIFO yet */
+                n = len - done;
+                if( n > AUX_TX_BUFFER_SIZE )
+                    n = AUX_TX_BUFFER_SIZE;
+
+                txTail += n;
+                txStats.dropped += n;
+            }
+            else
+            {
+                /* Feed the FIFO ourselves in case the interrupt can't, then
+                   give it a chance to run */
+                aux_tx_fill();
+                IRQUnBlock();
+                IRQBlock();
+            }
+            continue;
+        }
+
+        /* Copy up to the end of the free space or the end of the ring,
+           whichever comes first */
+        n = len - done;
+        if( n > space )
+            n = space;
+        if( n > AUX_TX_BUFFER_SIZE - offset )
+            n = AUX_TX_BUFFER_SIZE - offset;
+
+        memcpy( &txBuffer[offset], &data[done], n );
+        txHead += n;
+        done += n;
+    }
+
+    txStats.queued += done;
+
+    /* Start transmission straight away. Without the TX interrupt nothing else
+       would empty the ring, so behave like the blocking writes */
+    aux_tx_fill();
+
+    if( !txInterrupt )
+    {
+        while( txTail != txHead )
+            aux_tx_fill();
+    }
+
+    IRQUnBlock();
+
+    return done;
 }
 
+
+/**
+    @brief Wait until everything queued has been handed to the UART FIFO
+*/
+void RPI_AuxMiniUartFlush( void )
+{
+    while( txTail != txHead )
+    {
+        IRQBlock();
+        aux_tx_fill();
+        IRQUnBlock();
+    }
+}
+
+
+aux_tx_stats_t* RPI_AuxMiniUartTxStats( void )
+{
+    return &txStats;
+}
+
+
+/**
+    @brief Move everything in the receive FIFO into the receive ring. Only
+    called from the interrupt handler, the one producer
+*/
+static void aux_rx_drain( void )
+{
+    uint32_t head = rxHead;
+    uint32_t lsr;
+
+    while( 1 )
+    {
+        lsr = AUX_READ( MU_LSR );
+
+        /* The overrun bit clears on read */
+        if( lsr & AUX_MULSR_RX_OVERRUN )
+            rxStats.fifo_overruns++;
+
+        if( ( lsr & AUX_MULSR_DATA_READY ) == 0 )
+            break;
+
+        if( head - rxTail < AUX_RX_BUFFER_SIZE )
+        {
+            rxBuffer[head & AUX_RX_MASK] = AUX_READ( MU_IO );
+            head++;
+        }
+        else
+        {
+            /* Still read it, or the interrupt stays asserted */
+            (void)AUX_READ( MU_IO );
+            rxStats.ring_overruns++;
+        }
+    }
+
+    if( head != rxHead )
+    {
+        rxStats.interrupts++;
+        rxStats.received += head - rxHead;
+    }
+
+    /* Publish the bytes only once they're in the ring */
+    RPI_DMB();
+    rxHead = head;
+}
+
+
+/**
+    @brief Copy up to len received bytes out of the receive ring, never waits
+
+    @return The number of bytes copied
+*/
+int RPI_AuxMiniUartRead( char* data, int len )
+{
+    uint32_t tail = rxTail;
+    uint32_t available = rxHead - tail;
+    uint32_t n, first;
+
+    /* Don't read the data before the head that published it */
+    RPI_DMB();
+
+    n = (uint32_t)len < available ? (uint32_t)len : available;
+    first = AUX_RX_BUFFER_SIZE - ( tail & AUX_RX_MASK );
+    if( first > n )
+        first = n;
+
+    memcpy( data, &rxBuffer[tail & AUX_RX_MASK], first );
+    memcpy( data + first, rxBuffer, n - first );
+
+    /* Finish reading before handing the space back */
+    RPI_DMB();
+    rxTail = tail + n;
+
+    return n;
+}
+
+
+aux_rx_stats_t* RPI_AuxMiniUartRxStats( void )
+{
+    return &rxStats;
+}
+
+
+/**
+    @brief The mini UART interrupt handler, register it for RPI_IRQ_AUX_INT.
+    Empties the whole receive FIFO and tops up the transmit FIFO
+*/
+void RPI_AuxMiniUartIRQHandler( uint32_t irq, void* args )
+{
+    if( auxIER & AUX_MUIER_RX_INT )
+        aux_rx_drain();
+
+    if( auxIER & AUX_MUIER_TX_INT )
+    {
+        txStats.interrupts++;
+        aux_tx_fill();
+    }
+}
+
+
 bool RPI_AuxMiniUartNonBlockRead(char *c)
 {
     // read data from FIFO, don't care if there is data in fifo
-    *c = auxillary->MU_IO;
+    *c = AUX_READ( MU_IO );
 
     // return whether the data is valid
-    return auxillary->MU_LSR & AUX_MULSR_DATA_READY;
+    return AUX_READ( MU_LSR ) & AUX_MULSR_DATA_READY;
 }
 
 void RPI_AuxMiniUartBlockRead(char *c)
 {
     while (1)
     {
-        if (auxillary->MU_LSR & AUX_MULSR_DATA_READY) break;
+        if (AUX_READ( MU_LSR ) & AUX_MULSR_DATA_READY) break;
     }
 
-    *c = auxillary->MU_IO & 0xff;
-}
\ No newline at end of file
+    *c = AUX_READ( MU_IO ) & 0xff;
+}
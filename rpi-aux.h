@@ -50,6 +50,19 @@
 #define AUX_IRQ_SPI1                ( 1 << 1 )
 #define AUX_IRQ_MU                  ( 1 << 0 )
 
+#define AUX_MUIER_RX_INT            ( 1 << 0 )  /* See errata, swapped in the datasheet */
+#define AUX_MUIER_TX_INT            ( 1 << 1 )
+#define AUX_MUIER_INT_ENABLE        ( 3 << 2 )  /* Required for either interrupt */
+
+#define AUX_MUIIR_NO_PENDING        ( 1 << 0 )
+#define AUX_MUIIR_ID_TX             ( 1 << 1 )
+#define AUX_MUIIR_ID_RX             ( 2 << 1 )
+#define AUX_MUIIR_ID_MASK           ( 3 << 1 )
+#define AUX_MUIIR_CLEAR_RX_FIFO     ( 1 << 1 )  /* On write */
+#define AUX_MUIIR_CLEAR_TX_FIFO     ( 1 << 2 )  /* On write */
+
+#define AUX_MU_FIFO_DEPTH           8
+
 #define AUX_MULCR_8BIT_MODE         ( 3 << 0 )  /* See errata for this value */
 #define AUX_MULCR_BREAK             ( 1 << 6 )
 #define AUX_MULCR_DLAB_ACCESS       ( 1 << 7 )
@@ -181,9 +194,60 @@ typedef struct {
     volatile unsigned int SPI1_PEEK;
     } aux_t;
 
+/* Size of the transmit ring behind RPI_AuxMiniUartQueue, must be a power
+   of two */
+#ifndef AUX_TX_BUFFER_SIZE
+#define AUX_TX_BUFFER_SIZE          1024
+#endif
+
+/* Size of the receive ring filled by the interrupt handler, must be a power
+   of two */
+#ifndef AUX_RX_BUFFER_SIZE
+#define AUX_RX_BUFFER_SIZE          256
+#endif
+
+/** @brief What RPI_AuxMiniUartQueue does when the transmit ring is full */
+typedef enum {
+    /** Wait for space, output is never lost (default) */
+    AUX_TX_BLOCK = 0,
+
+    /** Discard the bytes that don't fit */
+    AUX_TX_DROP,
+
+    /** Discard the oldest queued bytes to make room */
+    AUX_TX_OVERWRITE,
+    } aux_tx_policy_t;
+
+typedef struct {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t interrupts;
+    } aux_tx_stats_t;
+
+typedef struct {
+    uint32_t received;
+
+    /** Bytes lost because the receive ring was full, the consumer isn't
+        keeping up */
+    uint32_t ring_overruns;
+
+    /** Times the hardware FIFO overflowed before the interrupt got to it */
+    uint32_t fifo_overruns;
+
+    uint32_t interrupts;
+    } aux_rx_stats_t;
+
 extern aux_t* RPI_GetAux( void );
 extern void RPI_AuxMiniUartInit( int baud, int bits, bool interrupt );
 extern void RPI_AuxMiniUartWrite( char c );
+extern void RPI_AuxMiniUartSetTxPolicy( aux_tx_policy_t policy );
+extern int RPI_AuxMiniUartQueue( const char* data, int len );
+extern void RPI_AuxMiniUartFlush( void );
+extern aux_tx_stats_t* RPI_AuxMiniUartTxStats( void );
+extern int RPI_AuxMiniUartRead( char* data, int len );
+extern aux_rx_stats_t* RPI_AuxMiniUartRxStats( void );
+extern void RPI_AuxMiniUartIRQHandler( uint32_t irq, void* args );
 extern bool RPI_AuxMiniUartNonBlockRead(char *c);
 extern void RPI_AuxMiniUartBlockRead(char *c);
 
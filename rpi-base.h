@@ -39,6 +39,31 @@
     #define PERIPHERAL_BASE     0x20000000UL
 #endif
 
+/* Data memory barrier. Orders the data a lock-free producer writes before the
+   index that publishes it, whether the other side is an interrupt handler or
+   another core */
+#if defined( RPI_HOST )
+    #define RPI_DMB()       __sync_synchronize()
+#elif defined( RPI2 )
+    #define RPI_DMB()       __asm volatile( "dmb" : : : "memory" )
+#else
+    #define RPI_DMB()       __asm volatile( "mcr p15, 0, %0, c7, c10, 5" : : "r" (0) : "memory" )
+#endif
+
+/* Data synchronisation and instruction barriers, for cache and translation
+   table maintenance. The DSB waits for everything before it to complete,
+   the ISB makes the instructions after it see the result */
+#if defined( RPI_HOST )
+    #define RPI_DSB()       __sync_synchronize()
+    #define RPI_ISB()       __sync_synchronize()
+#elif defined( RPI2 )
+    #define RPI_DSB()       __asm volatile( "dsb" : : : "memory" )
+    #define RPI_ISB()       __asm volatile( "isb" : : : "memory" )
+#else
+    #define RPI_DSB()       __asm volatile( "mcr p15, 0, %0, c7, c10, 4" : : "r" (0) : "memory" )
+    #define RPI_ISB()       __asm volatile( "mcr p15, 0, %0, c7, c5, 4" : : "r" (0) : "memory" )
+#endif
+
 typedef volatile uint32_t rpi_reg_rw_t;
 typedef volatile const uint32_t rpi_reg_ro_t;
 typedef volatile uint32_t rpi_reg_wo_t;
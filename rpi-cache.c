@@ -0,0 +1,97 @@
+/* Data cache maintenance by MVA. The ARM1176 and the Cortex-A7 encode the
+   line operations the same way, to the point of coherency on the A7, so
+   only the barrier after them differs and that is in rpi-base.h */
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+#include "rpi-cache.h"
+
+#define CACHE_LINE_MASK     ( (uintptr_t)RPI_CACHE_LINE - 1 )
+
+#if defined( RPI_HOST )
+
+void RPI_CacheCleanRange( const void* start, uint32_t size ) { }
+void RPI_CacheInvalidateRange( void* start, uint32_t size ) { }
+void RPI_CacheFlushRange( void* start, uint32_t size ) { }
+
+#else
+
+#define CACHE_CLEAN_LINE( mva )         __asm volatile( "mcr p15, 0, %0, c7, c10, 1" : : "r" (mva) : "memory" )
+#define CACHE_INVALIDATE_LINE( mva )    __asm volatile( "mcr p15, 0, %0, c7, c6, 1" : : "r" (mva) : "memory" )
+#define CACHE_FLUSH_LINE( mva )         __asm volatile( "mcr p15, 0, %0, c7, c14, 1" : : "r" (mva) : "memory" )
+
+/**
+    @brief Write any dirty lines in the range back to memory, they stay in
+    the cache
+*/
+void RPI_CacheCleanRange( const void* start, uint32_t size )
+{
+    uintptr_t mva = (uintptr_t)start & ~CACHE_LINE_MASK;
+    uintptr_t end = (uintptr_t)start + size;
+
+    if( size == 0 )
+        return;
+
+    /* Stores to the range have to reach the cache first */
+    RPI_DSB();
+
+    for( ; mva < end; mva += RPI_CACHE_LINE )
+        CACHE_CLEAN_LINE( mva );
+
+    RPI_DSB();
+}
+
+
+/**
+    @brief Throw away whatever the cache holds for the range so the next
+    read goes to memory
+*/
+void RPI_CacheInvalidateRange( void* start, uint32_t size )
+{
+    uintptr_t mva = (uintptr_t)start;
+    uintptr_t end = (uintptr_t)start + size;
+
+    if( size == 0 )
+        return;
+
+    if( mva & CACHE_LINE_MASK )
+    {
+        mva &= ~CACHE_LINE_MASK;
+        CACHE_FLUSH_LINE( mva );
+        mva += RPI_CACHE_LINE;
+    }
+
+    if( ( end & CACHE_LINE_MASK ) && ( end > mva ) )
+    {
+        end &= ~CACHE_LINE_MASK;
+        CACHE_FLUSH_LINE( end );
+    }
+
+    for( ; mva < end; mva += RPI_CACHE_LINE )
+        CACHE_INVALIDATE_LINE( mva );
+
+    RPI_DSB();
+}
+
+
+/**
+    @brief Write dirty lines in the range back and drop them from the cache
+*/
+void RPI_CacheFlushRange( void* start, uint32_t size )
+{
+    uintptr_t mva = (uintptr_t)start & ~CACHE_LINE_MASK;
+    uintptr_t end = (uintptr_t)start + size;
+
+    if( size == 0 )
+        return;
+
+    RPI_DSB();
+
+    for( ; mva < end; mva += RPI_CACHE_LINE )
+        CACHE_FLUSH_LINE( mva );
+
+    RPI_DSB();
+}
+
+#endif
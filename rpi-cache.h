@@ -0,0 +1,27 @@
+#ifndef RPI_CACHE_H
+#define RPI_CACHE_H
+
+#include <stdint.h>
+
+/** @brief Data cache line size. Buffers shared with the VideoCore start on a
+    line and are a whole number of lines long, so maintaining them never
+    touches anything else */
+#if defined( RPI2 )
+    #define RPI_CACHE_LINE      64
+#else
+    #define RPI_CACHE_LINE      32
+#endif
+
+#define RPI_CACHE_ALIGNED       __attribute__(( aligned( RPI_CACHE_LINE ) ))
+
+/* Data cache maintenance by address, out to the point where the VideoCore
+   sees the same memory. Clean before the VideoCore reads something the ARM
+   wrote, invalidate before the ARM reads something the VideoCore wrote and
+   flush (clean then invalidate) for both. Partial lines at either end of an
+   invalidated range are flushed instead so the bytes next to it survive.
+   They're no-ops on host builds */
+extern void RPI_CacheCleanRange( const void* start, uint32_t size );
+extern void RPI_CacheInvalidateRange( void* start, uint32_t size );
+extern void RPI_CacheFlushRange( void* start, uint32_t size );
+
+#endif
@@ -0,0 +1,173 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rpi-cache.h"
+#include "rpi-framebuffer.h"
+#include "rpi-mailbox.h"
+#include "rpi-mailbox-interface.h"
+
+static rpi_framebuffer_t rpiFramebuffer;
+
+/* The last flip handed to the VideoCore, if it may not have been answered */
+static rpi_property_transaction_t* flip = NULL;
+
+rpi_framebuffer_t* RPI_GetFramebuffer( void )
+{
+    return &rpiFramebuffer;
+}
+
+/**
+    @brief Wait for the last flip to be answered. It asks for the vsync
+    after the new offset, so once it's answered the new page has been
+    latched and the page it took off screen is no longer being scanned out
+*/
+static void flip_wait( void )
+{
+    if( flip == NULL )
+        return;
+
+    while( !RPI_PropertyPoll( flip ) ) { }
+
+    RPI_PropertyRelease( flip );
+    flip = NULL;
+}
+
+/**
+    @brief Allocate a multi page framebuffer from the VideoCore
+
+    @return 0 on success, -1 if the VideoCore didn't give us a framebuffer
+*/
+int RPI_FramebufferInit( uint32_t width, uint32_t height, uint32_t depth )
+{
+    const rpi_mailbox_property_t* mp;
+    rpi_property_transaction_t* t;
+
+    /* A flip of the old surface can't be answered after the new one */
+    flip_wait();
+
+    rpiFramebuffer.buffer = NULL;
+
+    /* Everything has to be set in one go, the allocation uses the sizes in
+       the same tag list */
+    t = RPI_PropertyInit();
+    RPI_PropertyAdd_SET_PHYSICAL_SIZE( t, width, height );
+    RPI_PropertyAdd_SET_VIRTUAL_SIZE( t, width, height * RPI_FRAMEBUFFER_PAGES );
+    RPI_PropertyAdd_SET_DEPTH( t, depth );
+    RPI_PropertyAdd_SET_VIRTUAL_OFFSET( t, 0, 0 );
+    RPI_PropertyAdd_ALLOCATE_BUFFER( t, 16 );
+    RPI_PropertyAdd_GET_PITCH( t );
+    RPI_PropertyProcess();
+
+    mp = RPI_PropertyGet( TAG_SET_PHYSICAL_SIZE );
+    if( mp == NULL )
+        return -1;
+
+    rpiFramebuffer.width = mp->data.buffer_32[0];
+    rpiFramebuffer.height = mp->data.buffer_32[1];
+
+    /* The firmware can silently clamp the virtual size, in which case there's
+       only room for fewer pages */
+    mp = RPI_PropertyGet( TAG_SET_VIRTUAL_SIZE );
+    rpiFramebuffer.pages = 1;
+
+    if( ( mp != NULL ) && ( rpiFramebuffer.height != 0 ) )
+    {
+        rpiFramebuffer.pages = (uint32_t)mp->data.buffer_32[1] / rpiFramebuffer.height;
+
+        if( rpiFramebuffer.pages > RPI_FRAMEBUFFER_PAGES )
+            rpiFramebuffer.pages = RPI_FRAMEBUFFER_PAGES;
+        else if( rpiFramebuffer.pages < 1 )
+            rpiFramebuffer.pages = 1;
+    }
+
+    mp = RPI_PropertyGet( TAG_SET_DEPTH );
+    rpiFramebuffer.depth = mp ? mp->data.buffer_32[0] : depth;
+
+    mp = RPI_PropertyGet( TAG_GET_PITCH );
+    rpiFramebuffer.pitch = mp ? mp->data.buffer_32[0] :
+                                rpiFramebuffer.width * ( rpiFramebuffer.depth >> 3 );
+
+    mp = RPI_PropertyGet( TAG_ALLOCATE_BUFFER );
+    if( ( mp == NULL ) || ( mp->data.buffer_32[0] == 0 ) )
+        return -1;
+
+    rpiFramebuffer.buffer = RPI_MailboxFromBus( mp->data.buffer_32[0] );
+    rpiFramebuffer.size = mp->data.buffer_32[1];
+    rpiFramebuffer.front = 0;
+
+    return 0;
+}
+
+/**
+    @brief Return the page to draw the next frame into
+
+    It's never one still on screen: if the last flip hasn't been answered
+    and the page is the one that flip is taking off screen, this waits for
+    its vsync
+*/
+void* RPI_FramebufferGetBackBuffer( void )
+{
+    uint32_t pages = rpiFramebuffer.pages;
+    uint32_t back = ( rpiFramebuffer.front + 1 ) % pages;
+
+    if( ( flip != NULL ) && ( back == ( rpiFramebuffer.front + pages - 1 ) % pages ) )
+        flip_wait();
+
+    return rpiFramebuffer.buffer + ( back * rpiFramebuffer.height * rpiFramebuffer.pitch );
+}
+
+/**
+    @brief Put the back buffer on screen
+
+    Only the virtual offset changes and the firmware latches it at the
+    next vblank, but it answers SET_VIRTUAL_OFFSET straight away while the
+    old page is still being scanned out. The flip asks for the vsync as
+    well so its answer only comes once the old page is off screen, and as
+    a flip waits for the one before it there's at most one per refresh.
+    With a third page the request isn't waited for, the next frame is
+    drawn into the page that wasn't on screen either way. With two the
+    page coming off screen is the next one drawn into, so it's waited for
+    here
+*/
+void RPI_FramebufferFlip( void )
+{
+    rpi_property_transaction_t* t;
+
+    /* The page is scanned out of memory, whatever is still in the cache
+       goes out first */
+    RPI_CacheCleanRange( RPI_FramebufferGetBackBuffer(),
+                         rpiFramebuffer.height * rpiFramebuffer.pitch );
+
+    if( rpiFramebuffer.pages < 2 )
+        return;
+
+    /* One flip in flight at a time so they reach the VideoCore in order */
+    flip_wait();
+
+    rpiFramebuffer.front = ( rpiFramebuffer.front + 1 ) % rpiFramebuffer.pages;
+
+    flip = RPI_PropertyBegin();
+
+    if( flip != NULL )
+    {
+        RPI_PropertyAdd_SET_VIRTUAL_OFFSET( flip, 0, rpiFramebuffer.front * rpiFramebuffer.height );
+        RPI_PropertyAdd_SET_VSYNC( flip, 0 );
+
+        if( RPI_PropertySubmit( flip, NULL, NULL ) )
+        {
+            if( rpiFramebuffer.pages < 3 )
+                flip_wait();
+
+            return;
+        }
+
+        RPI_PropertyRelease( flip );
+        flip = NULL;
+    }
+
+    /* Every buffer busy or the mailbox full, wait our turn instead */
+    t = RPI_PropertyInit();
+    RPI_PropertyAdd_SET_VIRTUAL_OFFSET( t, 0, rpiFramebuffer.front * rpiFramebuffer.height );
+    RPI_PropertyAdd_SET_VSYNC( t, 0 );
+    RPI_PropertyProcess();
+}
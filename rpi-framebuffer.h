@@ -0,0 +1,39 @@
+#ifndef RPI_FRAMEBUFFER_H
+#define RPI_FRAMEBUFFER_H
+
+#include <stdint.h>
+
+/** @brief Pages asked for. With three the page just taken off screen isn't
+    needed straight away, so a flip doesn't have to wait for the vsync */
+#define RPI_FRAMEBUFFER_PAGES   3
+
+/** @brief A page flipped framebuffer. The VideoCore is asked for a virtual
+    surface RPI_FRAMEBUFFER_PAGES times the height of the screen; a page not
+    on screen is drawn to and the pages are cycled by moving the virtual
+    offset, so presenting a frame never copies it */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+
+    /** Bytes per row, may be larger than width * depth / 8 */
+    uint32_t pitch;
+
+    /** Start of the virtual surface and its size in bytes */
+    uint8_t* buffer;
+    uint32_t size;
+
+    /** Number of pages, fewer than asked for if the firmware clamped the
+        virtual height */
+    uint32_t pages;
+
+    /** The page currently being scanned out */
+    uint32_t front;
+    } rpi_framebuffer_t;
+
+extern rpi_framebuffer_t* RPI_GetFramebuffer( void );
+extern int RPI_FramebufferInit( uint32_t width, uint32_t height, uint32_t depth );
+extern void* RPI_FramebufferGetBackBuffer( void );
+extern void RPI_FramebufferFlip( void );
+
+#endif
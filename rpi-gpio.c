@@ -1,23 +1,22 @@
 
 #include <stdint.h>
 #include "rpi-gpio.h"
-
-static rpi_gpio_t* rpiGpio = (rpi_gpio_t*)RPI_GPIO_BASE;
+#include "rpi-hal.h"
 
 
 rpi_gpio_t* RPI_GetGpio(void)
 {
-    return rpiGpio;
+    return RPI_HAL_BLOCK( rpi_gpio_t, RPI_GPIO_BASE );
 }
 
 
 void RPI_SetGpioPinFunction( rpi_gpio_pin_t gpio, rpi_gpio_alt_function_t func )
 {
-    rpi_reg_rw_t* fsel_reg = &((rpi_reg_rw_t*)rpiGpio)[ gpio / 10 ];
-    rpi_reg_rw_t fsel_copy = *fsel_reg;
+    rpi_reg_rw_t* fsel_reg = &((rpi_reg_rw_t*)RPI_GetGpio())[ gpio / 10 ];
+    uint32_t fsel_copy = RPI_REG_READ( *fsel_reg );
     fsel_copy &= ~( FS_MASK << ( ( gpio % 10 ) * 3 ) );
     fsel_copy |= (func << ( ( gpio % 10 ) * 3 ) );
-    *fsel_reg = fsel_copy;
+    RPI_REG_WRITE( *fsel_reg, fsel_copy );
 }
 
 
@@ -40,11 +39,11 @@ rpi_gpio_value_t RPI_GetGpioValue( rpi_gpio_pin_t gpio )
     switch( gpio / 32 )
     {
         case 0:
-            result = rpiGpio->GPLEV0 & ( 1 << gpio );
+            result = RPI_REG_READ( RPI_GetGpio()->GPLEV0 ) & ( 1 << gpio );
             break;
 
         case 1:
-            result = rpiGpio->GPLEV1 & ( 1 << ( gpio - 32 ) );
+            result = RPI_REG_READ( RPI_GetGpio()->GPLEV1 ) & ( 1 << ( gpio - 32 ) );
             break;
 
         default:
@@ -75,11 +74,11 @@ void RPI_SetGpioHi( rpi_gpio_pin_t gpio )
     switch( gpio / 32 )
     {
         case 0:
-            rpiGpio->GPSET0 = ( 1 << gpio );
+            RPI_REG_WRITE( RPI_GetGpio()->GPSET0, 1 << gpio );
             break;
 
         case 1:
-            rpiGpio->GPSET1 = ( 1 << ( gpio - 32 ) );
+            RPI_REG_WRITE( RPI_GetGpio()->GPSET1, 1 << ( gpio - 32 ) );
             break;
 
         default:
@@ -93,11 +92,11 @@ void RPI_SetGpioLo( rpi_gpio_pin_t gpio )
     switch( gpio / 32 )
     {
         case 0:
-            rpiGpio->GPCLR0 = ( 1 << gpio );
+            RPI_REG_WRITE( RPI_GetGpio()->GPCLR0, 1 << gpio );
             break;
 
         case 1:
-            rpiGpio->GPCLR1 = ( 1 << ( gpio - 32 ) );
+            RPI_REG_WRITE( RPI_GetGpio()->GPCLR1, 1 << ( gpio - 32 ) );
             break;
 
         default:
@@ -32,6 +32,7 @@
 #define RPI_GPIO_H
 
 #include "rpi-base.h"
+#include "rpi-hal.h"
 
 /** The base address of the GPIO peripheral (ARM Physical Address) */
 #define RPI_GPIO_BASE       ( PERIPHERAL_BASE + 0x200000UL )
@@ -42,16 +43,16 @@
     #define LED_GPSET       GPSET1
     #define LED_GPCLR       GPCLR1
     #define LED_GPIO_BIT    15
-    #define LED_ON()        do { RPI_GetGpio()->LED_GPCLR = ( 1 << LED_GPIO_BIT ); } while( 0 )
-    #define LED_OFF()       do { RPI_GetGpio()->LED_GPSET = ( 1 << LED_GPIO_BIT ); } while( 0 )
+    #define LED_ON()        do { RPI_REG_WRITE( RPI_GetGpio()->LED_GPCLR, 1 << LED_GPIO_BIT ); } while( 0 )
+    #define LED_OFF()       do { RPI_REG_WRITE( RPI_GetGpio()->LED_GPSET, 1 << LED_GPIO_BIT ); } while( 0 )
 #else
     #define LED_GPFSEL      GPFSEL1
     #define LED_GPFBIT      18
     #define LED_GPSET       GPSET0
     #define LED_GPCLR       GPCLR0
     #define LED_GPIO_BIT    16
-    #define LED_ON()        do { RPI_GetGpio()->LED_GPSET = ( 1 << LED_GPIO_BIT ); } while( 0 )
-    #define LED_OFF()       do { RPI_GetGpio()->LED_GPCLR = ( 1 << LED_GPIO_BIT ); } while( 0 )
+    #define LED_ON()        do { RPI_REG_WRITE( RPI_GetGpio()->LED_GPSET, 1 << LED_GPIO_BIT ); } while( 0 )
+    #define LED_OFF()       do { RPI_REG_WRITE( RPI_GetGpio()->LED_GPCLR, 1 << LED_GPIO_BIT ); } while( 0 )
 #endif
 
 typedef enum {
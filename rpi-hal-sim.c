@@ -0,0 +1,714 @@
+/* The host build's side of rpi-hal.h. Every register block a driver maps
+   is looked up here by its address on the Pi, and every access a driver
+   makes is passed to the backend that owns the block after charging the
+   virtual clock for it. The models below cover the system timer, the ARM
+   timer, the interrupt controller and the GPIO; the mini UART model lives
+   in rpi-aux-sim.c */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rpi-armtimer.h"
+#include "rpi-aux-sim.h"
+#include "rpi-gpio.h"
+#include "rpi-hal-sim.h"
+#include "rpi-interrupts.h"
+#include "rpi-systimer.h"
+
+/* A peripheral access over the AXI/APB bridge costs roughly this much on a
+   BCM2835 */
+#define SIM_DEFAULT_ACCESS_NS   40
+
+/* The ARM timer runs from the 250MHz APB clock */
+#define SIM_APB_NS              4
+
+#define SIM_REG( type, reg )    offsetof( type, reg )
+
+static rpi_hal_backend_t backends[RPI_HAL_SIM_BACKENDS];
+static int backendCount = 0;
+static rpi_hal_backend_t* lastBackend = NULL;
+static bool started = false;
+
+static rpi_hal_sim_t hal = { 0, SIM_DEFAULT_ACCESS_NS, 0, 0 };
+
+
+/* System timer. A free running microsecond counter with four compare
+   registers, a match sets the channel's bit in control_status until it's
+   written back */
+
+static rpi_sys_timer_t sysTimerRegs;
+static uint64_t sysTimerLastUs;
+
+static void systimer_update( void )
+{
+    uint64_t now = hal.time_ns / 1000;
+    uint32_t elapsed = (uint32_t)( now - sysTimerLastUs );
+    int i;
+
+    if( elapsed == 0 )
+        return;
+
+    /* A compare value matches when the counter passes through it */
+    for( i = 0; i < 4; i++ )
+    {
+        uint32_t compare = ( &sysTimerRegs.compare0 )[i];
+
+        if( (uint32_t)( compare - (uint32_t)sysTimerLastUs - 1 ) < elapsed )
+            sysTimerRegs.control_status |= 1 << i;
+    }
+
+    sysTimerLastUs = now;
+}
+
+static uint32_t systimer_read( volatile uint32_t* reg, uint32_t offset )
+{
+    switch( offset )
+    {
+        case SIM_REG( rpi_sys_timer_t, counter_lo ):
+            return (uint32_t)sysTimerLastUs;
+
+        case SIM_REG( rpi_sys_timer_t, counter_hi ):
+            return (uint32_t)( sysTimerLastUs >> 32 );
+
+        default:
+            return *reg;
+    }
+}
+
+static void systimer_write( volatile uint32_t* reg, uint32_t offset, uint32_t value )
+{
+    switch( offset )
+    {
+        case SIM_REG( rpi_sys_timer_t, control_status ):
+            sysTimerRegs.control_status &= ~value;
+            break;
+
+        case SIM_REG( rpi_sys_timer_t, counter_lo ):
+        case SIM_REG( rpi_sys_timer_t, counter_hi ):
+            break;
+
+        default:
+            *reg = value;
+            break;
+    }
+}
+
+static void systimer_reset( void )
+{
+    memset( (void*)&sysTimerRegs, 0, sizeof( sysTimerRegs ) );
+    sysTimerLastUs = 0;
+}
+
+static uint64_t systimer_next_event( void )
+{
+    uint64_t next = UINT64_MAX;
+    int i;
+
+    for( i = 0; i < 4; i++ )
+    {
+        uint32_t wait = ( &sysTimerRegs.compare0 )[i] - (uint32_t)sysTimerLastUs;
+        uint64_t at = ( sysTimerLastUs + ( wait ? wait : 0x100000000ULL ) ) * 1000;
+
+        if( at < next )
+            next = at;
+    }
+
+    return next;
+}
+
+static uint32_t systimer_irq_lines( void )
+{
+    return sysTimerRegs.control_status & 0xF;
+}
+
+
+/* ARM timer. Counts Value down from Load once every timer clock and sets
+   the interrupt pending bit and reloads when it gets to zero. A write to
+   Reload only changes what the next countdown starts from, so the one in
+   progress keeps its own start value */
+
+static rpi_arm_timer_t armTimerRegs;
+static uint64_t armTimerStartNs;
+static uint32_t armTimerCount;
+static uint32_t armTimerRaw;
+
+static uint32_t armtimer_tick_ns( void )
+{
+    static const uint32_t prescale[4] = { 1, 16, 256, 1 };
+
+    return SIM_APB_NS * ( armTimerRegs.PreDivider + 1 ) *
+           prescale[( armTimerRegs.Control >> 2 ) & 3];
+}
+
+static uint32_t armtimer_width( uint32_t value )
+{
+    if( armTimerRegs.Control & RPI_ARMTIMER_CTRL_23BIT )
+        return value & 0x7FFFFF;
+
+    return value & 0xFFFF;
+}
+
+/* How long a countdown from count takes, zero included */
+static uint64_t armtimer_period_ns( uint32_t count )
+{
+    return (uint64_t)( armtimer_width( count ) + 1 ) * armtimer_tick_ns();
+}
+
+static void armtimer_update( void )
+{
+    uint64_t period;
+
+    if( ( armTimerRegs.Control & RPI_ARMTIMER_CTRL_ENABLE ) == 0 )
+        return;
+
+    period = armtimer_period_ns( armTimerCount );
+
+    if( hal.time_ns - armTimerStartNs < period )
+        return;
+
+    /* The countdown in progress ends, any after it run from Load */
+    armTimerRaw = 1;
+    armTimerStartNs += period;
+    armTimerCount = armTimerRegs.Load;
+
+    period = armtimer_period_ns( armTimerCount );
+    armTimerStartNs += ( ( hal.time_ns - armTimerStartNs ) / period ) * period;
+}
+
+static uint32_t armtimer_read( volatile uint32_t* reg, uint32_t offset )
+{
+    switch( offset )
+    {
+        case SIM_REG( rpi_arm_timer_t, Value ):
+            if( ( armTimerRegs.Control & RPI_ARMTIMER_CTRL_ENABLE ) == 0 )
+                return armtimer_width( armTimerCount );
+
+            return armtimer_width( armTimerCount ) - (uint32_t)( ( hal.time_ns - armTimerStartNs ) / armtimer_tick_ns() );
+
+        case SIM_REG( rpi_arm_timer_t, IRQClear ):
+            return 0x544D5241;
+
+        case SIM_REG( rpi_arm_timer_t, RAWIRQ ):
+            return armTimerRaw;
+
+        case SIM_REG( rpi_arm_timer_t, MaskedIRQ ):
+            return armTimerRaw && ( armTimerRegs.Control & RPI_ARMTIMER_CTRL_INT_ENABLE );
+
+        case SIM_REG( rpi_arm_timer_t, FreeRunningCounter ):
+            return (uint32_t)( hal.time_ns / ( SIM_APB_NS * ( ( ( armTimerRegs.Control >> 16 ) & 0xFF ) + 1 ) ) );
+
+        default:
+            return *reg;
+    }
+}
+
+static void armtimer_write( volatile uint32_t* reg, uint32_t offset, uint32_t value )
+{
+    switch( offset )
+    {
+        /* Restarts the countdown from the new value straight away */
+        case SIM_REG( rpi_arm_timer_t, Load ):
+            armTimerRegs.Load = value;
+            armTimerRegs.Reload = value;
+            armTimerCount = value;
+            armTimerStartNs = hal.time_ns;
+            break;
+
+        /* Takes effect at the next reload. Load reads back the new value
+           as they're the same register underneath */
+        case SIM_REG( rpi_arm_timer_t, Reload ):
+            armTimerRegs.Load = value;
+            armTimerRegs.Reload = value;
+            break;
+
+        case SIM_REG( rpi_arm_timer_t, Control ):
+            if( ( value & RPI_ARMTIMER_CTRL_ENABLE ) &&
+                ( ( armTimerRegs.Control & RPI_ARMTIMER_CTRL_ENABLE ) == 0 ) )
+                armTimerStartNs = hal.time_ns;
+
+            armTimerRegs.Control = value;
+            break;
+
+        case SIM_REG( rpi_arm_timer_t, IRQClear ):
+            armTimerRaw = 0;
+            break;
+
+        case SIM_REG( rpi_arm_timer_t, Value ):
+        case SIM_REG( rpi_arm_timer_t, RAWIRQ ):
+        case SIM_REG( rpi_arm_timer_t, MaskedIRQ ):
+        case SIM_REG( rpi_arm_timer_t, FreeRunningCounter ):
+            break;
+
+        default:
+            *reg = value;
+            break;
+    }
+}
+
+static void armtimer_reset( void )
+{
+    memset( (void*)&armTimerRegs, 0, sizeof( armTimerRegs ) );
+    armTimerRegs.Control = 0x3E0020;
+    armTimerRegs.PreDivider = 0x7D;
+    armTimerStartNs = 0;
+    armTimerCount = 0;
+    armTimerRaw = 0;
+}
+
+static uint64_t armtimer_next_event( void )
+{
+    if( ( armTimerRegs.Control & RPI_ARMTIMER_CTRL_ENABLE ) == 0 )
+        return UINT64_MAX;
+
+    return armTimerStartNs + armtimer_period_ns( armTimerCount );
+}
+
+static uint32_t armtimer_irq_lines( void )
+{
+    return armTimerRaw && ( armTimerRegs.Control & RPI_ARMTIMER_CTRL_INT_ENABLE );
+}
+
+
+/* Interrupt controller. Gathers the interrupt lines of every model and
+   shows the enabled ones in the pending registers */
+
+static rpi_irq_controller_t irqRegs;
+static uint32_t irqEnabled[3];
+
+static void irq_lines( uint32_t* lines )
+{
+    int i;
+
+    lines[0] = lines[1] = lines[2] = 0;
+
+    for( i = 0; i < backendCount; i++ )
+    {
+        uint64_t raised;
+
+        if( backends[i].irq_lines == NULL )
+            continue;
+
+        raised = (uint64_t)backends[i].irq_lines() << ( backends[i].irq_base % 32 );
+
+        lines[backends[i].irq_base / 32] |= (uint32_t)raised;
+        if( ( raised >> 32 ) && ( backends[i].irq_base / 32 < 2 ) )
+            lines[backends[i].irq_base / 32 + 1] |= (uint32_t)( raised >> 32 );
+    }
+
+    lines[0] &= irqEnabled[0];
+    lines[1] &= irqEnabled[1];
+    lines[2] &= irqEnabled[2] & 0xFF;
+}
+
+static uint32_t irq_read( volatile uint32_t* reg, uint32_t offset )
+{
+    uint32_t lines[3];
+
+    irq_lines( lines );
+
+    switch( offset )
+    {
+        case SIM_REG( rpi_irq_controller_t, IRQ_basic_pending ):
+            return lines[2] | ( lines[0] ? ( 1 << 8 ) : 0 ) | ( lines[1] ? ( 1 << 9 ) : 0 );
+
+        case SIM_REG( rpi_irq_controller_t, IRQ_pending_1 ):
+            return lines[0];
+
+        case SIM_REG( rpi_irq_controller_t, IRQ_pending_2 ):
+            return lines[1];
+
+        case SIM_REG( rpi_irq_controller_t, Enable_IRQs_1 ):
+        case SIM_REG( rpi_irq_controller_t, Disable_IRQs_1 ):
+            return irqEnabled[0];
+
+        case SIM_REG( rpi_irq_controller_t, Enable_IRQs_2 ):
+        case SIM_REG( rpi_irq_controller_t, Disable_IRQs_2 ):
+            return irqEnabled[1];
+
+        case SIM_REG( rpi_irq_controller_t, Enable_Basic_IRQs ):
+        case SIM_REG( rpi_irq_controller_t, Disable_Basic_IRQs ):
+            return irqEnabled[2];
+
+        default:
+            return *reg;
+    }
+}
+
+static void irq_write( volatile uint32_t* reg, uint32_t offset, uint32_t value )
+{
+    switch( offset )
+    {
+        case SIM_REG( rpi_irq_controller_t, Enable_IRQs_1 ):
+            irqEnabled[0] |= value;
+            break;
+
+        case SIM_REG( rpi_irq_controller_t, Enable_IRQs_2 ):
+            irqEnabled[1] |= value;
+            break;
+
+        case SIM_REG( rpi_irq_controller_t, Enable_Basic_IRQs ):
+            irqEnabled[2] |= value;
+            break;
+
+        case SIM_REG( rpi_irq_controller_t, Disable_IRQs_1 ):
+            irqEnabled[0] &= ~value;
+            break;
+
+        case SIM_REG( rpi_irq_controller_t, Disable_IRQs_2 ):
+            irqEnabled[1] &= ~value;
+            break;
+
+        case SIM_REG( rpi_irq_controller_t, Disable_Basic_IRQs ):
+            irqEnabled[2] &= ~value;
+            break;
+
+        default:
+            *reg = value;
+            break;
+    }
+}
+
+static void irq_reset( void )
+{
+    memset( (void*)&irqRegs, 0, sizeof( irqRegs ) );
+    memset( irqEnabled, 0, sizeof( irqEnabled ) );
+}
+
+
+/* GPIO. Pins set as outputs read back what was last set or cleared, the
+   rest read the levels RPI_HalSimGpioInput drives them to */
+
+static rpi_gpio_t gpioRegs;
+static uint32_t gpioOutput[2];
+static uint32_t gpioInput[2];
+
+static uint32_t gpio_level( int bank )
+{
+    uint32_t outputs = 0;
+    int pin;
+
+    for( pin = bank * 32; ( pin < bank * 32 + 32 ) && ( pin <= RPI_GPIO53 ); pin++ )
+    {
+        uint32_t fsel = ( &gpioRegs.GPFSEL0 )[pin / 10] >> ( ( pin % 10 ) * 3 );
+
+        if( ( fsel & FS_MASK ) == FS_OUTPUT )
+            outputs |= 1 << ( pin % 32 );
+    }
+
+    return ( gpioOutput[bank] & outputs ) | ( gpioInput[bank] & ~outputs );
+}
+
+static uint32_t gpio_read( volatile uint32_t* reg, uint32_t offset )
+{
+    switch( offset )
+    {
+        case SIM_REG( rpi_gpio_t, GPLEV0 ):
+            return gpio_level( 0 );
+
+        case SIM_REG( rpi_gpio_t, GPLEV1 ):
+            return gpio_level( 1 );
+
+        case SIM_REG( rpi_gpio_t, GPSET0 ):
+        case SIM_REG( rpi_gpio_t, GPSET1 ):
+        case SIM_REG( rpi_gpio_t, GPCLR0 ):
+        case SIM_REG( rpi_gpio_t, GPCLR1 ):
+            return 0;
+
+        default:
+            return *reg;
+    }
+}
+
+static void gpio_write( volatile uint32_t* reg, uint32_t offset, uint32_t value )
+{
+    switch( offset )
+    {
+        case SIM_REG( rpi_gpio_t, GPSET0 ):
+            gpioOutput[0] |= value;
+            break;
+
+        case SIM_REG( rpi_gpio_t, GPSET1 ):
+            gpioOutput[1] |= value;
+            break;
+
+        case SIM_REG( rpi_gpio_t, GPCLR0 ):
+            gpioOutput[0] &= ~value;
+            break;
+
+        case SIM_REG( rpi_gpio_t, GPCLR1 ):
+            gpioOutput[1] &= ~value;
+            break;
+
+        case SIM_REG( rpi_gpio_t, GPLEV0 ):
+        case SIM_REG( rpi_gpio_t, GPLEV1 ):
+            break;
+
+        default:
+            *reg = value;
+            break;
+    }
+}
+
+static void gpio_reset( void )
+{
+    memset( (void*)&gpioRegs, 0, sizeof( gpioRegs ) );
+    memset( gpioOutput, 0, sizeof( gpioOutput ) );
+    memset( gpioInput, 0, sizeof( gpioInput ) );
+}
+
+void RPI_HalSimGpioInput( uint32_t pin, bool level )
+{
+    if( pin > RPI_GPIO53 )
+        return;
+
+    if( level )
+        gpioInput[pin / 32] |= 1 << ( pin % 32 );
+    else
+        gpioInput[pin / 32] &= ~( 1 << ( pin % 32 ) );
+}
+
+
+static const rpi_hal_backend_t models[] = {
+    { "system timer", RPI_SYSTIMER_BASE, (void*)&sysTimerRegs, sizeof( sysTimerRegs ),
+      systimer_read, systimer_write, systimer_reset, systimer_update,
+      systimer_next_event, systimer_irq_lines, RPI_IRQ_0 },
+    { "arm timer", RPI_ARMTIMER_BASE, (void*)&armTimerRegs, sizeof( armTimerRegs ),
+      armtimer_read, armtimer_write, armtimer_reset, armtimer_update,
+      armtimer_next_event, armtimer_irq_lines, RPI_IRQ_ARM_TIMER },
+    { "interrupt controller", RPI_INTERRUPT_CONTROLLER_BASE, (void*)&irqRegs, sizeof( irqRegs ),
+      irq_read, irq_write, irq_reset, NULL, NULL, NULL, 0 },
+    { "gpio", RPI_GPIO_BASE, (void*)&gpioRegs, sizeof( gpioRegs ),
+      gpio_read, gpio_write, gpio_reset, NULL, NULL, NULL, 0 },
+    };
+
+
+/**
+    @brief Put the built in models in place the first time the HAL is used
+*/
+static void hal_start( void )
+{
+    unsigned int i;
+
+    if( started )
+        return;
+
+    started = true;
+
+    for( i = 0; i < sizeof( models ) / sizeof( models[0] ); i++ )
+        RPI_HalSimRegister( &models[i] );
+
+    RPI_HalSimRegister( &rpiAuxSimBackend );
+    RPI_HalSimReset();
+}
+
+
+bool RPI_HalSimRegister( const rpi_hal_backend_t* backend )
+{
+    int i;
+
+    hal_start();
+    lastBackend = NULL;
+
+    for( i = 0; i < backendCount; i++ )
+    {
+        if( backends[i].base == backend->base )
+        {
+            backends[i] = *backend;
+            return true;
+        }
+    }
+
+    if( backendCount == RPI_HAL_SIM_BACKENDS )
+        return false;
+
+    backends[backendCount++] = *backend;
+
+    return true;
+}
+
+
+/**
+    @brief The register block at a peripheral's address on the Pi. Blocks
+    nobody models are given zeroed memory that reads back what's written
+*/
+void* RPI_HalMap( uint32_t base, uint32_t size )
+{
+    rpi_hal_backend_t plain;
+    int i;
+
+    hal_start();
+
+    for( i = 0; i < backendCount; i++ )
+    {
+        if( backends[i].base == base )
+            return backends[i].regs;
+    }
+
+    memset( &plain, 0, sizeof( plain ) );
+    plain.name = "memory";
+    plain.base = base;
+    plain.regs = calloc( 1, size );
+    plain.size = size;
+
+    if( ( plain.regs == NULL ) || !RPI_HalSimRegister( &plain ) )
+    {
+        free( plain.regs );
+        return NULL;
+    }
+
+    return plain.regs;
+}
+
+
+static rpi_hal_backend_t* hal_find( volatile const uint32_t* reg )
+{
+    const volatile uint8_t* address = (const volatile uint8_t*)reg;
+    int i;
+
+    /* Drivers tend to hit the same block many times in a row */
+    if( ( lastBackend != NULL ) && ( address >= (uint8_t*)lastBackend->regs ) &&
+        ( address < (uint8_t*)lastBackend->regs + lastBackend->size ) )
+        return lastBackend;
+
+    for( i = 0; i < backendCount; i++ )
+    {
+        if( ( address >= (uint8_t*)backends[i].regs ) &&
+            ( address < (uint8_t*)backends[i].regs + backends[i].size ) )
+        {
+            lastBackend = &backends[i];
+            return lastBackend;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void hal_update( void )
+{
+    int i;
+
+    for( i = 0; i < backendCount; i++ )
+    {
+        if( backends[i].update )
+            backends[i].update();
+    }
+}
+
+
+uint32_t RPI_HalRead( volatile const uint32_t* reg )
+{
+    rpi_hal_backend_t* backend = hal_find( reg );
+
+    hal.time_ns += hal.access_ns;
+    hal.reads++;
+    hal_update();
+
+    if( ( backend == NULL ) || ( backend->read == NULL ) )
+        return *reg;
+
+    return backend->read( (volatile uint32_t*)reg,
+                          (uint32_t)( (const volatile uint8_t*)reg - (uint8_t*)backend->regs ) );
+}
+
+
+void RPI_HalWrite( volatile uint32_t* reg, uint32_t value )
+{
+    rpi_hal_backend_t* backend = hal_find( reg );
+
+    hal.time_ns += hal.access_ns;
+    hal.writes++;
+    hal_update();
+
+    if( ( backend == NULL ) || ( backend->write == NULL ) )
+    {
+        *reg = value;
+        return;
+    }
+
+    backend->write( reg, (uint32_t)( (volatile uint8_t*)reg - (uint8_t*)backend->regs ), value );
+}
+
+
+rpi_hal_sim_t* RPI_HalSimState( void )
+{
+    hal_start();
+    return &hal;
+}
+
+
+/**
+    @brief Restart the clock and put every model back in its reset state
+*/
+void RPI_HalSimReset( void )
+{
+    int i;
+
+    hal_start();
+
+    hal.time_ns = 0;
+    hal.reads = 0;
+    hal.writes = 0;
+
+    for( i = 0; i < backendCount; i++ )
+    {
+        if( backends[i].reset )
+            backends[i].reset();
+        else if( backends[i].read == NULL )
+            memset( backends[i].regs, 0, backends[i].size );
+    }
+}
+
+
+uint64_t RPI_HalSimTime( void )
+{
+    return hal.time_ns;
+}
+
+
+void RPI_HalSimAdvance( uint64_t ns )
+{
+    hal.time_ns += ns;
+    hal_update();
+}
+
+
+/**
+    @brief The virtual time at which a model next changes state on its own,
+    the current time if none of them will
+*/
+uint64_t RPI_HalSimNextEvent( void )
+{
+    uint64_t next = UINT64_MAX;
+    int i;
+
+    hal_start();
+
+    for( i = 0; i < backendCount; i++ )
+    {
+        uint64_t at;
+
+        if( backends[i].next_event == NULL )
+            continue;
+
+        at = backends[i].next_event();
+
+        if( ( at > hal.time_ns ) && ( at < next ) )
+            next = at;
+    }
+
+    return next == UINT64_MAX ? hal.time_ns : next;
+}
+
+
+bool RPI_HalSimIrqPending( void )
+{
+    uint32_t lines[3];
+
+    hal_start();
+    irq_lines( lines );
+
+    return lines[0] || lines[1] || lines[2];
+}
@@ -0,0 +1,60 @@
+#ifndef RPI_HAL_SIM_H
+#define RPI_HAL_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rpi-hal.h"
+
+#define RPI_HAL_SIM_BACKENDS    8
+
+/** @brief A register block on host builds. Accesses to the size bytes at
+    regs are passed to read and write with their offset into the block, or
+    made to the memory itself when those are NULL. The rest are optional:
+    update brings the model up to the current virtual time, next_event says
+    when it next changes state on its own, irq_lines reports its interrupt
+    lines with bit n being interrupt irq_base + n */
+typedef struct {
+    const char* name;
+    uint32_t base;
+    void* regs;
+    uint32_t size;
+
+    uint32_t (*read)( volatile uint32_t* reg, uint32_t offset );
+    void (*write)( volatile uint32_t* reg, uint32_t offset, uint32_t value );
+    void (*reset)( void );
+    void (*update)( void );
+    uint64_t (*next_event)( void );
+    uint32_t (*irq_lines)( void );
+    uint32_t irq_base;
+    } rpi_hal_backend_t;
+
+/** @brief The virtual clock shared by every model. It moves on by
+    access_ns for every register access and by whatever RPI_HalSimAdvance
+    is asked for, so busy waiting costs as much virtual time as it would on
+    the Pi */
+typedef struct {
+    uint64_t time_ns;
+    uint32_t access_ns;
+    uint64_t reads;
+    uint64_t writes;
+    } rpi_hal_sim_t;
+
+/* The system timer, ARM timer, interrupt controller, GPIO and mini UART
+   models are there from the start. RPI_HalSimRegister adds a backend or
+   replaces the one at the same base address */
+extern bool RPI_HalSimRegister( const rpi_hal_backend_t* backend );
+extern rpi_hal_sim_t* RPI_HalSimState( void );
+extern void RPI_HalSimReset( void );
+extern uint64_t RPI_HalSimTime( void );
+extern void RPI_HalSimAdvance( uint64_t ns );
+extern uint64_t RPI_HalSimNextEvent( void );
+
+/* True while the interrupt controller has an enabled interrupt pending,
+   RPI_IrqDispatch then runs the handlers like the IRQ vector would */
+extern bool RPI_HalSimIrqPending( void );
+
+/* Drive GPIO input levels, the pins set as outputs follow GPSET/GPCLR */
+extern void RPI_HalSimGpioInput( uint32_t pin, bool level );
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef RPI_HAL_H
+#define RPI_HAL_H
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+
+/* Peripheral register access. Drivers get their register block with
+   RPI_HAL_BLOCK and go through RPI_REG_READ / RPI_REG_WRITE for every
+   register. On the Pi these are the plain volatile accesses they always
+   were. On host builds the block is whatever backend rpi-hal-sim.c has for
+   that address, normally a model of the peripheral that sees and charges
+   virtual time for every access, plain memory if there's no model */
+#if defined( RPI_HOST )
+    #define RPI_HAL_BLOCK( type, base )     ( (type*)RPI_HalMap( ( base ), sizeof( type ) ) )
+    #define RPI_REG_READ( reg )             RPI_HalRead( &( reg ) )
+    #define RPI_REG_WRITE( reg, value )     RPI_HalWrite( &( reg ), ( value ) )
+
+    extern void* RPI_HalMap( uint32_t base, uint32_t size );
+    extern uint32_t RPI_HalRead( volatile const uint32_t* reg );
+    extern void RPI_HalWrite( volatile uint32_t* reg, uint32_t value );
+#else
+    #define RPI_HAL_BLOCK( type, base )     ( (type*)( base ) )
+    #define RPI_REG_READ( reg )             ( reg )
+    #define RPI_REG_WRITE( reg, value )     ( ( reg ) = ( value ) )
+#endif
+
+#endif
@@ -6,22 +6,31 @@
 #include "rpi-armtimer.h"
 #include "rpi-base.h"
 #include "rpi-gpio.h"
+#include "rpi-hal.h"
 #include "rpi-interrupts.h"
+#include "rpi-smp.h"
 
 #include "rpi-aux.h"
 
-/** @brief The BCM2835/6 Interupt controller peripheral at it's base address */
-static rpi_irq_controller_t* rpiIRQController =
-        (rpi_irq_controller_t*)RPI_INTERRUPT_CONTROLLER_BASE;
-
 static INTERRUPT_VECTOR InterruptVectorTable[64+8]; // hardcoded 21 basic pending registers
 
+/* See ARM section A2.5 (Program status registers) */
+#define CPSR_IRQ_INHIBIT    0x80
+
+#if !defined( RPI_HOST )
+/* IRQBlock nests, only the outermost IRQUnBlock restores the IRQ state that
+   the outermost IRQBlock found. Each core has its own CPSR, so each keeps
+   its own depth and saved state; only the core itself touches its entry */
+static volatile uint32_t irqBlockDepth[RPI_CORES];
+static uint32_t irqBlockState[RPI_CORES];
+#endif
+
 /**
     @brief Return the IRQ Controller register set
 */
 rpi_irq_controller_t* RPI_GetIrqController( void )
 {
-    return rpiIRQController;
+    return RPI_HAL_BLOCK( rpi_irq_controller_t, RPI_INTERRUPT_CONTROLLER_BASE );
 }
 
 void IRQRegister(const uint32_t irq, FN_INTERRUPT_HANDLER fHandler, void *args)
@@ -34,50 +43,67 @@ void IRQRegister(const uint32_t irq, FN_INTERRUPT_HANDLER fHandler, void *args)
 
 void IRQBlock(void)
 {
+#if !defined( RPI_HOST )
+    uint32_t cpsr;
+    uint32_t core;
+
+    __asm volatile( "mrs %0, cpsr\n\tcpsid i" : "=r" (cpsr) : : "memory" );
 
+    core = RPI_CoreId();
+
+    if( irqBlockDepth[core]++ == 0 )
+        irqBlockState[core] = cpsr & CPSR_IRQ_INHIBIT;
+#endif
 }
 
 void IRQUnBlock(void)
 {
+#if !defined( RPI_HOST )
+    uint32_t core = RPI_CoreId();
 
+    if( ( --irqBlockDepth[core] == 0 ) && ( irqBlockState[core] == 0 ) )
+        __asm volatile( "cpsie i" : : : "memory" );
+#endif
 }
 
 void RPI_EnableIrq(const uint32_t irq)
 {
+    rpi_irq_controller_t* controller = RPI_GetIrqController();
     uint32_t mask = 1 << (irq % 32);
 
     IRQBlock();
     if (irq <= 31)
     {
-        rpiIRQController->Enable_IRQs_1 = mask;
+        RPI_REG_WRITE( controller->Enable_IRQs_1, mask );
     }
     else if (irq <= 63)
     {
-        rpiIRQController->Enable_IRQs_2 = mask;
+        RPI_REG_WRITE( controller->Enable_IRQs_2, mask );
     }
     else
     {
-        rpiIRQController->Enable_Basic_IRQs = mask;
+        RPI_REG_WRITE( controller->Enable_Basic_IRQs, mask );
     }
     IRQUnBlock();
 }
 
 void RPI_DisableIrq(const uint32_t irq)
 {
+    rpi_irq_controller_t* controller = RPI_GetIrqController();
     uint32_t mask = 1 << (irq % 32);
 
     IRQBlock();
     if (irq <= 31)
     {
-        rpiIRQController->Disable_IRQs_1 = mask;
+        RPI_REG_WRITE( controller->Disable_IRQs_1, mask );
     }
     else if (irq <= 63)
     {
-        rpiIRQController->Disable_IRQs_1 = mask;
+        RPI_REG_WRITE( controller->Disable_IRQs_2, mask );
     }
     else
     {
-        rpiIRQController->Disable_Basic_IRQs = mask;
+        RPI_REG_WRITE( controller->Disable_Basic_IRQs, mask );
     }
     IRQUnBlock();
 }
@@ -90,6 +116,8 @@ void RPI_IrqControllerInit(void)
 }
 
 
+#if !defined( RPI_HOST )
+
 /**
     @brief The Reset vector interrupt handler
 
@@ -166,6 +194,8 @@ void __attribute__((interrupt("ABORT"))) data_abort_vector(void)
     }
 }
 
+#endif
+
 extern void handleInterruptRange(uint32_t pending, const uint32_t base)
 {
     while (pending)
@@ -188,30 +218,28 @@ extern void handleInterruptRange(uint32_t pending, const uint32_t base)
 }
 
 /**
-    @brief The IRQ Interrupt handler
-
-    This handler is run every time an interrupt source is triggered. It's
-    up to the handler to determine the source of the interrupt and most
-    importantly clear the interrupt flag so that the interrupt won't
-    immediately put us back into the start of the handler again.
+    @brief Run the handler of every pending interrupt. Called from the IRQ
+    vector, and on host builds by whatever stands in for the CPU taking the
+    interrupt
 */
-void __attribute__((interrupt("IRQ"))) interrupt_vector(void)
+void RPI_IrqDispatch(void)
 {
+    rpi_irq_controller_t* controller = RPI_GetIrqController();
     register uint32_t basic_pending;
 
     // read pending registers
-    basic_pending = rpiIRQController->IRQ_basic_pending;
+    basic_pending = RPI_REG_READ( controller->IRQ_basic_pending );
 
     // pending 1 (0-31)
     if (basic_pending & (1 << 8))
     {
-        handleInterruptRange(rpiIRQController->IRQ_pending_1, 0);
+        handleInterruptRange(RPI_REG_READ( controller->IRQ_pending_1 ), 0);
     }
 
     // pending 2 (32-61)
     if (basic_pending & (1 << 9))
     {
-        handleInterruptRange(rpiIRQController->IRQ_pending_2, 32);
+        handleInterruptRange(RPI_REG_READ( controller->IRQ_pending_2 ), 32);
     }
 
     // basic pending
@@ -221,6 +249,21 @@ void __attribute__((interrupt("IRQ"))) interrupt_vector(void)
     }
 }
 
+#if !defined( RPI_HOST )
+
+/**
+    @brief The IRQ Interrupt handler
+
+    This handler is run every time an interrupt source is triggered. It's
+    up to the handler to determine the source of the interrupt and most
+    importantly clear the interrupt flag so that the interrupt won't
+    immediately put us back into the start of the handler again.
+*/
+void __attribute__((interrupt("IRQ"))) interrupt_vector(void)
+{
+    RPI_IrqDispatch();
+}
+
 
 /**
     @brief The FIQ Interrupt Handler
@@ -251,3 +294,5 @@ void __attribute__((interrupt("FIQ"))) fast_interrupt_vector(void)
 {
 
 }
+
+#endif
@@ -152,6 +152,9 @@ typedef struct
 } INTERRUPT_VECTOR;
 
 extern void IRQRegister(const uint32_t irq, FN_INTERRUPT_HANDLER fHandler, void *args);
+/* Mask and unmask IRQs on the calling core, nesting. Any core may call
+   them, but they only keep that core's interrupts out: they don't stop
+   another core running the same code at the same time */
 extern void IRQBlock(void);
 extern void IRQUnBlock(void);
 extern void handleInterruptRange(uint32_t pending, const uint32_t base);
@@ -165,5 +168,6 @@ extern rpi_irq_controller_t* RPI_GetIrqController( void );
 extern void RPI_IrqControllerInit(void);
 extern void RPI_EnableIrq(const uint32_t irq);
 extern void RPI_DisableIrq(const uint32_t irq);
+extern void RPI_IrqDispatch(void);
 
 #endif
@@ -0,0 +1,575 @@
+/* A stand in for the VideoCore on host builds. It replaces rpi-mailbox.c and
+   answers property tag buffers the way the firmware would, so everything
+   built on the property interface runs on a PC. Requests are answered
+   straight away unless RPI_MailboxHostScript or the model's latencies say
+   otherwise, which lets the interrupt driven property calls be tried
+   against a slow VideoCore. What it answers comes from a model of the
+   board that RPI_MailboxHostModel hands out for changing */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rpi-interrupts.h"
+#include "rpi-mailbox.h"
+#include "rpi-mailbox-interface.h"
+
+#define HOST_MAX_BUFFERS        16
+#define HOST_RESPONSE           0x80000000
+
+/* Both directions of the real mailbox hold eight values */
+#define HOST_MAILBOX_DEPTH      8
+
+/* Buffers handed to or from the "VideoCore". A bus address is the buffer
+   index (plus one, so 0 stays NULL) in the top byte and an offset below */
+static void* busBuffers[HOST_MAX_BUFFERS];
+
+/* Requests waiting for the VideoCore and answers waiting for the ARM, in
+   virtual microseconds */
+static struct {
+    unsigned int value;
+    uint64_t due_us;
+    } requests[HOST_MAILBOX_DEPTH];
+static uint32_t requestHead = 0;
+static uint32_t requestCount = 0;
+
+static unsigned int responses[HOST_MAILBOX_DEPTH];
+static uint32_t responseHead = 0;
+static uint32_t responseCount = 0;
+
+#define MHZ                     1000000
+
+/* A Pi 2 Model B. The ARM boots at 600MHz and can be asked for up to
+   900MHz */
+static rpi_mailbox_host_model_t model = {
+    .firmware_version = 0x5a0ad3d8,
+    .board_model = 0,
+    .board_revision = 0xa21041,
+    .mac_address = { 0xb8, 0x27, 0xeb, 0x12, 0x34, 0x56 },
+    .serial = { 0x12345678, 0 },
+    .arm_memory = { 0, 0x3b000000 },
+    .vc_memory = { 0x3b000000, 0x04000000 },
+    .clocks = {
+        [TAG_CLOCK_EMMC] = { 250 * MHZ, 250 * MHZ, 250 * MHZ, 1 },
+        [TAG_CLOCK_UART] = { 48 * MHZ, 48 * MHZ, 48 * MHZ, 1 },
+        [TAG_CLOCK_ARM] = { 600 * MHZ, 600 * MHZ, 900 * MHZ, 1 },
+        [TAG_CLOCK_CORE] = { 250 * MHZ, 250 * MHZ, 450 * MHZ, 1 },
+        [TAG_CLOCK_V3D] = { 250 * MHZ, 250 * MHZ, 450 * MHZ, 1 },
+        [TAG_CLOCK_H264] = { 250 * MHZ, 250 * MHZ, 450 * MHZ, 1 },
+        [TAG_CLOCK_ISP] = { 250 * MHZ, 250 * MHZ, 450 * MHZ, 1 },
+        [TAG_CLOCK_SDRAM] = { 400 * MHZ, 400 * MHZ, 450 * MHZ, 1 },
+        },
+    .temperature = 45000,
+    .request_us = 0,
+    .tag_us = 0,
+    .refresh_us = 0,
+    };
+
+static uint64_t hostTime = 0;
+static const uint32_t* script = NULL;
+static uint32_t scriptCount = 0;
+static rpi_mailbox_host_stats_t hostStats;
+
+static bool irqEnabled = false;
+static bool inIrq = false;
+
+static struct {
+    int physical_width;
+    int physical_height;
+    int virtual_width;
+    int virtual_height;
+    int x_offset;
+    int y_offset;
+    int depth;
+    int pitch;
+    uint8_t* buffer;
+    int size;
+    } fb = { 640, 480, 640, 480, 0, 0, 32, 640 * 4, NULL, 0 };
+
+
+unsigned int RPI_MailboxToBus( void* buffer )
+{
+    int i;
+
+    /* A buffer keeps its slot, so it has to be looked for before a free
+       slot is taken */
+    for( i = 0; i < HOST_MAX_BUFFERS; i++ )
+    {
+        if( busBuffers[i] == buffer )
+            return ( i + 1 ) << 24;
+    }
+
+    for( i = 0; i < HOST_MAX_BUFFERS; i++ )
+    {
+        if( busBuffers[i] == NULL )
+        {
+            busBuffers[i] = buffer;
+            return ( i + 1 ) << 24;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+    @brief Give up a buffer's slot when the "VideoCore" frees it, so a new
+    allocation doesn't use up another one
+*/
+static void bus_release( void* buffer )
+{
+    int i;
+
+    if( buffer == NULL )
+        return;
+
+    for( i = 0; i < HOST_MAX_BUFFERS; i++ )
+    {
+        if( busBuffers[i] == buffer )
+            busBuffers[i] = NULL;
+    }
+}
+
+
+void* RPI_MailboxFromBus( unsigned int address )
+{
+    unsigned int index;
+
+    address &= 0x3FFFFFFF;
+    index = address >> 24;
+
+    if( ( index == 0 ) || ( index > HOST_MAX_BUFFERS ) )
+        return NULL;
+
+    return (uint8_t*)busBuffers[index - 1] + ( address & 0xFFFFFF );
+}
+
+
+static int fb_allocate( void )
+{
+    int size = fb.virtual_height * fb.pitch;
+
+    if( ( size <= 0 ) || ( (uint32_t)size > model.vc_memory[1] ) )
+        return 0;
+
+    if( size != fb.size )
+    {
+        bus_release( fb.buffer );
+        free( fb.buffer );
+        fb.buffer = malloc( size );
+        fb.size = size;
+    }
+
+    return size;
+}
+
+
+/**
+    @brief Answer the clock tags from the model. Rates asked for are held
+    between the clock's minimum and maximum like the firmware does
+*/
+static int clock_respond( int tag, int* value )
+{
+    rpi_mailbox_host_clock_t* clock;
+    uint32_t id = value[0];
+
+    if( ( id >= RPI_MAILBOX_HOST_CLOCKS ) || ( model.clocks[id].max_rate == 0 ) )
+        return -1;
+
+    clock = &model.clocks[id];
+
+    switch( tag )
+    {
+        case TAG_SET_CLOCK_STATE:
+            clock->on = value[1] & 1;
+            /* Fall through */
+        case TAG_GET_CLOCK_STATE:
+            value[1] = clock->on;
+            break;
+
+        case TAG_SET_CLOCK_RATE:
+            if( (uint32_t)value[1] > clock->max_rate )
+                clock->rate = clock->max_rate;
+            else if( (uint32_t)value[1] < clock->min_rate )
+                clock->rate = clock->min_rate;
+            else
+                clock->rate = value[1];
+            /* Fall through */
+        case TAG_GET_CLOCK_RATE:
+            value[1] = clock->rate;
+            break;
+
+        case TAG_GET_MAX_CLOCK_RATE:
+            value[1] = clock->max_rate;
+            break;
+
+        case TAG_GET_MIN_CLOCK_RATE:
+            value[1] = clock->min_rate;
+            break;
+    }
+
+    return 8;
+}
+
+
+/**
+    @brief Fill in the response to one tag, returns the response length or -1
+    if the tag isn't understood and should be left unanswered
+*/
+static int property_respond( int tag, int* value )
+{
+    switch( tag )
+    {
+        case TAG_GET_FIRMWARE_VERSION:
+            value[0] = model.firmware_version;
+            return 4;
+
+        case TAG_GET_BOARD_MODEL:
+            value[0] = model.board_model;
+            return 4;
+
+        case TAG_GET_BOARD_REVISION:
+            value[0] = model.board_revision;
+            return 4;
+
+        case TAG_GET_BOARD_MAC_ADDRESS:
+            memcpy( value, model.mac_address, 6 );
+            return 6;
+
+        case TAG_GET_BOARD_SERIAL:
+            value[0] = model.serial[0];
+            value[1] = model.serial[1];
+            return 8;
+
+        case TAG_GET_ARM_MEMORY:
+            value[0] = model.arm_memory[0];
+            value[1] = model.arm_memory[1];
+            return 8;
+
+        case TAG_GET_VC_MEMORY:
+            value[0] = model.vc_memory[0];
+            value[1] = model.vc_memory[1];
+            return 8;
+
+        case TAG_GET_CLOCK_STATE:
+        case TAG_SET_CLOCK_STATE:
+        case TAG_GET_CLOCK_RATE:
+        case TAG_SET_CLOCK_RATE:
+        case TAG_GET_MAX_CLOCK_RATE:
+        case TAG_GET_MIN_CLOCK_RATE:
+            return clock_respond( tag, value );
+
+        case TAG_SET_PHYSICAL_SIZE:
+            fb.physical_width = value[0];
+            fb.physical_height = value[1];
+            /* Fall through */
+        case TAG_GET_PHYSICAL_SIZE:
+        case TAG_TEST_PHYSICAL_SIZE:
+            value[0] = fb.physical_width;
+            value[1] = fb.physical_height;
+            return 8;
+
+        case TAG_SET_VIRTUAL_SIZE:
+            fb.virtual_width = value[0];
+            fb.virtual_height = value[1];
+            fb.pitch = fb.virtual_width * ( fb.depth >> 3 );
+            /* Fall through */
+        case TAG_GET_VIRTUAL_SIZE:
+        case TAG_TEST_VIRTUAL_SIZE:
+            value[0] = fb.virtual_width;
+            value[1] = fb.virtual_height;
+            return 8;
+
+        case TAG_SET_VIRTUAL_OFFSET:
+            /* Offsets that would scan out past the virtual surface are
+               refused, the firmware keeps the old ones */
+            if( ( value[0] + fb.physical_width <= fb.virtual_width ) &&
+                ( value[1] + fb.physical_height <= fb.virtual_height ) )
+            {
+                fb.x_offset = value[0];
+                fb.y_offset = value[1];
+            }
+            /* Fall through */
+        case TAG_GET_VIRTUAL_OFFSET:
+            value[0] = fb.x_offset;
+            value[1] = fb.y_offset;
+            return 8;
+
+        case TAG_SET_DEPTH:
+            fb.depth = value[0];
+            fb.pitch = fb.virtual_width * ( fb.depth >> 3 );
+            /* Fall through */
+        case TAG_GET_DEPTH:
+            value[0] = fb.depth;
+            return 4;
+
+        case TAG_GET_PITCH:
+            value[0] = fb.pitch;
+            return 4;
+
+        case TAG_SET_VSYNC:
+            /* The wait was in when the request fell due, see vsync_due */
+            value[0] = 0;
+            return 4;
+
+        case TAG_ALLOCATE_BUFFER:
+            /* The firmware answers with a zero base and size when the
+               GPU's share of memory is too small */
+            if( fb_allocate() == 0 )
+            {
+                value[0] = 0;
+                value[1] = 0;
+            }
+            else
+            {
+                value[0] = RPI_MailboxToBus( fb.buffer );
+                value[1] = fb.size;
+            }
+            return 8;
+
+        case TAG_GET_TEMPERATURE:
+            value[1] = model.temperature;
+            return 8;
+
+        case TAG_RELEASE_BUFFER:
+            bus_release( fb.buffer );
+            free( fb.buffer );
+            fb.buffer = NULL;
+            fb.size = 0;
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+
+static void property_process( int* pt )
+{
+    int words = pt[PT_OSIZE] >> 2;
+    int index = 2;
+
+    while( ( index < words ) && ( pt[index] != 0 ) )
+    {
+        int* tag = &pt[index];
+        int length = property_respond( tag[T_OIDENT], &tag[T_OVALUE] );
+
+        if( length >= 0 )
+            tag[T_ORESPONSE] = HOST_RESPONSE | length;
+
+        index += ( tag[T_OVALUE_SIZE] >> 2 ) + 3;
+    }
+
+    pt[PT_OREQUEST_OR_RESPONSE] = HOST_RESPONSE;
+}
+
+
+/**
+    @brief Answer every request that is due by now. The VideoCore works
+    through its mailbox in order, so a slow request holds up the ones
+    behind it
+*/
+static void vc_run( void )
+{
+    while( ( requestCount > 0 ) && ( requests[requestHead].due_us <= hostTime ) &&
+           ( responseCount < HOST_MAILBOX_DEPTH ) )
+    {
+        unsigned int value = requests[requestHead].value;
+
+        requestHead = ( requestHead + 1 ) % HOST_MAILBOX_DEPTH;
+        requestCount--;
+
+        if( ( value & 0xF ) == MB0_TAGS_ARM_TO_VC )
+            property_process( RPI_MailboxFromBus( value & ~0xF ) );
+
+        responses[( responseHead + responseCount ) % HOST_MAILBOX_DEPTH] = value;
+        responseCount++;
+        hostStats.responses++;
+    }
+
+    /* The interrupt stays asserted for as long as there's data to read */
+    if( irqEnabled && ( responseCount > 0 ) && !inIrq )
+    {
+        inIrq = true;
+        handleInterruptRange( RPI_BASIC_ARM_MAILBOX_IRQ, 64 );
+        inIrq = false;
+    }
+}
+
+
+void RPI_MailboxHostScript( const uint32_t* latency_us, uint32_t count )
+{
+    script = latency_us;
+    scriptCount = count;
+}
+
+
+void RPI_MailboxHostAdvance( uint32_t us )
+{
+    hostTime += us;
+    vc_run();
+}
+
+
+uint64_t RPI_MailboxHostTime( void )
+{
+    return hostTime;
+}
+
+
+rpi_mailbox_host_stats_t* RPI_MailboxHostStats( void )
+{
+    return &hostStats;
+}
+
+
+rpi_mailbox_host_model_t* RPI_MailboxHostModel( void )
+{
+    return &model;
+}
+
+
+/**
+    @brief How long the model says a request takes to answer, longer the
+    more tags there are in it
+*/
+static uint32_t model_latency( mailbox0_channel_t channel, unsigned int value )
+{
+    uint32_t latency = model.request_us;
+    int* pt;
+    int words;
+    int index = 2;
+
+    if( ( channel != MB0_TAGS_ARM_TO_VC ) || ( model.tag_us == 0 ) )
+        return latency;
+
+    pt = RPI_MailboxFromBus( value & ~0xF );
+    if( pt == NULL )
+        return latency;
+
+    words = pt[PT_OSIZE] >> 2;
+
+    while( ( index < words ) && ( pt[index] != 0 ) )
+    {
+        latency += model.tag_us;
+        index += ( pt[index + T_OVALUE_SIZE] >> 2 ) + 3;
+    }
+
+    return latency;
+}
+
+
+/**
+    @brief When a request that's otherwise due at due_us is answered. One
+    asking to wait for the vsync holds the mailbox up until the next vblank
+*/
+static uint64_t vsync_due( mailbox0_channel_t channel, unsigned int value, uint64_t due_us )
+{
+    int* pt;
+    int words;
+    int index = 2;
+
+    if( ( channel != MB0_TAGS_ARM_TO_VC ) || ( model.refresh_us == 0 ) )
+        return due_us;
+
+    pt = RPI_MailboxFromBus( value & ~0xF );
+    if( pt == NULL )
+        return due_us;
+
+    words = pt[PT_OSIZE] >> 2;
+
+    while( ( index < words ) && ( pt[index] != 0 ) )
+    {
+        if( pt[index + T_OIDENT] == TAG_SET_VSYNC )
+            return ( due_us / model.refresh_us + 1 ) * model.refresh_us;
+
+        index += ( pt[index + T_OVALUE_SIZE] >> 2 ) + 3;
+    }
+
+    return due_us;
+}
+
+
+bool RPI_Mailbox0TryWrite( mailbox0_channel_t channel, unsigned int value )
+{
+    uint32_t latency;
+
+    if( requestCount == HOST_MAILBOX_DEPTH )
+        return false;
+
+    if( scriptCount > 0 )
+    {
+        latency = *script++;
+        scriptCount--;
+    }
+    else
+    {
+        latency = model_latency( channel, value );
+    }
+
+    hostStats.requests++;
+
+    if( latency == RPI_MAILBOX_HOST_NEVER )
+    {
+        hostStats.dropped++;
+        return true;
+    }
+
+    requests[( requestHead + requestCount ) % HOST_MAILBOX_DEPTH].value = ( value & ~0xF ) | channel;
+    requests[( requestHead + requestCount ) % HOST_MAILBOX_DEPTH].due_us =
+        vsync_due( channel, value, hostTime + latency );
+    requestCount++;
+
+    vc_run();
+
+    return true;
+}
+
+
+bool RPI_Mailbox0TryRead( unsigned int* value )
+{
+    hostStats.polls++;
+    RPI_MailboxHostAdvance( 1 );
+
+    if( responseCount == 0 )
+        return false;
+
+    *value = responses[responseHead];
+    responseHead = ( responseHead + 1 ) % HOST_MAILBOX_DEPTH;
+    responseCount--;
+
+    return true;
+}
+
+
+void RPI_Mailbox0EnableIrq( bool enable )
+{
+    irqEnabled = enable;
+    vc_run();
+}
+
+
+void RPI_Mailbox0Write( mailbox0_channel_t channel, int value )
+{
+    while( !RPI_Mailbox0TryWrite( channel, value ) )
+    {
+        hostStats.polls++;
+        RPI_MailboxHostAdvance( 1 );
+    }
+}
+
+
+int RPI_Mailbox0Read( mailbox0_channel_t channel )
+{
+    unsigned int value;
+
+    while( 1 )
+    {
+        /* Nothing coming, don't wait forever for it */
+        if( ( responseCount == 0 ) && ( requestCount == 0 ) )
+            return -1;
+
+        if( RPI_Mailbox0TryRead( &value ) && ( ( value & 0xF ) == channel ) )
+            return value >> 4;
+    }
+}
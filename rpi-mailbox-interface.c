@@ -32,31 +32,117 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "rpi-base.h"
+#include "rpi-cache.h"
+#include "rpi-interrupts.h"
 #include "rpi-mailbox.h"
 #include "rpi-mailbox-interface.h"
 
-/* Make sure the property tag buffer is aligned to a 16-byte boundary because
-   we only have 28-bits available in the property interface protocol to pass
-   the address of the buffer to the VC. */
-static int pt[8192] __attribute__((aligned(16)));
-static int pt_index = 0;
+/* Make sure the property tag buffers are aligned to a 16-byte boundary
+   because we only have 28-bits available in the property interface protocol
+   to pass the address of the buffer to the VC. They're aligned to a whole
+   cache line, which is at least that, as the cache is cleaned before the
+   VideoCore reads one and invalidated before the ARM reads the answer */
+static int pt[RPI_PROPERTY_BUFFER_WORDS] RPI_CACHE_ALIGNED;
+static int slotBuffers[RPI_PROPERTY_SLOTS][RPI_PROPERTY_BUFFER_WORDS] RPI_CACHE_ALIGNED;
 
+/* The blocking interface's transaction, then the non-blocking ones */
+static rpi_property_transaction_t transactions[RPI_PROPERTY_SLOTS + 1];
+static rpi_property_transaction_t* const legacy = &transactions[RPI_PROPERTY_SLOTS];
 
-void RPI_PropertyInit( void )
+static void property_start( rpi_property_transaction_t* t, int* buffer, int words )
 {
+    t->pt = buffer;
+    t->pt_words = words;
+
     /* Fill in the size on-the-fly */
-    pt[PT_OSIZE] = 12;
+    t->pt[PT_OSIZE] = 12;
 
     /* Process request (All other values are reserved!) */
-    pt[PT_OREQUEST_OR_RESPONSE] = 0;
+    t->pt[PT_OREQUEST_OR_RESPONSE] = 0;
 
     /* First available data slot */
-    pt_index = 2;
+    t->pt_index = 2;
 
     /* NULL tag to terminate tag list */
-    pt[pt_index] = 0;
+    t->pt[t->pt_index] = 0;
+
+    t->complete = NULL;
+    t->args = NULL;
+    t->state = PROPERTY_BUILDING;
+}
+
+
+rpi_property_transaction_t* RPI_PropertyInit( void )
+{
+    property_start( legacy, pt, RPI_PROPERTY_BUFFER_WORDS );
+
+    return legacy;
+}
+
+
+#define RPI_PROPERTY_DESC( name, id, args, response ) \
+    { TAG_##name, RPI_PROPERTY_VALUE_SIZE( args, response ), args },
+
+const rpi_property_tag_desc_t RPI_PropertyTagTable[] = {
+    RPI_PROPERTY_TAGS( RPI_PROPERTY_DESC )
+    };
+
+const int RPI_PropertyTagCount = sizeof( RPI_PropertyTagTable ) / sizeof( RPI_PropertyTagTable[0] );
+
+/* Fail the build for a tag that wouldn't fit an empty buffer on its own: the
+   buffer header, the tag header, its value and the terminator */
+#define RPI_PROPERTY_FITS( name, id, args, response ) \
+    typedef char rpi_property_fits_##name[ \
+        ( ( 2 + 3 + 1 ) * 4 + RPI_PROPERTY_VALUE_SIZE( args, response ) \
+          <= RPI_PROPERTY_BUFFER_WORDS * 4 ) ? 1 : -1 ];
+
+RPI_PROPERTY_TAGS( RPI_PROPERTY_FITS )
+
+
+/**
+    @brief Look a tag up in the descriptor table
+    @return NULL if the tag isn't one we know about
+*/
+const rpi_property_tag_desc_t* RPI_PropertyTagDesc( rpi_mailbox_tag_t tag )
+{
+    int i;
+
+    for( i = 0; i < RPI_PropertyTagCount; i++ )
+    {
+        if( RPI_PropertyTagTable[i].tag == (int)tag )
+            return &RPI_PropertyTagTable[i];
+    }
+
+    return NULL;
 }
 
+
+/**
+    @brief Add a property tag to a transaction's tag list, taking as many
+    arguments as the descriptor table says it has. The RPI_PropertyAdd_<tag>
+    builders do the same without the lookup
+*/
+static void property_add_tag( rpi_property_transaction_t* t, rpi_mailbox_tag_t tag, va_list vl )
+{
+    const rpi_property_tag_desc_t* desc = RPI_PropertyTagDesc( tag );
+    int* value;
+    int i;
+
+    /* Unknown tags are left out of the list */
+    if( desc == NULL )
+        return;
+
+    value = RPI_PropertyReserve( t, tag, desc->value_size );
+
+    if( value == NULL )
+        return;
+
+    for( i = 0; i < desc->args; i++ )
+        value[i] = va_arg( vl, int );
+}
+
+
 /**
     @brief Add a property tag to the current tag list. Data can be included. All data is uint32_t
     @param tag
@@ -65,188 +151,260 @@ void RPI_PropertyAddTag( rpi_mailbox_tag_t tag, ... )
 {
     va_list vl;
     va_start( vl, tag );
+    property_add_tag( legacy, tag, vl );
+    va_end( vl );
+}
 
-    pt[pt_index++] = tag;
 
-    switch( tag )
+void RPI_PropertyAdd( rpi_property_transaction_t* t, rpi_mailbox_tag_t tag, ... )
+{
+    va_list vl;
+    va_start( vl, tag );
+    property_add_tag( t, tag, vl );
+    va_end( vl );
+}
+
+
+/**
+    @brief Note where the tags of an answer start so that looking one up
+    doesn't have to walk the buffer
+*/
+static void property_index( rpi_property_transaction_t* t )
+{
+    int words = t->pt[PT_OSIZE] >> 2;
+    int index = 2;
+
+    t->index_count = 0;
+
+    while( ( t->index_count < RPI_PROPERTY_INDEX_SZ ) &&
+           ( index < words ) && ( t->pt[index] != 0 ) )
     {
-        case TAG_GET_FIRMWARE_VERSION:
-        case TAG_GET_BOARD_MODEL:
-        case TAG_GET_BOARD_REVISION:
-        case TAG_GET_BOARD_MAC_ADDRESS:
-        case TAG_GET_BOARD_SERIAL:
-        case TAG_GET_ARM_MEMORY:
-        case TAG_GET_VC_MEMORY:
-        case TAG_GET_DMA_CHANNELS:
-            /* Provide an 8-byte buffer for the response */
-            pt[pt_index++] = 8;
-            pt[pt_index++] = 0; /* Request */
-            pt_index += 2;
-            break;
+        t->index[t->index_count].tag = t->pt[index];
+        t->index[t->index_count].offset = index;
+        t->index_count++;
 
-        case TAG_GET_CLOCKS:
-        case TAG_GET_COMMAND_LINE:
-            /* Provide a 256-byte buffer */
-            pt[pt_index++] = 256;
-            pt[pt_index++] = 0; /* Request */
-            pt_index += 256 >> 2;
-            break;
+        index += ( t->pt[index + T_OVALUE_SIZE] >> 2 ) + 3;
+    }
 
-        case TAG_ALLOCATE_BUFFER:
-        case TAG_GET_MAX_CLOCK_RATE:
-        case TAG_GET_MIN_CLOCK_RATE:
-        case TAG_GET_CLOCK_RATE:
-            pt[pt_index++] = 8;
-            pt[pt_index++] = 0; /* Request */
-            pt[pt_index++] = va_arg( vl, int );
-            pt[pt_index++] = 0;
-            break;
+    t->index_end = index;
+}
 
-        case TAG_SET_CLOCK_RATE:
-            pt[pt_index++] = 12;
-            pt[pt_index++] = 0; /* Request */
-            pt[pt_index++] = va_arg( vl, int ); /* Clock ID */
-            pt[pt_index++] = va_arg( vl, int ); /* Rate (in Hz) */
-            pt[pt_index++] = va_arg( vl, int ); /* Skip turbo setting if == 1 */
-            break;
 
-        case TAG_GET_PHYSICAL_SIZE:
-        case TAG_SET_PHYSICAL_SIZE:
-        case TAG_TEST_PHYSICAL_SIZE:
-        case TAG_GET_VIRTUAL_SIZE:
-        case TAG_SET_VIRTUAL_SIZE:
-        case TAG_TEST_VIRTUAL_SIZE:
-        case TAG_GET_VIRTUAL_OFFSET:
-        case TAG_SET_VIRTUAL_OFFSET:
-            pt[pt_index++] = 8;
-            pt[pt_index++] = 0; /* Request */
-
-            if( ( tag == TAG_SET_PHYSICAL_SIZE ) ||
-                ( tag == TAG_SET_VIRTUAL_SIZE ) ||
-                ( tag == TAG_SET_VIRTUAL_OFFSET ) ||
-                ( tag == TAG_TEST_PHYSICAL_SIZE ) ||
-                ( tag == TAG_TEST_VIRTUAL_SIZE ) )
-            {
-                pt[pt_index++] = va_arg( vl, int ); /* Width */
-                pt[pt_index++] = va_arg( vl, int ); /* Height */
-            }
-            else
-            {
-                pt_index += 2;
-            }
-            break;
+/**
+    @brief Take every answer out of the mailbox and mark the transactions
+    they belong to as done. Runs in the interrupt handler or, with the
+    interrupt off, whenever somebody polls
+*/
+static void property_drain( void )
+{
+    unsigned int value;
+    int i;
 
-        case TAG_GET_ALPHA_MODE:
-        case TAG_SET_ALPHA_MODE:
-        case TAG_GET_DEPTH:
-        case TAG_SET_DEPTH:
-        case TAG_GET_PIXEL_ORDER:
-        case TAG_SET_PIXEL_ORDER:
-        case TAG_GET_PITCH:
-            pt[pt_index++] = 4;
-            pt[pt_index++] = 0; /* Request */
-
-            if( ( tag == TAG_SET_DEPTH ) ||
-                ( tag == TAG_SET_PIXEL_ORDER ) ||
-                ( tag == TAG_SET_ALPHA_MODE ) )
-            {
-                /* Colour Depth, bits-per-pixel \ Pixel Order State */
-                pt[pt_index++] = va_arg( vl, int );
-            }
-            else
-            {
-                pt_index += 1;
-            }
-            break;
+    while( RPI_Mailbox0TryRead( &value ) )
+    {
+        if( ( value & 0xF ) != MB0_TAGS_ARM_TO_VC )
+            continue;
 
-        case TAG_GET_OVERSCAN:
-        case TAG_SET_OVERSCAN:
-            pt[pt_index++] = 16;
-            pt[pt_index++] = 0; /* Request */
+        for( i = 0; i < RPI_PROPERTY_SLOTS + 1; i++ )
+        {
+            rpi_property_transaction_t* t = &transactions[i];
 
-            if( ( tag == TAG_SET_OVERSCAN ) )
+            if( ( t->state == PROPERTY_PENDING ) && ( t->bus == ( value & ~0xF ) ) )
             {
-                pt[pt_index++] = va_arg( vl, int ); /* Top pixels */
-                pt[pt_index++] = va_arg( vl, int ); /* Bottom pixels */
-                pt[pt_index++] = va_arg( vl, int ); /* Left pixels */
-                pt[pt_index++] = va_arg( vl, int ); /* Right pixels */
-            }
-            else
-            {
-                pt_index += 4;
+                /* The cache may have fetched the buffer again while the
+                   VideoCore was writing the answer */
+                RPI_CacheInvalidateRange( t->pt, t->pt_words * sizeof( int ) );
+
+                t->result = value >> 4;
+                property_index( t );
+
+                /* The answer is in the buffer before anybody sees DONE */
+                RPI_DMB();
+                t->state = PROPERTY_DONE;
+
+                if( t->complete )
+                    t->complete( t, t->args );
+
+                break;
             }
-            break;
+        }
+    }
+}
 
-        default:
-            /* Unsupported tags, just remove the tag from the list */
-            pt_index--;
+
+rpi_property_transaction_t* RPI_PropertyBegin( void )
+{
+    rpi_property_transaction_t* t = NULL;
+    int i;
+
+    IRQBlock();
+
+    for( i = 0; i < RPI_PROPERTY_SLOTS; i++ )
+    {
+        if( transactions[i].state == PROPERTY_FREE )
+        {
+            t = &transactions[i];
+            property_start( t, slotBuffers[i], RPI_PROPERTY_BUFFER_WORDS );
             break;
+        }
     }
 
-    /* Make sure the tags are 0 terminated to end the list and update the buffer size */
-    pt[pt_index] = 0;
+    IRQUnBlock();
 
-    va_end( vl );
+    return t;
 }
 
 
-int RPI_PropertyProcess( void )
+/**
+    @brief Hand the tag list to the VideoCore without waiting for the answer
+    @return false if the mailbox is full, the transaction can be submitted
+    again later
+*/
+bool RPI_PropertySubmit( rpi_property_transaction_t* t,
+                         rpi_property_complete_t complete, void* args )
 {
-    int result;
+    bool written;
 
-#if( PRINT_PROP_DEBUG == 1 )
-    printf( "%s Length: %d\r\n", __func__, pt[PT_OSIZE] );
-#endif
     /* Fill in the size of the buffer */
-    pt[PT_OSIZE] = ( pt_index + 1 ) << 2;
-    pt[PT_OREQUEST_OR_RESPONSE] = 0;
+    t->pt[PT_OSIZE] = ( t->pt_index + 1 ) << 2;
+    t->pt[PT_OREQUEST_OR_RESPONSE] = 0;
+
+    t->bus = RPI_MailboxToBus( t->pt );
+    t->complete = complete;
+    t->args = args;
 
+    /* The VideoCore reads the request from memory, not the ARM's cache */
+    RPI_CacheCleanRange( t->pt, t->pt_words * sizeof( int ) );
+
+    IRQBlock();
+
+    /* Pending before it is written, the answer can come back at once */
+    t->state = PROPERTY_PENDING;
+    RPI_DMB();
+
+    written = RPI_Mailbox0TryWrite( MB0_TAGS_ARM_TO_VC, t->bus );
+
+    if( !written )
+        t->state = PROPERTY_BUILDING;
+
+    IRQUnBlock();
+
+    return written;
+}
+
+
+/**
+    @brief Check whether the VideoCore has answered, never waits
+*/
+bool RPI_PropertyPoll( rpi_property_transaction_t* t )
+{
+    if( t->state == PROPERTY_PENDING )
+    {
+        IRQBlock();
+        property_drain();
+        IRQUnBlock();
+    }
+
+    return t->state == PROPERTY_DONE;
+}
+
+
+void RPI_PropertyRelease( rpi_property_transaction_t* t )
+{
+    t->state = PROPERTY_FREE;
+}
+
+
+void RPI_PropertyEnableIrq( void )
+{
+    RPI_Mailbox0EnableIrq( true );
+    RPI_EnableIrq( RPI_IRQ_ARM_MAILBOX );
+}
+
+
+/**
+    @brief The mailbox interrupt handler, register it for RPI_IRQ_ARM_MAILBOX.
+    Completion callbacks are called from here
+*/
+void RPI_PropertyIRQHandler( uint32_t irq, void* args )
+{
+    property_drain();
+}
+
+
+int RPI_PropertyProcess( void )
+{
 #if( PRINT_PROP_DEBUG == 1 )
-    for( i = 0; i < (pt[PT_OSIZE] >> 2); i++ )
+    int i;
+
+    printf( "%s Length: %d\r\n", __func__, ( legacy->pt_index + 1 ) << 2 );
+
+    for( i = 0; i < legacy->pt_index + 1; i++ )
         printf( "Request: %3d %8.8X\r\n", i, pt[i] );
 #endif
-    RPI_Mailbox0Write( MB0_TAGS_ARM_TO_VC, (unsigned int)pt );
+    /* The same round trip as the non-blocking interface, just waited for */
+    while( !RPI_PropertySubmit( legacy, NULL, NULL ) ) { }
 
-    result = RPI_Mailbox0Read( MB0_TAGS_ARM_TO_VC );
+    while( !RPI_PropertyPoll( legacy ) ) { }
 
 #if( PRINT_PROP_DEBUG == 1 )
     for( i = 0; i < (pt[PT_OSIZE] >> 2); i++ )
         printf( "Response: %3d %8.8X\r\n", i, pt[i] );
 #endif
-    return result;
+    return legacy->result;
 }
 
 
-rpi_mailbox_property_t* RPI_PropertyGet( rpi_mailbox_tag_t tag )
+/**
+    @brief Find a tag in an answer through its index
+    @return NULL if the tag isn't in the tag list
+*/
+static const rpi_mailbox_property_t* property_find( rpi_property_transaction_t* t,
+                                                    rpi_mailbox_tag_t tag )
 {
-    static rpi_mailbox_property_t property;
-    int* tag_buffer = NULL;
+    int words = t->pt[PT_OSIZE] >> 2;
+    int index;
+    int i;
 
-    property.tag = tag;
+    for( i = 0; i < t->index_count; i++ )
+    {
+        if( t->index[i].tag == tag )
+            return (const rpi_mailbox_property_t*)&t->pt[t->index[i].offset];
+    }
 
-    /* Get the tag from the buffer. Start at the first tag position  */
-    int index = 2;
+    /* Only a tag list longer than the index needs scanning */
+    index = t->index_end;
 
-    while( index < ( pt[PT_OSIZE] >> 2 ) )
+    while( ( index < words ) && ( t->pt[index] != 0 ) )
     {
-        /* printf( "Test Tag: [%d] %8.8X\r\n", index, pt[index] ); */
-        if( pt[index] == tag )
-        {
-            tag_buffer = &pt[index];
-            break;
-        }
+        if( t->pt[index] == tag )
+            return (const rpi_mailbox_property_t*)&t->pt[index];
 
-        /* Progress to the next tag if we haven't yet discovered the tag */
-        index += ( pt[index + 1] >> 2 ) + 3;
+        index += ( t->pt[index + T_OVALUE_SIZE] >> 2 ) + 3;
     }
 
-    /* Return NULL of the property tag cannot be found in the buffer */
-    if( tag_buffer == NULL )
+    return NULL;
+}
+
+
+const rpi_mailbox_property_t* RPI_PropertyGet( rpi_mailbox_tag_t tag )
+{
+    if( legacy->state != PROPERTY_DONE )
         return NULL;
 
-    /* Return the required data */
-    property.byte_length = tag_buffer[T_ORESPONSE] & 0xFFFF;
-    memcpy( property.data.buffer_8, &tag_buffer[T_OVALUE], property.byte_length );
+    return property_find( legacy, tag );
+}
+
+
+/**
+    @brief Find a tag in the answer to a transaction
+    @return NULL if the transaction hasn't been answered or has no such tag
+*/
+const rpi_mailbox_property_t* RPI_PropertyResult( rpi_property_transaction_t* t,
+                                                  rpi_mailbox_tag_t tag )
+{
+    if( t->state != PROPERTY_DONE )
+        return NULL;
 
-    return &property;
+    return property_find( t, tag );
 }
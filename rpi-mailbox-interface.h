@@ -31,94 +31,136 @@
 #ifndef RPI_MAILBOX_INTERFACE_H
 #define RPI_MAILBOX_INTERFACE_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Tag buffers that can be in flight at once, each of
+    RPI_PROPERTY_BUFFER_WORDS words. The legacy RPI_PropertyInit/Process
+    buffer is in addition to these.
+
+    The largest list built is the framebuffer setup, 31 words, and the
+    largest single tag anybody asks for is GET_CLOCKS or GET_COMMAND_LINE,
+    70 words with the buffer header and terminator. 80 makes every buffer a
+    whole number of cache lines, so cleaning or invalidating one never
+    touches its neighbour. Every tag in RPI_PROPERTY_TAGS is checked to fit
+    when rpi-mailbox-interface.c is compiled */
+#define RPI_PROPERTY_SLOTS          4
+#define RPI_PROPERTY_BUFFER_WORDS   80
+
+/** @brief Tags per answer that are found without scanning the buffer */
+#define RPI_PROPERTY_INDEX_SZ       16
+
 /**
-    @brief An enum of the RPI->Videocore firmware mailbox property interface
-    properties. Further details are available from
+    @brief Every RPI->Videocore firmware mailbox property interface property
+    with the number of 32-bit request arguments it takes and the size of its
+    answer in bytes, rounded up to a whole word. Further details are
+    available from
     https://github.com/raspberrypi/firmware/wiki/Mailbox-property-interface
+
+    The tag enum, the descriptor table and the RPI_PropertyAdd_<tag>
+    builders are all generated from this list. The palette tags are left
+    out, at 256 entries they're bigger than a whole tag buffer
 */
-typedef enum {
-    /* Videocore */
-    TAG_GET_FIRMWARE_VERSION = 0x1,
-
-    /* Hardware */
-    TAG_GET_BOARD_MODEL = 0x10001,
-    TAG_GET_BOARD_REVISION,
-    TAG_GET_BOARD_MAC_ADDRESS,
-    TAG_GET_BOARD_SERIAL,
-    TAG_GET_ARM_MEMORY,
-    TAG_GET_VC_MEMORY,
-    TAG_GET_CLOCKS,
-
-    /* Config */
-    TAG_GET_COMMAND_LINE = 0x50001,
-
-    /* Shared resource management */
-    TAG_GET_DMA_CHANNELS = 0x60001,
-
-    /* Power */
-    TAG_GET_POWER_STATE = 0x20001,
-    TAG_GET_TIMING,
-    TAG_SET_POWER_STATE = 0x28001,
-
-    /* Clocks */
-    TAG_GET_CLOCK_STATE = 0x30001,
-    TAG_SET_CLOCK_STATE = 0x38001,
-    TAG_GET_CLOCK_RATE = 0x30002,
-    TAG_SET_CLOCK_RATE = 0x38002,
-    TAG_GET_MAX_CLOCK_RATE = 0x30004,
-    TAG_GET_MIN_CLOCK_RATE = 0x30007,
-    TAG_GET_TURBO = 0x30009,
-    TAG_SET_TURBO = 0x38009,
-
-    /* Voltage */
-    TAG_GET_VOLTAGE = 0x30003,
-    TAG_SET_VOLTAGE = 0x38003,
-    TAG_GET_MAX_VOLTAGE = 0x30005,
-    TAG_GET_MIN_VOLTAGE = 0x30008,
-    TAG_GET_TEMPERATURE = 0x30006,
-    TAG_GET_MAX_TEMPERATURE = 0x3000A,
-    TAG_ALLOCATE_MEMORY = 0x3000C,
-    TAG_LOCK_MEMORY = 0x3000D,
-    TAG_UNLOCK_MEMORY = 0x3000E,
-    TAG_RELEASE_MEMORY = 0x3000F,
-    TAG_EXECUTE_CODE = 0x30010,
-    TAG_GET_DISPMANX_MEM_HANDLE = 0x30014,
-    TAG_GET_EDID_BLOCK = 0x30020,
-
-    /* Framebuffer */
-    TAG_ALLOCATE_BUFFER = 0x40001,
-    TAG_RELEASE_BUFFER = 0x48001,
-    TAG_BLANK_SCREEN = 0x40002,
-    TAG_GET_PHYSICAL_SIZE = 0x40003,
-    TAG_TEST_PHYSICAL_SIZE = 0x44003,
-    TAG_SET_PHYSICAL_SIZE = 0x48003,
-    TAG_GET_VIRTUAL_SIZE = 0x40004,
-    TAG_TEST_VIRTUAL_SIZE = 0x44004,
-    TAG_SET_VIRTUAL_SIZE = 0x48004,
-    TAG_GET_DEPTH = 0x40005,
-    TAG_TEST_DEPTH = 0x44005,
-    TAG_SET_DEPTH = 0x48005,
-    TAG_GET_PIXEL_ORDER = 0x40006,
-    TAG_TEST_PIXEL_ORDER = 0x44006,
-    TAG_SET_PIXEL_ORDER = 0x48006,
-    TAG_GET_ALPHA_MODE = 0x40007,
-    TAG_TEST_ALPHA_MODE = 0x44007,
-    TAG_SET_ALPHA_MODE = 0x48007,
-    TAG_GET_PITCH = 0x40008,
-    TAG_GET_VIRTUAL_OFFSET = 0x40009,
-    TAG_TEST_VIRTUAL_OFFSET = 0x44009,
-    TAG_SET_VIRTUAL_OFFSET = 0x48009,
-    TAG_GET_OVERSCAN = 0x4000A,
-    TAG_TEST_OVERSCAN = 0x4400A,
-    TAG_SET_OVERSCAN = 0x4800A,
-    TAG_GET_PALETTE = 0x4000B,
-    TAG_TEST_PALETTE = 0x4400B,
-    TAG_SET_PALETTE = 0x4800B,
-    TAG_SET_CURSOR_INFO = 0x8011,
-    TAG_SET_CURSOR_STATE = 0x8010
+#define RPI_PROPERTY_TAGS( X ) \
+    /* Videocore */ \
+    X( GET_FIRMWARE_VERSION,        0x00001, 0, 4 ) \
+    \
+    /* Hardware */ \
+    X( GET_BOARD_MODEL,             0x10001, 0, 4 ) \
+    X( GET_BOARD_REVISION,          0x10002, 0, 4 ) \
+    X( GET_BOARD_MAC_ADDRESS,       0x10003, 0, 8 ) \
+    X( GET_BOARD_SERIAL,            0x10004, 0, 8 ) \
+    X( GET_ARM_MEMORY,              0x10005, 0, 8 ) \
+    X( GET_VC_MEMORY,               0x10006, 0, 8 ) \
+    X( GET_CLOCKS,                  0x10007, 0, 256 ) \
+    \
+    /* Config */ \
+    X( GET_COMMAND_LINE,            0x50001, 0, 256 ) \
+    \
+    /* Shared resource management */ \
+    X( GET_DMA_CHANNELS,            0x60001, 0, 4 ) \
+    \
+    /* Power */ \
+    X( GET_POWER_STATE,             0x20001, 1, 8 ) \
+    X( GET_TIMING,                  0x20002, 1, 8 ) \
+    X( SET_POWER_STATE,             0x28001, 2, 8 ) \
+    \
+    /* Clocks */ \
+    X( GET_CLOCK_STATE,             0x30001, 1, 8 ) \
+    X( SET_CLOCK_STATE,             0x38001, 2, 8 ) \
+    X( GET_CLOCK_RATE,              0x30002, 1, 8 ) \
+    X( SET_CLOCK_RATE,              0x38002, 3, 8 ) \
+    X( GET_MAX_CLOCK_RATE,          0x30004, 1, 8 ) \
+    X( GET_MIN_CLOCK_RATE,          0x30007, 1, 8 ) \
+    X( GET_TURBO,                   0x30009, 1, 8 ) \
+    X( SET_TURBO,                   0x38009, 2, 8 ) \
+    \
+    /* Voltage */ \
+    X( GET_VOLTAGE,                 0x30003, 1, 8 ) \
+    X( SET_VOLTAGE,                 0x38003, 2, 8 ) \
+    X( GET_MAX_VOLTAGE,             0x30005, 1, 8 ) \
+    X( GET_MIN_VOLTAGE,             0x30008, 1, 8 ) \
+    X( GET_TEMPERATURE,             0x30006, 1, 8 ) \
+    X( GET_MAX_TEMPERATURE,         0x3000A, 1, 8 ) \
+    X( ALLOCATE_MEMORY,             0x3000C, 3, 4 ) \
+    X( LOCK_MEMORY,                 0x3000D, 1, 4 ) \
+    X( UNLOCK_MEMORY,               0x3000E, 1, 4 ) \
+    X( RELEASE_MEMORY,              0x3000F, 1, 4 ) \
+    X( EXECUTE_CODE,                0x30010, 7, 4 ) \
+    X( GET_DISPMANX_MEM_HANDLE,     0x30014, 1, 8 ) \
+    X( GET_EDID_BLOCK,              0x30020, 1, 136 ) \
+    \
+    /* Framebuffer */ \
+    X( ALLOCATE_BUFFER,             0x40001, 1, 8 ) \
+    X( RELEASE_BUFFER,              0x48001, 0, 0 ) \
+    X( BLANK_SCREEN,                0x40002, 1, 4 ) \
+    X( GET_PHYSICAL_SIZE,           0x40003, 0, 8 ) \
+    X( TEST_PHYSICAL_SIZE,          0x44003, 2, 8 ) \
+    X( SET_PHYSICAL_SIZE,           0x48003, 2, 8 ) \
+    X( GET_VIRTUAL_SIZE,            0x40004, 0, 8 ) \
+    X( TEST_VIRTUAL_SIZE,           0x44004, 2, 8 ) \
+    X( SET_VIRTUAL_SIZE,            0x48004, 2, 8 ) \
+    X( GET_DEPTH,                   0x40005, 0, 4 ) \
+    X( TEST_DEPTH,                  0x44005, 1, 4 ) \
+    X( SET_DEPTH,                   0x48005, 1, 4 ) \
+    X( GET_PIXEL_ORDER,             0x40006, 0, 4 ) \
+    X( TEST_PIXEL_ORDER,            0x44006, 1, 4 ) \
+    X( SET_PIXEL_ORDER,             0x48006, 1, 4 ) \
+    X( GET_ALPHA_MODE,              0x40007, 0, 4 ) \
+    X( TEST_ALPHA_MODE,             0x44007, 1, 4 ) \
+    X( SET_ALPHA_MODE,              0x48007, 1, 4 ) \
+    X( GET_PITCH,                   0x40008, 0, 4 ) \
+    X( GET_VIRTUAL_OFFSET,          0x40009, 0, 8 ) \
+    X( TEST_VIRTUAL_OFFSET,         0x44009, 2, 8 ) \
+    X( SET_VIRTUAL_OFFSET,          0x48009, 2, 8 ) \
+    X( GET_OVERSCAN,                0x4000A, 0, 16 ) \
+    X( TEST_OVERSCAN,               0x4400A, 4, 16 ) \
+    X( SET_OVERSCAN,                0x4800A, 4, 16 ) \
+    X( SET_VSYNC,                   0x4800E, 1, 4 ) \
+    X( SET_CURSOR_INFO,             0x08011, 6, 4 ) \
+    X( SET_CURSOR_STATE,            0x08010, 4, 16 )
+
+/* The value buffer of a tag has to hold both the request and the answer */
+#define RPI_PROPERTY_VALUE_SIZE( args, response ) \
+    ( ( (args) * 4 ) > (response) ? ( (args) * 4 ) : (response) )
+
+#define RPI_PROPERTY_ENUM( name, id, args, response )   TAG_##name = id,
 
+typedef enum {
+    RPI_PROPERTY_TAGS( RPI_PROPERTY_ENUM )
     } rpi_mailbox_tag_t;
 
+/** @brief What the descriptor table knows about a tag */
+typedef struct {
+    int tag;
+    uint16_t value_size;
+    uint8_t args;
+    } rpi_property_tag_desc_t;
+
+extern const rpi_property_tag_desc_t RPI_PropertyTagTable[];
+extern const int RPI_PropertyTagCount;
+extern const rpi_property_tag_desc_t* RPI_PropertyTagDesc( rpi_mailbox_tag_t tag );
+
 
 typedef enum {
     TAG_STATE_REQUEST = 0,
@@ -138,9 +180,14 @@ typedef enum {
     T_OVALUE = 3,
     } rpi_tag_offset_t;
 
+/** @brief A tag as it sits in the tag buffer. Lookups return a pointer
+    straight into the answer, valid until that buffer is built again */
 typedef struct {
     int tag;
-    int byte_length;
+    int value_size;
+    /** Bit 31 is set once the VideoCore has answered, the rest is the length
+        of the value it wrote, see RPI_PropertyLength */
+    int response;
     union {
         int value_32;
         unsigned char buffer_8[256];
@@ -148,6 +195,11 @@ typedef struct {
     } data;
     } rpi_mailbox_property_t;
 
+static inline int RPI_PropertyLength( const rpi_mailbox_property_t* mp )
+{
+    return mp->response & 0xFFFF;
+}
+
 typedef enum {
     TAG_CLOCK_RESERVED = 0,
     TAG_CLOCK_EMMC,
@@ -162,9 +214,161 @@ typedef enum {
     TAG_CLOCK_PWM,
     } rpi_tag_clock_id_t;
 
-extern void RPI_PropertyInit( void );
+typedef enum {
+    PROPERTY_FREE = 0,
+    PROPERTY_BUILDING,
+    PROPERTY_PENDING,
+    PROPERTY_DONE,
+    } rpi_property_state_t;
+
+typedef struct rpi_property_transaction_s rpi_property_transaction_t;
+
+/** @brief Called from the mailbox interrupt handler when the VideoCore has
+    answered a transaction */
+typedef void (*rpi_property_complete_t)( rpi_property_transaction_t* t, void* args );
+
+/** @brief One tag buffer and where it is in its round trip to the VideoCore */
+struct rpi_property_transaction_s {
+    int* pt;
+    int pt_index;
+    int pt_words;
+    /** What was written to the mailbox, the answer comes back the same */
+    unsigned int bus;
+    int result;
+    volatile rpi_property_state_t state;
+    rpi_property_complete_t complete;
+    void* args;
+    /** Where the first tags of the answer start, built once when it arrives.
+        index_end is where a scan for any further tags has to start */
+    struct {
+        int tag;
+        int offset;
+        } index[RPI_PROPERTY_INDEX_SZ];
+    int index_count;
+    int index_end;
+    };
+
+/* The blocking interface, one tag list at a time. RPI_PropertyInit returns
+   the transaction it is built in for the RPI_PropertyAdd_<tag> builders */
+extern rpi_property_transaction_t* RPI_PropertyInit( void );
 extern void RPI_PropertyAddTag( rpi_mailbox_tag_t tag, ... );
 extern int RPI_PropertyProcess( void );
-extern rpi_mailbox_property_t* RPI_PropertyGet( rpi_mailbox_tag_t tag );
+extern const rpi_mailbox_property_t* RPI_PropertyGet( rpi_mailbox_tag_t tag );
+
+/* The non-blocking interface. Begin takes a free buffer (NULL if they are
+   all busy), Submit hands it to the VideoCore and returns straight away
+   (false if the mailbox is full, try again later), Poll says whether the
+   answer is back and Release gives the buffer back */
+extern rpi_property_transaction_t* RPI_PropertyBegin( void );
+extern void RPI_PropertyAdd( rpi_property_transaction_t* t, rpi_mailbox_tag_t tag, ... );
+extern bool RPI_PropertySubmit( rpi_property_transaction_t* t,
+                                rpi_property_complete_t complete, void* args );
+extern bool RPI_PropertyPoll( rpi_property_transaction_t* t );
+extern const rpi_mailbox_property_t* RPI_PropertyResult( rpi_property_transaction_t* t,
+                                                         rpi_mailbox_tag_t tag );
+extern void RPI_PropertyRelease( rpi_property_transaction_t* t );
+
+/* Answers are picked up by Poll, or as soon as they arrive once the
+   mailbox interrupt is enabled and RPI_PropertyIRQHandler is registered
+   for RPI_IRQ_ARM_MAILBOX */
+extern void RPI_PropertyEnableIrq( void );
+extern void RPI_PropertyIRQHandler( uint32_t irq, void* args );
+
+
+/**
+    @brief Make room for a tag at the end of a tag list and fill in its
+    header
+    @return The tag's value buffer, NULL if the list is full
+*/
+static inline int* RPI_PropertyReserve( rpi_property_transaction_t* t, int tag, int value_size )
+{
+    int* p = &t->pt[t->pt_index];
+    int words = 3 + ( value_size >> 2 );
+
+    if( t->pt_index + words + 1 > t->pt_words )
+        return NULL;
+
+    p[T_OIDENT] = tag;
+    p[T_OVALUE_SIZE] = value_size;
+    p[T_ORESPONSE] = 0; /* Request */
+
+    /* Keep the list 0 terminated */
+    t->pt_index += words;
+    t->pt[t->pt_index] = 0;
+
+    return &p[T_OVALUE];
+}
+
+/* A builder for every tag, RPI_PropertyAdd_<tag>( t, arguments ), taking
+   exactly the arguments the tag needs. Each returns the tag's value buffer
+   for tags with variable length data, or NULL if the list is full */
+#define RPI_PROPERTY_BUILDER_HEAD( name, args, response ) \
+    int* v = RPI_PropertyReserve( t, TAG_##name, RPI_PROPERTY_VALUE_SIZE( args, response ) );
+
+#define RPI_PROPERTY_BUILDER_0( name, response ) \
+    static inline int* RPI_PropertyAdd_##name( rpi_property_transaction_t* t ) \
+    { \
+        return RPI_PropertyReserve( t, TAG_##name, RPI_PROPERTY_VALUE_SIZE( 0, response ) ); \
+    }
+
+#define RPI_PROPERTY_BUILDER_1( name, response ) \
+    static inline int* RPI_PropertyAdd_##name( rpi_property_transaction_t* t, uint32_t a0 ) \
+    { \
+        RPI_PROPERTY_BUILDER_HEAD( name, 1, response ) \
+        if( v ) { v[0] = a0; } \
+        return v; \
+    }
+
+#define RPI_PROPERTY_BUILDER_2( name, response ) \
+    static inline int* RPI_PropertyAdd_##name( rpi_property_transaction_t* t, uint32_t a0, \
+                                               uint32_t a1 ) \
+    { \
+        RPI_PROPERTY_BUILDER_HEAD( name, 2, response ) \
+        if( v ) { v[0] = a0; v[1] = a1; } \
+        return v; \
+    }
+
+#define RPI_PROPERTY_BUILDER_3( name, response ) \
+    static inline int* RPI_PropertyAdd_##name( rpi_property_transaction_t* t, uint32_t a0, \
+                                               uint32_t a1, uint32_t a2 ) \
+    { \
+        RPI_PROPERTY_BUILDER_HEAD( name, 3, response ) \
+        if( v ) { v[0] = a0; v[1] = a1; v[2] = a2; } \
+        return v; \
+    }
+
+#define RPI_PROPERTY_BUILDER_4( name, response ) \
+    static inline int* RPI_PropertyAdd_##name( rpi_property_transaction_t* t, uint32_t a0, \
+                                               uint32_t a1, uint32_t a2, uint32_t a3 ) \
+    { \
+        RPI_PROPERTY_BUILDER_HEAD( name, 4, response ) \
+        if( v ) { v[0] = a0; v[1] = a1; v[2] = a2; v[3] = a3; } \
+        return v; \
+    }
+
+#define RPI_PROPERTY_BUILDER_6( name, response ) \
+    static inline int* RPI_PropertyAdd_##name( rpi_property_transaction_t* t, uint32_t a0, \
+                                               uint32_t a1, uint32_t a2, uint32_t a3, \
+                                               uint32_t a4, uint32_t a5 ) \
+    { \
+        RPI_PROPERTY_BUILDER_HEAD( name, 6, response ) \
+        if( v ) { v[0] = a0; v[1] = a1; v[2] = a2; v[3] = a3; v[4] = a4; v[5] = a5; } \
+        return v; \
+    }
+
+#define RPI_PROPERTY_BUILDER_7( name, response ) \
+    static inline int* RPI_PropertyAdd_##name( rpi_property_transaction_t* t, uint32_t a0, \
+                                               uint32_t a1, uint32_t a2, uint32_t a3, \
+                                               uint32_t a4, uint32_t a5, uint32_t a6 ) \
+    { \
+        RPI_PROPERTY_BUILDER_HEAD( name, 7, response ) \
+        if( v ) { v[0] = a0; v[1] = a1; v[2] = a2; v[3] = a3; v[4] = a4; v[5] = a5; v[6] = a6; } \
+        return v; \
+    }
+
+#define RPI_PROPERTY_BUILDER( name, id, args, response ) \
+    RPI_PROPERTY_BUILDER_##args( name, response )
+
+RPI_PROPERTY_TAGS( RPI_PROPERTY_BUILDER )
 
 #endif
@@ -33,6 +33,14 @@
 #include "rpi-gpio.h"
 #include "rpi-mailbox.h"
 
+/* The uncached alias on the RPi2, whose ARM doesn't go through the
+   VideoCore's L2. The BCM2835's ARM does, so it uses the L2 coherent one */
+#if defined( RPI2 )
+    #define RPI_MAILBOX_BUS_ALIAS   0xC0000000
+#else
+    #define RPI_MAILBOX_BUS_ALIAS   0x40000000
+#endif
+
 /* Mailbox 0 mapped to it's base address */
 static mailbox_t* rpiMailbox0 = (mailbox_t*)RPI_MAILBOX0_BASE;
 
@@ -75,3 +83,56 @@ int RPI_Mailbox0Read( mailbox0_channel_t channel )
     /* Return just the value (the upper 28-bits) */
     return value >> 4;
 }
+
+
+/**
+    @brief Write to the mailbox unless it is full
+    @return true if the value was written
+*/
+bool RPI_Mailbox0TryWrite( mailbox0_channel_t channel, unsigned int value )
+{
+    if( rpiMailbox0->Status & ARM_MS_FULL )
+        return false;
+
+    rpiMailbox0->Write = ( value & ~0xF ) | channel;
+
+    return true;
+}
+
+
+/**
+    @brief Take the next value out of the mailbox, whatever channel it is for
+    @return false if the mailbox is empty
+*/
+bool RPI_Mailbox0TryRead( unsigned int* value )
+{
+    if( rpiMailbox0->Status & ARM_MS_EMPTY )
+        return false;
+
+    *value = rpiMailbox0->Read;
+
+    return true;
+}
+
+
+void RPI_Mailbox0EnableIrq( bool enable )
+{
+    rpiMailbox0->Configuration = enable ? ARM_MC_IHAVEDATAIRQEN : 0;
+}
+
+
+unsigned int RPI_MailboxToBus( void* buffer )
+{
+    /* Buffers are cleaned out of the ARM's cache before they're handed over,
+       so the VideoCore is pointed at them through an alias that doesn't
+       keep its own stale copy in the L2 */
+    return (unsigned int)buffer | RPI_MAILBOX_BUS_ALIAS;
+}
+
+
+void* RPI_MailboxFromBus( unsigned int address )
+{
+    /* The VideoCore returns addresses through one of its cache aliases, the
+       top two bits select the alias and aren't part of the ARM address */
+    return (void*)( address & 0x3FFFFFFF );
+}
@@ -31,6 +31,9 @@
 #ifndef RPI_MAILBOX_H
 #define RPI_MAILBOX_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "rpi-base.h"
 
 #define RPI_MAILBOX0_BASE    ( PERIPHERAL_BASE + 0xB880 )
@@ -59,6 +62,12 @@ enum mailbox_status_reg_bits {
     ARM_MS_LEVEL = 0x400000FF,
 };
 
+/* Configuration register bits. With DATA set the mailbox raises
+   RPI_IRQ_ARM_MAILBOX for as long as there is something to read */
+enum mailbox_config_reg_bits {
+    ARM_MC_IHAVEDATAIRQEN = 0x00000001,
+};
+
 /* Define a structure which defines the register access to a mailbox.
    Not all mailboxes support the full register set! */
 typedef struct {
@@ -74,4 +83,82 @@ typedef struct {
 extern void RPI_Mailbox0Write( mailbox0_channel_t channel, int value );
 extern int RPI_Mailbox0Read( mailbox0_channel_t channel );
 
+/* Non-blocking access for interrupt driven users. The raw value keeps the
+   channel number in its bottom four bits */
+extern bool RPI_Mailbox0TryWrite( mailbox0_channel_t channel, unsigned int value );
+extern bool RPI_Mailbox0TryRead( unsigned int* value );
+extern void RPI_Mailbox0EnableIrq( bool enable );
+
+/* Convert between ARM pointers and the 32-bit addresses passed through the
+   mailbox. On the host build pointers don't fit, so the fake VideoCore in
+   rpi-mailbox-host.c hands out handles instead */
+extern unsigned int RPI_MailboxToBus( void* buffer );
+extern void* RPI_MailboxFromBus( unsigned int address );
+
+#if defined( RPI_HOST )
+
+/* Latency that makes the fake VideoCore never answer a request */
+#define RPI_MAILBOX_HOST_NEVER  0xFFFFFFFF
+
+/** @brief Statistics kept by the fake VideoCore */
+typedef struct {
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t dropped;
+    /** Status reads made while waiting, each one costs a microsecond */
+    uint32_t polls;
+    } rpi_mailbox_host_stats_t;
+
+/* Clock ids 0 to TAG_CLOCK_PWM */
+#define RPI_MAILBOX_HOST_CLOCKS 11
+
+/** @brief One clock of the fake VideoCore, a max_rate of 0 means it
+    doesn't exist and the tags asking about it go unanswered */
+typedef struct {
+    uint32_t rate;
+    uint32_t min_rate;
+    uint32_t max_rate;
+    uint32_t on;
+    } rpi_mailbox_host_clock_t;
+
+/** @brief The board the fake VideoCore pretends to be. It starts out as a
+    Pi 2 Model B with 64MB given to the GPU */
+typedef struct {
+    uint32_t firmware_version;
+    uint32_t board_model;
+    uint32_t board_revision;
+    uint8_t mac_address[6];
+    uint32_t serial[2];
+    /** Base address and size of the ARM's and the VideoCore's memory. The
+        framebuffer is allocated from the VideoCore's */
+    uint32_t arm_memory[2];
+    uint32_t vc_memory[2];
+    rpi_mailbox_host_clock_t clocks[RPI_MAILBOX_HOST_CLOCKS];
+    /** Thousandths of a degree C */
+    uint32_t temperature;
+    /** How long an unscripted request takes, a fixed cost plus a cost for
+        every tag in the buffer. Both are 0 to begin with */
+    uint32_t request_us;
+    uint32_t tag_us;
+    /** The display's refresh period. A request with SET_VSYNC in it isn't
+        answered before the next vblank, which comes every refresh_us from
+        time 0. It's 0 to begin with, no display and no wait */
+    uint32_t refresh_us;
+    } rpi_mailbox_host_model_t;
+
+/* Script the fake VideoCore. Successive requests are answered after the
+   given number of microseconds of virtual time, once the script runs out
+   they take as long as the model says. Time moves on with
+   RPI_MailboxHostAdvance and with every status read */
+extern void RPI_MailboxHostScript( const uint32_t* latency_us, uint32_t count );
+extern void RPI_MailboxHostAdvance( uint32_t us );
+extern uint64_t RPI_MailboxHostTime( void );
+extern rpi_mailbox_host_stats_t* RPI_MailboxHostStats( void );
+
+/* The model can be changed at any time, answers already given stay as
+   they were */
+extern rpi_mailbox_host_model_t* RPI_MailboxHostModel( void );
+
+#endif
+
 #endif
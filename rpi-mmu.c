@@ -0,0 +1,272 @@
+/* Identity mapped first level translation table. The ARM's RAM is cached
+   write-back, the peripherals are device memory, the VideoCore's RAM is
+   left unmapped apart from whatever is remapped later, normally the
+   framebuffer as write-combining. Everything is done with 1MB sections */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "rpi-base.h"
+#include "rpi-cache.h"
+#include "rpi-mailbox-interface.h"
+#include "rpi-mmu.h"
+#include "rpi-property-cache.h"
+#include "rpi-smp.h"
+
+/* Everything from PERIPHERAL_BASE that the BCM283x decodes */
+#define PERIPHERAL_SIZE         0x01000000UL
+
+/* Client access to domain 0, the only one used. The sections' access
+   permissions are checked */
+#define DACR_DOMAIN0_CLIENT     0x00000001
+
+#define SCTLR_MMU               0x00000001
+#define SCTLR_DATA_CACHE        0x00000004
+#define SCTLR_BRANCH_PREDICTION 0x00000800
+#define SCTLR_INSTRUCTION_CACHE 0x00001000
+#define SCTLR_EXTENDED_PAGES    0x00800000
+
+/* Takes part in coherency with the other cores, set before the caches */
+#define ACTLR_SMP               0x00000040
+
+#define SECTION_BASE_MASK       0xFFF00000UL
+#define SECTION_TYPE_MASK       0x00000003UL
+#define SECTION_ATTR_MASK       ( RPI_MMU_TEX( 7 ) | RPI_MMU_C | RPI_MMU_B )
+
+static uint32_t rpiMmuTable[RPI_MMU_TABLE_ENTRIES] __attribute__((aligned(RPI_MMU_TABLE_ALIGN)));
+static int mmuEnabled = 0;
+
+
+/**
+    @brief The section entry mapping the 1MB containing address to itself
+*/
+uint32_t RPI_MmuSection( uint32_t address, rpi_mmu_memory_t type )
+{
+    uint32_t entry = ( address & SECTION_BASE_MASK ) | RPI_MMU_SECTION | RPI_MMU_AP_FULL;
+
+    switch( type )
+    {
+        case RPI_MMU_WRITE_BACK:
+            return entry | RPI_MMU_TEX( 1 ) | RPI_MMU_C | RPI_MMU_B | RPI_MMU_SHARED;
+
+        case RPI_MMU_WRITE_COMBINE:
+            return entry | RPI_MMU_TEX( 1 ) | RPI_MMU_SHARED;
+
+        case RPI_MMU_DEVICE:
+            return entry | RPI_MMU_B | RPI_MMU_XN;
+
+        case RPI_MMU_STRONGLY_ORDERED:
+            return entry | RPI_MMU_XN;
+
+        default:
+            return 0;
+    }
+}
+
+
+/**
+    @brief Map every section the range touches as type, a range that
+    doesn't start or end on a section boundary is rounded out to one
+*/
+void RPI_MmuMapRange( uint32_t* table, uint32_t base, uint32_t size, rpi_mmu_memory_t type )
+{
+    uint32_t first, last, i;
+
+    if( size == 0 )
+        return;
+
+    first = base >> RPI_MMU_SECTION_SHIFT;
+    last = (uint32_t)( ( (uint64_t)base + size - 1 ) >> RPI_MMU_SECTION_SHIFT );
+
+    if( last >= RPI_MMU_TABLE_ENTRIES )
+        last = RPI_MMU_TABLE_ENTRIES - 1;
+
+    for( i = first; i <= last; i++ )
+        table[i] = RPI_MmuSection( i << RPI_MMU_SECTION_SHIFT, type );
+}
+
+
+/**
+    @brief Fill a whole table for the layout. The peripherals go in last so
+    RAM reported past PERIPHERAL_BASE can't make them cacheable
+*/
+void RPI_MmuBuildTable( uint32_t* table, const rpi_mmu_layout_t* layout )
+{
+    memset( table, 0, RPI_MMU_TABLE_ENTRIES * sizeof( uint32_t ) );
+
+    RPI_MmuMapRange( table, layout->ram_base, layout->ram_size, RPI_MMU_WRITE_BACK );
+    RPI_MmuMapRange( table, PERIPHERAL_BASE, PERIPHERAL_SIZE, RPI_MMU_DEVICE );
+
+#if defined( RPI2 )
+    RPI_MmuMapRange( table, RPI_LOCAL_PERIPHERAL_BASE, RPI_MMU_SECTION_SIZE, RPI_MMU_DEVICE );
+#endif
+}
+
+
+/**
+    @brief What address is mapped as in table, entries that weren't made
+    by RPI_MmuSection read as strongly ordered
+*/
+rpi_mmu_memory_t RPI_MmuLookup( const uint32_t* table, uint32_t address )
+{
+    uint32_t entry = table[address >> RPI_MMU_SECTION_SHIFT];
+
+    if( ( entry & SECTION_TYPE_MASK ) != RPI_MMU_SECTION )
+        return RPI_MMU_FAULT;
+
+    switch( entry & SECTION_ATTR_MASK )
+    {
+        case RPI_MMU_TEX( 1 ) | RPI_MMU_C | RPI_MMU_B:
+            return RPI_MMU_WRITE_BACK;
+
+        case RPI_MMU_TEX( 1 ):
+            return RPI_MMU_WRITE_COMBINE;
+
+        case RPI_MMU_B:
+            return RPI_MMU_DEVICE;
+
+        default:
+            return RPI_MMU_STRONGLY_ORDERED;
+    }
+}
+
+
+#if defined( RPI_HOST )
+
+/* The table is built the same way on host builds so it can be checked and
+   timed there, there's just nothing to turn on */
+static void mmu_enable( uint32_t* table ) { }
+static void mmu_sync( uint32_t first, uint32_t last ) { }
+
+#else
+
+static void mmu_enable( uint32_t* table )
+{
+    uint32_t sctlr;
+
+    /* The MMU has been off, so nothing has been allocated into the data
+       cache. The ARM1176 is told to throw away both caches anyway, the
+       Cortex-A7 invalidates them itself when it comes out of reset and
+       only the instruction cache needs to go */
+#if defined( RPI2 )
+    __asm volatile( "mcr p15, 0, %0, c7, c5, 0" : : "r" (0) );
+#else
+    __asm volatile( "mcr p15, 0, %0, c7, c7, 0" : : "r" (0) );
+#endif
+
+    /* Invalidate the TLBs, then domain 0 only, TTBR0 only and the table
+       walks go to memory rather than through the cache */
+    __asm volatile( "mcr p15, 0, %0, c8, c7, 0" : : "r" (0) );
+    __asm volatile( "mcr p15, 0, %0, c3, c0, 0" : : "r" (DACR_DOMAIN0_CLIENT) );
+    __asm volatile( "mcr p15, 0, %0, c2, c0, 2" : : "r" (0) );
+    __asm volatile( "mcr p15, 0, %0, c2, c0, 0" : : "r" (table) : "memory" );
+    RPI_DSB();
+    RPI_ISB();
+
+#if defined( RPI2 )
+    /* The firmware's stub normally sets this already. Where it isn't
+       allowed to be changed from here the write is ignored */
+    __asm volatile( "mrc p15, 0, %0, c1, c0, 1" : "=r" (sctlr) );
+    __asm volatile( "mcr p15, 0, %0, c1, c0, 1" : : "r" (sctlr | ACTLR_SMP) );
+    RPI_ISB();
+#endif
+
+    /* The ARM1176 needs XP set to use the ARMv6 descriptors with TEX and
+       XN, on the Cortex-A7 it always reads as one */
+    __asm volatile( "mrc p15, 0, %0, c1, c0, 0" : "=r" (sctlr) );
+    sctlr |= SCTLR_MMU | SCTLR_DATA_CACHE | SCTLR_INSTRUCTION_CACHE |
+             SCTLR_BRANCH_PREDICTION | SCTLR_EXTENDED_PAGES;
+    __asm volatile( "mcr p15, 0, %0, c1, c0, 0" : : "r" (sctlr) : "memory" );
+    RPI_ISB();
+}
+
+static void mmu_sync( uint32_t first, uint32_t last )
+{
+    /* The table lives in write-back memory but isn't walked through the
+       cache, so the changed entries are cleaned out to RAM before the old
+       translations are dropped */
+    RPI_CacheCleanRange( &rpiMmuTable[first], ( last - first + 1 ) * sizeof( uint32_t ) );
+
+    /* Every core shares the table, so on the RPi2 the TLBs and branch
+       predictors of all of them are invalidated */
+#if defined( RPI2 )
+    __asm volatile( "mcr p15, 0, %0, c8, c3, 0" : : "r" (0) );
+    __asm volatile( "mcr p15, 0, %0, c7, c1, 6" : : "r" (0) );
+#else
+    __asm volatile( "mcr p15, 0, %0, c8, c7, 0" : : "r" (0) );
+    __asm volatile( "mcr p15, 0, %0, c7, c5, 6" : : "r" (0) );
+#endif
+    RPI_DSB();
+    RPI_ISB();
+}
+
+#endif
+
+
+/**
+    @brief Map the ARM's RAM and the peripherals and turn the MMU on
+    @return -1 if the firmware didn't say where the RAM is, the MMU is left
+    off then
+*/
+int RPI_MmuInit( void )
+{
+    const rpi_mailbox_property_t* mp;
+    rpi_mmu_layout_t layout;
+
+    if( mmuEnabled )
+        return 0;
+
+    mp = RPI_PropertyCacheGet( TAG_GET_ARM_MEMORY, 0 );
+    if( ( mp == NULL ) || ( mp->data.buffer_32[1] == 0 ) )
+        return -1;
+
+    layout.ram_base = (uint32_t)mp->data.buffer_32[0];
+    layout.ram_size = (uint32_t)mp->data.buffer_32[1];
+
+    RPI_MmuBuildTable( rpiMmuTable, &layout );
+    mmu_enable( rpiMmuTable );
+    mmuEnabled = 1;
+
+    /* Secondary cores look at it before their caches are on */
+    RPI_CacheCleanRange( &mmuEnabled, sizeof( mmuEnabled ) );
+
+    return 0;
+}
+
+
+/**
+    @brief Turn the MMU on on a secondary core with the table core 0 built
+*/
+void RPI_MmuInitCore( void )
+{
+    if( mmuEnabled )
+        mmu_enable( rpiMmuTable );
+}
+
+
+/**
+    @brief Change part of the live mapping
+*/
+void RPI_MmuRemap( uint32_t base, uint32_t size, rpi_mmu_memory_t type )
+{
+    if( size == 0 )
+        return;
+
+    RPI_MmuMapRange( rpiMmuTable, base, size, type );
+
+    if( mmuEnabled )
+    {
+        uint64_t last = ( (uint64_t)base + size - 1 ) >> RPI_MMU_SECTION_SHIFT;
+
+        if( last >= RPI_MMU_TABLE_ENTRIES )
+            last = RPI_MMU_TABLE_ENTRIES - 1;
+
+        mmu_sync( base >> RPI_MMU_SECTION_SHIFT, (uint32_t)last );
+    }
+}
+
+
+const uint32_t* RPI_MmuGetTable( void )
+{
+    return rpiMmuTable;
+}
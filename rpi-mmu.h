@@ -0,0 +1,79 @@
+#ifndef RPI_MMU_H
+#define RPI_MMU_H
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+
+/** @brief The first level translation table maps the 4GB address space in
+    1MB sections, one word each. It has to sit on a 16KB boundary */
+#define RPI_MMU_SECTION_SHIFT   20
+#define RPI_MMU_SECTION_SIZE    ( 1UL << RPI_MMU_SECTION_SHIFT )
+#define RPI_MMU_TABLE_ENTRIES   4096
+#define RPI_MMU_TABLE_ALIGN     16384
+
+/** @brief Bits of a short descriptor section entry */
+#define RPI_MMU_SECTION         0x00002
+#define RPI_MMU_B               0x00004
+#define RPI_MMU_C               0x00008
+#define RPI_MMU_XN              0x00010
+#define RPI_MMU_AP_FULL         0x00C00
+#define RPI_MMU_TEX( n )        ( ( n ) << 12 )
+#define RPI_MMU_S               0x10000
+
+/* The Cortex-A7 cores of the RPi2 only keep shareable memory coherent
+   between them. The ARM1176 doesn't cache shareable memory at all, so it's
+   only asked for on the RPi2 */
+#if defined( RPI2 )
+    #define RPI_MMU_SHARED      RPI_MMU_S
+#else
+    #define RPI_MMU_SHARED      0
+#endif
+
+/** @brief What a section of the address space is mapped as */
+typedef enum {
+    /** Not mapped, any access aborts */
+    RPI_MMU_FAULT = 0,
+
+    /** Normal memory, cached write-back with write allocate */
+    RPI_MMU_WRITE_BACK,
+
+    /** Normal memory that isn't cached. Writes are still merged in the
+        write buffer, which is what a framebuffer wants */
+    RPI_MMU_WRITE_COMBINE,
+
+    /** Shared device memory, accesses are never merged, repeated or
+        reordered and nothing is executed from it */
+    RPI_MMU_DEVICE,
+
+    /** Every access completes before the next one starts */
+    RPI_MMU_STRONGLY_ORDERED,
+    } rpi_mmu_memory_t;
+
+/** @brief The regions RPI_MmuBuildTable maps, all addresses are physical and
+    mapped to themselves. Anything not covered is left unmapped */
+typedef struct {
+    /** The ARM's share of the RAM, from TAG_GET_ARM_MEMORY */
+    uint32_t ram_base;
+    uint32_t ram_size;
+    } rpi_mmu_layout_t;
+
+/* Building and reading translation tables. These only ever touch the table
+   they're given, so they're the same on the Pi and on host builds */
+extern uint32_t RPI_MmuSection( uint32_t address, rpi_mmu_memory_t type );
+extern void RPI_MmuMapRange( uint32_t* table, uint32_t base, uint32_t size, rpi_mmu_memory_t type );
+extern void RPI_MmuBuildTable( uint32_t* table, const rpi_mmu_layout_t* layout );
+extern rpi_mmu_memory_t RPI_MmuLookup( const uint32_t* table, uint32_t address );
+
+/* The live table. RPI_MmuInit asks the firmware where the ARM's RAM is,
+   builds the table and, on the Pi, turns on the MMU along with the caches
+   and branch prediction. RPI_MmuInitCore does the same on the other cores
+   with the table core 0 built. RPI_MmuRemap changes part of the live mapping;
+   cached lines in the range aren't cleaned, so it's for regions that
+   haven't been accessed as write-back memory */
+extern int RPI_MmuInit( void );
+extern void RPI_MmuInitCore( void );
+extern void RPI_MmuRemap( uint32_t base, uint32_t size, rpi_mmu_memory_t type );
+extern const uint32_t* RPI_MmuGetTable( void );
+
+#endif
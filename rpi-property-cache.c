@@ -0,0 +1,267 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rpi-mailbox-interface.h"
+#include "rpi-property-cache.h"
+
+/* The VideoCore sets this in a tag's response word once it has answered */
+#define TAG_RESPONSE_BIT    0x80000000
+
+typedef struct {
+    rpi_mailbox_tag_t tag;
+    uint32_t arg;
+    } cache_key_t;
+
+/* Facts that are fixed for as long as the board is powered */
+static const cache_key_t immutable[] = {
+    { TAG_GET_FIRMWARE_VERSION, 0 },
+    { TAG_GET_BOARD_MODEL, 0 },
+    { TAG_GET_BOARD_REVISION, 0 },
+    { TAG_GET_BOARD_MAC_ADDRESS, 0 },
+    { TAG_GET_BOARD_SERIAL, 0 },
+    { TAG_GET_ARM_MEMORY, 0 },
+    { TAG_GET_VC_MEMORY, 0 },
+    { TAG_GET_MAX_CLOCK_RATE, TAG_CLOCK_ARM },
+    };
+
+/* Tags that only change when this program changes them. Whoever does must
+   call RPI_PropertyCacheInvalidate for the tag straight after:
+     TAG_GET_CLOCK_RATE - after any TAG_SET_CLOCK_RATE */
+static const rpi_mailbox_tag_t invalidated[] = {
+    TAG_GET_CLOCK_RATE,
+    };
+
+static rpi_property_cache_entry_t cache[RPI_PROPERTY_CACHE_SZ];
+static rpi_property_cache_stats_t stats;
+
+/* The last answer to a tag that isn't cached, handed out until the next */
+static rpi_property_cache_entry_t uncached;
+
+
+/**
+    @brief Whether a tag's answer can be kept: it's one of the immutable
+    tags, for any argument, or one with an invalidation point. Anything
+    else, the temperature or a power state say, can change under us
+*/
+static int cache_allowed( rpi_mailbox_tag_t tag )
+{
+    unsigned int i;
+
+    for( i = 0; i < sizeof( immutable ) / sizeof( immutable[0] ); i++ )
+    {
+        if( immutable[i].tag == tag )
+            return 1;
+    }
+
+    for( i = 0; i < sizeof( invalidated ) / sizeof( invalidated[0] ); i++ )
+    {
+        if( invalidated[i] == tag )
+            return 1;
+    }
+
+    return 0;
+}
+
+
+static rpi_property_cache_entry_t* cache_find( rpi_mailbox_tag_t tag, uint32_t arg )
+{
+    int i;
+
+    for( i = 0; i < RPI_PROPERTY_CACHE_SZ; i++ )
+    {
+        if( cache[i].valid && ( cache[i].words[T_OIDENT] == (int)tag ) && ( cache[i].arg == arg ) )
+            return &cache[i];
+    }
+
+    return NULL;
+}
+
+
+/**
+    @brief Keep a copy of an answered tag. Tags the VideoCore didn't answer
+    or with values too big to keep are left to be asked for every time, and
+    tags that can't be cached only go in the uncached entry
+*/
+static void cache_store( const rpi_mailbox_property_t* mp, uint32_t arg )
+{
+    rpi_property_cache_entry_t* e;
+    int length;
+    int i;
+
+    if( ( mp == NULL ) || ( ( mp->response & TAG_RESPONSE_BIT ) == 0 ) )
+        return;
+
+    length = RPI_PropertyLength( mp );
+
+    if( length > RPI_PROPERTY_CACHE_VALUE_WORDS * 4 )
+        return;
+
+    if( cache_allowed( mp->tag ) )
+    {
+        e = cache_find( mp->tag, arg );
+
+        for( i = 0; ( e == NULL ) && ( i < RPI_PROPERTY_CACHE_SZ ); i++ )
+        {
+            if( !cache[i].valid )
+                e = &cache[i];
+        }
+
+        /* Full, it'll be a miss every time */
+        if( e == NULL )
+            return;
+    }
+    else
+    {
+        e = &uncached;
+    }
+
+    e->arg = arg;
+    e->words[T_OIDENT] = mp->tag;
+    e->words[T_OVALUE_SIZE] = RPI_PROPERTY_CACHE_VALUE_WORDS * 4;
+    e->words[T_ORESPONSE] = mp->response;
+    memcpy( &e->words[T_OVALUE], mp->data.buffer_8, length );
+    e->valid = 1;
+}
+
+
+/**
+    @brief Ask the VideoCore for a list of tags in one round trip and cache
+    the answers. Uses a free transaction if there is one, the blocking
+    interface's buffer if not
+*/
+static void cache_fetch( const cache_key_t* keys, int count )
+{
+    rpi_property_transaction_t* t = RPI_PropertyBegin();
+    rpi_property_transaction_t* pooled = t;
+    int i;
+
+    if( t == NULL )
+        t = RPI_PropertyInit();
+
+    for( i = 0; i < count; i++ )
+    {
+        const rpi_property_tag_desc_t* desc = RPI_PropertyTagDesc( keys[i].tag );
+        int* value;
+
+        if( desc == NULL )
+            continue;
+
+        value = RPI_PropertyReserve( t, keys[i].tag, desc->value_size );
+
+        if( ( value != NULL ) && ( desc->args > 0 ) )
+            value[0] = keys[i].arg;
+    }
+
+    stats.round_trips++;
+
+    if( pooled )
+    {
+        while( !RPI_PropertySubmit( t, NULL, NULL ) ) { }
+        while( !RPI_PropertyPoll( t ) ) { }
+    }
+    else
+    {
+        RPI_PropertyProcess();
+    }
+
+    for( i = 0; i < count; i++ )
+        cache_store( RPI_PropertyResult( t, keys[i].tag ), keys[i].arg );
+
+    if( pooled )
+        RPI_PropertyRelease( t );
+}
+
+
+/**
+    @brief Fill the cache with the immutable tags in one batched transaction
+    @return The number of them the VideoCore answered
+*/
+int RPI_PropertyCacheInit( void )
+{
+    int count = sizeof( immutable ) / sizeof( immutable[0] );
+    int answered = 0;
+    int i;
+
+    memset( cache, 0, sizeof( cache ) );
+    memset( &uncached, 0, sizeof( uncached ) );
+    memset( &stats, 0, sizeof( stats ) );
+
+    cache_fetch( immutable, count );
+
+    for( i = 0; i < count; i++ )
+    {
+        if( cache_find( immutable[i].tag, immutable[i].arg ) )
+            answered++;
+    }
+
+    return answered;
+}
+
+
+/**
+    @brief Return a tag's answer from RAM, going to the VideoCore only the
+    first time or after the tag has been invalidated. Tags that can change
+    without us knowing are asked for every time, their answer lasts until
+    the next uncached one. Only for tags with values of up to
+    RPI_PROPERTY_CACHE_VALUE_WORDS words
+    @return NULL if the VideoCore doesn't answer the tag
+*/
+const rpi_mailbox_property_t* RPI_PropertyCacheGet( rpi_mailbox_tag_t tag, uint32_t arg )
+{
+    rpi_property_cache_entry_t* e = cache_find( tag, arg );
+    cache_key_t key;
+
+    if( e != NULL )
+    {
+        stats.hits++;
+        return (const rpi_mailbox_property_t*)e->words;
+    }
+
+    key.tag = tag;
+    key.arg = arg;
+
+    if( !cache_allowed( tag ) )
+    {
+        stats.uncached++;
+
+        uncached.valid = 0;
+        cache_fetch( &key, 1 );
+
+        return uncached.valid ? (const rpi_mailbox_property_t*)uncached.words : NULL;
+    }
+
+    stats.misses++;
+
+    cache_fetch( &key, 1 );
+
+    e = cache_find( tag, arg );
+
+    return e ? (const rpi_mailbox_property_t*)e->words : NULL;
+}
+
+
+/**
+    @brief Forget every cached answer for a tag, for whatever argument. Call
+    it after changing something the tag reports, a clock rate for example.
+    The tags it's needed for are listed in invalidated[]
+*/
+void RPI_PropertyCacheInvalidate( rpi_mailbox_tag_t tag )
+{
+    int i;
+
+    for( i = 0; i < RPI_PROPERTY_CACHE_SZ; i++ )
+    {
+        if( cache[i].valid && ( cache[i].words[T_OIDENT] == (int)tag ) )
+        {
+            cache[i].valid = 0;
+            stats.invalidations++;
+        }
+    }
+}
+
+
+rpi_property_cache_stats_t* RPI_PropertyCacheStats( void )
+{
+    return &stats;
+}
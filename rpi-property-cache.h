@@ -0,0 +1,42 @@
+#ifndef RPI_PROPERTY_CACHE_H
+#define RPI_PROPERTY_CACHE_H
+
+#include <stdint.h>
+
+#include "rpi-mailbox-interface.h"
+
+/** @brief Answers kept in RAM, and the largest value one can hold */
+#define RPI_PROPERTY_CACHE_SZ           16
+#define RPI_PROPERTY_CACHE_VALUE_WORDS  4
+
+/** @brief One cached answer. words is laid out like a tag in a tag buffer
+    so it can be handed out as an rpi_mailbox_property_t */
+typedef struct {
+    uint32_t arg;
+    int valid;
+    int words[3 + RPI_PROPERTY_CACHE_VALUE_WORDS];
+    } rpi_property_cache_entry_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    /** Mailbox round trips made, the boot time batch counts as one */
+    uint32_t round_trips;
+    uint32_t invalidations;
+    /** Asked for tags that can't be cached, each one a round trip */
+    uint32_t uncached;
+    } rpi_property_cache_stats_t;
+
+/* Asks for everything the VideoCore will never change its mind about in a
+   single transaction. Only those and the few tags that change when we
+   change them are cached. TAG_GET_CLOCK_RATE is fetched on first use and
+   kept until RPI_PropertyCacheInvalidate, which whoever sets a clock rate
+   has to call. Any other tag RPI_PropertyCacheGet is asked for goes to the
+   VideoCore every time. arg is the tag's argument, the clock id for the
+   clock tags, and part of the key */
+extern int RPI_PropertyCacheInit( void );
+extern const rpi_mailbox_property_t* RPI_PropertyCacheGet( rpi_mailbox_tag_t tag, uint32_t arg );
+extern void RPI_PropertyCacheInvalidate( rpi_mailbox_tag_t tag );
+extern rpi_property_cache_stats_t* RPI_PropertyCacheStats( void );
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rpi-base.h"
+#include "rpi-cache.h"
+#include "rpi-hal.h"
+#include "rpi-mmu.h"
+#include "rpi-smp.h"
+#include "rpi-systimer.h"
+
+/* The firmware's stub parks each secondary core on its mailbox 3 */
+#define SMP_START_MAILBOX   3
+
+extern void _secondary_start( void );
+
+static rpi_core_entry_t coreEntry[RPI_CORES];
+static volatile uint32_t coreRunning[RPI_CORES];
+
+
+uint32_t RPI_CoreId( void )
+{
+#if defined( RPI2 )
+    uint32_t mpidr;
+
+    __asm volatile( "mrc p15, 0, %0, c0, c0, 5" : "=r" (mpidr) );
+
+    return mpidr & 3;
+#else
+    return 0;
+#endif
+}
+
+
+uint32_t RPI_CoreCount( void )
+{
+    return RPI_CORES;
+}
+
+
+rpi_local_peripherals_t* RPI_GetLocalPeripherals( void )
+{
+    return RPI_HAL_BLOCK( rpi_local_peripherals_t, RPI_LOCAL_PERIPHERAL_BASE );
+}
+
+
+bool RPI_SmpStartCore( uint32_t core, rpi_core_entry_t entry )
+{
+    rpi_sys_timer_t* timer = RPI_GetSystemTimer();
+    uint32_t ts;
+
+    if( ( core == 0 ) || ( core >= RPI_CORES ) )
+        return false;
+
+    coreEntry[core] = entry;
+    coreRunning[core] = 0;
+
+    /* The core reads these before its own caches are on */
+    RPI_CacheCleanRange( &coreEntry[core], sizeof( coreEntry[core] ) );
+    RPI_CacheCleanRange( (const void*)&coreRunning[core], sizeof( coreRunning[core] ) );
+
+    RPI_REG_WRITE( RPI_GetLocalPeripherals()->core_mailbox_set[core][SMP_START_MAILBOX],
+                   (uint32_t)_secondary_start );
+
+    /* The stub waits for an event between looks at its mailbox */
+    RPI_DSB();
+    __asm volatile( "sev" );
+
+    ts = RPI_REG_READ( timer->counter_lo );
+
+    while( __atomic_load_n( &coreRunning[core], __ATOMIC_ACQUIRE ) == 0 )
+    {
+        if( ( RPI_REG_READ( timer->counter_lo ) - ts ) > RPI_SMP_START_TIMEOUT_US )
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+    @brief A secondary core's C entry point, with the stack set up by
+    _secondary_start. Nothing it can't read straight from RAM is touched
+    until the MMU is on, after that it's coherent with core 0
+*/
+void RPI_SmpSecondary( uint32_t core )
+{
+    RPI_MmuInitCore();
+
+    __atomic_store_n( &coreRunning[core], 1, __ATOMIC_RELEASE );
+
+    coreEntry[core]( core );
+
+    while( 1 )
+    {
+        /* EMPTY! */
+    }
+}
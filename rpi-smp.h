@@ -0,0 +1,66 @@
+#ifndef RPI_SMP_H
+#define RPI_SMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rpi-base.h"
+
+/* The RPi2's ARM local peripherals: the core timers, the per-core mailboxes
+   and the interrupt routing. They're not behind PERIPHERAL_BASE */
+#define RPI_LOCAL_PERIPHERAL_BASE   0x40000000UL
+
+#if defined( RPI2 )
+    #define RPI_CORES               4
+#else
+    #define RPI_CORES               1
+#endif
+
+/* How long RPI_SmpStartCore waits for a core to say it's running */
+#define RPI_SMP_START_TIMEOUT_US    100000
+
+/** @brief The local peripheral block. Each core has four mailboxes, writing
+    a set register ORs the value in and writing the read/clear register
+    clears the bits written */
+typedef struct {
+    rpi_reg_rw_t control;
+    rpi_reg_ro_t reserved0;
+    rpi_reg_rw_t core_timer_prescaler;
+    rpi_reg_rw_t gpu_interrupt_routing;
+    rpi_reg_rw_t pmu_routing_set;
+    rpi_reg_rw_t pmu_routing_clear;
+    rpi_reg_ro_t reserved1;
+    rpi_reg_ro_t core_timer_ls;
+    rpi_reg_ro_t core_timer_ms;
+    rpi_reg_rw_t local_interrupt_routing;
+    rpi_reg_ro_t reserved2;
+    rpi_reg_rw_t axi_outstanding_counters;
+    rpi_reg_rw_t axi_outstanding_irq;
+    rpi_reg_rw_t local_timer_control;
+    rpi_reg_wo_t local_timer_write_flags;
+    rpi_reg_ro_t reserved3;
+    rpi_reg_rw_t core_timer_interrupt_control[4];
+    rpi_reg_rw_t core_mailbox_interrupt_control[4];
+    rpi_reg_ro_t core_irq_source[4];
+    rpi_reg_ro_t core_fiq_source[4];
+    rpi_reg_wo_t core_mailbox_set[4][4];
+    rpi_reg_rw_t core_mailbox_clear[4][4];
+    } rpi_local_peripherals_t;
+
+/** @brief Entry point for a secondary core, running on its own stack with
+    the MMU and caches on */
+typedef void (*rpi_core_entry_t)( uint32_t core );
+
+extern uint32_t RPI_CoreId( void );
+extern uint32_t RPI_CoreCount( void );
+extern rpi_local_peripherals_t* RPI_GetLocalPeripherals( void );
+
+/* Release a core held by the firmware's stub, which is waiting for an
+   address in its mailbox 3. It starts at _secondary_start in armc-start.S
+   and calls entry once it's ready. Returns false if it didn't come up */
+extern bool RPI_SmpStartCore( uint32_t core, rpi_core_entry_t entry );
+
+/* Called by _secondary_start, never returns */
+extern void RPI_SmpSecondary( uint32_t core );
+
+#endif
@@ -1,19 +1,19 @@
 
 #include <stdint.h>
+#include "rpi-hal.h"
 #include "rpi-systimer.h"
 
-static rpi_sys_timer_t* rpiSystemTimer = (rpi_sys_timer_t*)RPI_SYSTIMER_BASE;
-
 rpi_sys_timer_t* RPI_GetSystemTimer(void)
 {
-    return rpiSystemTimer;
+    return RPI_HAL_BLOCK( rpi_sys_timer_t, RPI_SYSTIMER_BASE );
 }
 
 void RPI_WaitMicroSeconds( uint32_t us )
 {
-    volatile uint32_t ts = rpiSystemTimer->counter_lo;
+    rpi_sys_timer_t* rpiSystemTimer = RPI_GetSystemTimer();
+    volatile uint32_t ts = RPI_REG_READ( rpiSystemTimer->counter_lo );
 
-    while( ( rpiSystemTimer->counter_lo - ts ) < us )
+    while( ( RPI_REG_READ( rpiSystemTimer->counter_lo ) - ts ) < us )
     {
         /* BLANK */
     }
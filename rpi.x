@@ -184,6 +184,16 @@ SECTIONS
    . = ALIGN(. != 0 ? 32 / 8 : 1);
   }
   _bss_end__ = . ; __bss_end__ = . ;
+  /* Stacks for the RPi2's cores 1 to 3, core 0's is below 0x8000. Not part
+     of the image and never cleared */
+  __core_stack_size__ = 0x10000;
+  . = ALIGN(16);
+  .core_stacks (NOLOAD) :
+  {
+    __core_stacks_start__ = . ;
+    . += 3 * __core_stack_size__;
+    __core_stacks_end__ = . ;
+  }
   . = ALIGN(32 / 8);
   . = ALIGN(32 / 8);
   __end__ = . ;
@@ -0,0 +1,21 @@
+#ifndef SIP_CRC_H_
+#define SIP_CRC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-16/CCITT-FALSE: polynomial 0x1021, not reflected, no final xor.
+// "123456789" gives 0x29b1
+#define SIP_CRC16_INIT 0xffff
+
+extern const uint16_t SIPCrc16Table[4][256];
+
+static inline uint16_t SIPCrc16Byte(uint16_t crc, uint8_t byte)
+{
+	return (uint16_t)(crc << 8) ^ SIPCrc16Table[0][(crc >> 8) ^ byte];
+}
+
+// four bytes per step through the slice tables, what's left one at a time
+uint16_t SIPCrc16(uint16_t crc, const uint8_t *data, size_t len);
+
+#endif
@@ -1,7 +1,45 @@
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include "sip.h"
+#include "sip-crc.h"
+#include "rpi-base.h"
 
-#define DEBUG_SIP
+// build with -DDEBUG_SIP to trace every byte, it's far too slow to leave on
+
+// marks '<' in the hex table so the decode loops can spot a resync
+#define SIP_HEX_SFLAG 0x80
+
+// ascii to nibble, anything that isn't a hex digit decodes as 0
+static const uint8_t sip_hex_lut[256] =
+{
+	['0'] = 0x0, ['1'] = 0x1, ['2'] = 0x2, ['3'] = 0x3, ['4'] = 0x4,
+	['5'] = 0x5, ['6'] = 0x6, ['7'] = 0x7, ['8'] = 0x8, ['9'] = 0x9,
+	['A'] = 0xa, ['B'] = 0xb, ['C'] = 0xc, ['D'] = 0xd, ['E'] = 0xe, ['F'] = 0xf,
+	['a'] = 0xa, ['b'] = 0xb, ['c'] = 0xc, ['d'] = 0xd, ['e'] = 0xe, ['f'] = 0xf,
+	['<'] = SIP_HEX_SFLAG,
+};
+
+// For the states that begin a byte, the state after the whole byte. NONE
+// marks the states that don't begin one and go through SIPFeedInput
+static const uint8_t sip_byte_next[] =
+{
+	[NONE] = NONE,
+	[SFLAG] = NONE,
+	[COMMAND_H] = SEQUENCE_H,
+	[COMMAND_L] = NONE,
+	[SEQUENCE_H] = LENGTH_H,
+	[SEQUENCE_L] = NONE,
+	[LENGTH_H] = PAYLOAD_H,
+	[LENGTH_L] = NONE,
+	[LENGTH_EXT_H] = PAYLOAD_H,
+	[LENGTH_EXT_L] = NONE,
+	[PAYLOAD_H] = PAYLOAD_H,
+	[PAYLOAD_L] = NONE,
+	[CHECKSUM_H] = EFLAG,
+	[CHECKSUM_L] = NONE,
+	[EFLAG] = NONE,
+};
 
 void SIPRegisterCommand(SIP_t *sip, uint8_t command, callback_func f)
 {
@@ -13,16 +51,551 @@ void SIPDeregisterCommand(SIP_t *sip, uint8_t command)
 	sip->CommandVectorTable[command] = 0;
 }
 
+void SIPSetMode(SIP_t *sip, SIPMode_t mode)
+{
+	sip->Mode = mode;
+
+	// both decoders start out waiting for the next frame
+	sip->State = NONE;
+	sip->frame_index = 0;
+	sip->frame_header = 3;
+	sip->cobs_remaining = 0;
+	sip->cobs_zero = false;
+}
+
+void SIPRegisterBulkTarget(SIP_t *sip, uint8_t id, SIPBulkTarget_t *target)
+{
+	if (id < SIP_BULK_TARGETS)
+		sip->BulkTargets[id] = target;
+}
+
+static void sip_error(SIP_t *sip, SIPError_t error)
+{
+	sip->Error = error;
+	sip->ErrorCount[error]++;
+}
+
+void SIPSetTransmit(SIP_t *sip, SIPTransmit_t transmit)
+{
+	sip->Transmit = transmit;
+}
+
+// where the raw frame starts in an encode buffer. Text is expanded backwards
+// and COBS forwards, either way never over bytes that are still to be read
+static inline size_t sip_raw_offset(SIPMode_t mode)
+{
+	return mode == SIP_MODE_BINARY ? SIP_COBS_OFFSET : 1;
+}
+
+// encode the n byte raw frame at out + sip_raw_offset(mode) in place
+static size_t sip_encode_raw(uint8_t *out, SIPMode_t mode, size_t n)
+{
+	const uint8_t *raw = out + sip_raw_offset(mode);
+
+	if (mode == SIP_MODE_BINARY)
+	{
+		// COBS: each block is a code byte, the distance to the next zero,
+		// then the non zero bytes before it
+		uint8_t *code = out;
+		uint8_t *p = out + 1;
+		size_t i;
+
+		for (i = 0; i < n; i++)
+		{
+			uint8_t b = raw[i];
+
+			if (b != 0)
+				*p++ = b;
+
+			if (b == 0 || p - code == 0xFF)
+			{
+				*code = p - code;
+				code = p++;
+			}
+		}
+
+		*code = p - code;
+		*p++ = 0;
+
+		return p - out;
+	}
+	else
+	{
+		static const char digits[] = "0123456789ABCDEF";
+		size_t i = n;
+
+		out[2 * n + 1] = '>';
+
+		while (i-- > 0)
+		{
+			uint8_t b = raw[i];
+
+			out[2 * i + 2] = digits[b & 0x0f];
+			out[2 * i + 1] = digits[b >> 4];
+		}
+
+		out[0] = '<';
+
+		return 2 * n + 2;
+	}
+}
+
+static size_t sip_build_frame(uint8_t *out, SIPMode_t mode, uint8_t command,
+							  uint8_t sequence, const uint8_t *payload, uint16_t length)
+{
+	uint8_t *raw = out + sip_raw_offset(mode);
+	size_t header = length >= SIP_LENGTH_EXTENDED ? 5 : 3;
+	uint16_t crc;
+
+	// the payload may already be in place, as a response's is
+	memmove(&raw[header], payload, length);
+	raw[0] = command;
+	raw[1] = sequence;
+
+	if (header == 5)
+	{
+		raw[2] = SIP_LENGTH_EXTENDED;
+		raw[3] = length >> 8;
+		raw[4] = length & 0xff;
+	}
+	else
+	{
+		raw[2] = length;
+	}
+
+	crc = SIPCrc16(SIP_CRC16_INIT, raw, header + length);
+	raw[header + length] = crc >> 8;
+	raw[header + length + 1] = crc & 0xff;
+
+	return sip_encode_raw(out, mode, header + length + 2);
+}
+
+// Run a handler with a response that it fills in straight inside the TX frame,
+// then send the response back with the same command and sequence
+static void sip_execute(SIP_t *sip, callback_func f, uint8_t command,
+						uint8_t sequence, uint8_t *payload, uint16_t length)
+{
+	SIPMode_t mode = sip->Mode;
+	uint8_t *status = sip->response_frame + sip_raw_offset(mode) + 3;
+	SIPResponse_t *response = &sip->Response;
+
+	response->command = command;
+	response->sequence = sequence;
+	response->length = 0;
+	response->data = status + 1;
+
+	*status = (uint8_t)f(payload, length, response);
+
+	if (sip->Transmit)
+	{
+		if (response->length > SIP_MAX_RESP_LEN)
+			response->length = SIP_MAX_RESP_LEN;
+
+		sip->Transmit(sip->response_frame,
+			sip_build_frame(sip->response_frame, mode, command, sequence,
+							status, response->length + 1));
+	}
+}
+
+// reply to one of the reserved commands. These are answered from wherever
+// the parser runs, so they can't use the shared response frame
+static void sip_reply(SIP_t *sip, uint8_t status, const uint8_t *data, uint8_t length)
+{
+	uint8_t frame[SIP_TEXT_FRAME_LEN(5)];
+	uint8_t payload[5];
+
+	if (sip->Transmit == 0)
+		return;
+
+	payload[0] = status;
+	memcpy(&payload[1], data, length);
+
+	sip->Transmit(frame,
+		sip_build_frame(frame, sip->Mode, sip->command, sip->sequence,
+						payload, length + 1));
+}
+
+static void sip_set_mode_command(SIP_t *sip)
+{
+	uint8_t status = 0;
+
+	if (sip->length == 1 && sip->payload[0] <= SIP_MODE_BINARY)
+	{
+		SIPSetMode(sip, (SIPMode_t)sip->payload[0]);
+	}
+	else
+	{
+		sip_error(sip, INVALID_CMD_ERROR);
+		status = 1;
+	}
+
+	// acknowledged in the mode that's now in use
+	sip_reply(sip, status, 0, 0);
+}
+
+static inline uint32_t sip_get_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void sip_bulk_reply(SIP_t *sip, uint8_t status, uint32_t received)
+{
+	uint8_t data[4];
+
+	data[0] = received >> 24;
+	data[1] = received >> 16;
+	data[2] = received >> 8;
+	data[3] = received;
+
+	sip_reply(sip, status, data, sizeof(data));
+}
+
+static SIPBulkTarget_t *sip_bulk_target(SIP_t *sip, uint16_t min_length)
+{
+	if (sip->length < min_length || sip->payload[0] >= SIP_BULK_TARGETS)
+		return 0;
+
+	return sip->BulkTargets[sip->payload[0]];
+}
+
+static void sip_bulk_start(SIP_t *sip)
+{
+	SIPBulkTarget_t *target = sip_bulk_target(sip, SIP_BULK_HEADER_LEN);
+	uint32_t length;
+
+	if (target == 0)
+	{
+		sip_error(sip, INVALID_CMD_ERROR);
+		sip_bulk_reply(sip, SIP_BULK_REFUSED, 0);
+		return;
+	}
+
+	length = sip_get_be32(&sip->payload[1]);
+
+	if (length > target->size)
+	{
+		sip_error(sip, INVALID_LENGTH_ERROR);
+		sip_bulk_reply(sip, SIP_BULK_REFUSED, 0);
+		return;
+	}
+
+	target->received = 0;
+	target->length = length;
+	target->refused = 0;
+
+	sip_bulk_reply(sip, SIP_BULK_OK, 0);
+}
+
+static void sip_bulk_data(SIP_t *sip)
+{
+	SIPBulkTarget_t *target = sip_bulk_target(sip, SIP_BULK_HEADER_LEN);
+	uint32_t offset, received, n;
+
+	if (target == 0)
+	{
+		sip_error(sip, INVALID_CMD_ERROR);
+		sip_bulk_reply(sip, SIP_BULK_REFUSED, 0);
+		return;
+	}
+
+	offset = sip_get_be32(&sip->payload[1]);
+	received = target->received;
+	n = sip->length - SIP_BULK_HEADER_LEN;
+
+	// a chunk after a lost one, or a repeat, the host goes back to received
+	if (offset != received)
+	{
+		target->refused++;
+		sip_bulk_reply(sip, SIP_BULK_OUT_OF_ORDER, received);
+		return;
+	}
+
+	if (n > target->length - received)
+	{
+		sip_error(sip, INVALID_LENGTH_ERROR);
+		sip_bulk_reply(sip, SIP_BULK_REFUSED, received);
+		return;
+	}
+
+	memcpy(&target->buffer[offset], &sip->payload[SIP_BULK_HEADER_LEN], n);
+
+	// the data has to be there before anyone sees the count go up
+	RPI_DMB();
+	target->received = received + n;
+
+	sip_bulk_reply(sip, SIP_BULK_OK, received + n);
+}
+
+static void sip_dispatch(SIP_t *sip)
+{
+	callback_func f = sip->CommandVectorTable[sip->command];
+
+	// The reserved commands are part of the protocol rather than callbacks. A
+	// mode switch has to take effect before the next frame is parsed, bulk
+	// data goes straight to its target
+	if (f == 0)
+	{
+		switch (sip->command)
+		{
+			case SIP_CMD_SET_MODE:
+				sip_set_mode_command(sip);
+				break;
+
+			case SIP_CMD_BULK_START:
+				sip_bulk_start(sip);
+				break;
+
+			case SIP_CMD_BULK_DATA:
+				sip_bulk_data(sip);
+				break;
+
+			default:
+				// nothing would run it
+				break;
+		}
+
+		return;
+	}
+
+	if (sip->Deferred)
+	{
+		uint32_t head = sip->frame_head;
+		uint32_t depth = head - sip->frame_tail;
+		SIPFrame_t *frame;
+
+		if (depth == SIP_FRAME_POOL_SZ)
+		{
+			sip->QueueStats.dropped++;
+			sip_error(sip, INVALID_EXEC_ERROR);
+			return;
+		}
+
+		frame = &sip->frame_pool[head & (SIP_FRAME_POOL_SZ - 1)];
+		frame->command = sip->command;
+		frame->sequence = sip->sequence;
+		frame->length = sip->length;
+		frame->timestamp = sip->Clock ? sip->Clock() : 0;
+		memcpy(frame->payload, sip->payload, sip->length);
+
+		sip->QueueStats.queued++;
+
+		if (depth + 1 > sip->QueueStats.max_depth)
+			sip->QueueStats.max_depth = depth + 1;
+
+		// publish the frame only once it's been copied
+		RPI_DMB();
+		sip->frame_head = head + 1;
+		return;
+	}
+
+	sip_execute(sip, f, sip->command, sip->sequence, sip->payload, sip->length);
+}
+
+void SIPSetDeferred(SIP_t *sip, bool deferred, SIPClock_t clock)
+{
+	sip->Deferred = deferred;
+	sip->Clock = clock;
+}
+
+int SIPProcessQueue(SIP_t *sip, int max)
+{
+	int executed = 0;
+
+	while (executed != max && sip->frame_tail != sip->frame_head)
+	{
+		uint32_t tail = sip->frame_tail;
+		SIPFrame_t *frame = &sip->frame_pool[tail & (SIP_FRAME_POOL_SZ - 1)];
+		callback_func f;
+
+		// don't read the frame before the head that published it
+		RPI_DMB();
+
+		if (sip->Clock)
+		{
+			uint32_t latency = sip->Clock() - frame->timestamp;
+
+			sip->QueueStats.latency_total += latency;
+
+			if (latency > sip->QueueStats.latency_max)
+				sip->QueueStats.latency_max = latency;
+		}
+
+		// the handler may have been deregistered since the frame was queued
+		f = sip->CommandVectorTable[frame->command];
+
+		if (f != 0)
+			sip_execute(sip, f, frame->command, frame->sequence,
+						frame->payload, frame->length);
+
+		sip->QueueStats.executed++;
+		executed++;
+
+		// finish with the frame before handing the slot back
+		RPI_DMB();
+		sip->frame_tail = tail + 1;
+	}
+
+	return executed;
+}
+
+// a whole frame has arrived, only run it if it arrived intact
+static void sip_frame_done(SIP_t *sip)
+{
+	if (sip->checksum != sip->crc)
+	{
+		sip_error(sip, INVALID_CS_ERROR);
+		return;
+	}
+
+	sip->ErrorCount[NO_ERROR]++;
+	sip_dispatch(sip);
+}
+
+// how the parser carries on once the whole length is known
+static SIPState_t sip_length_done(SIP_t *sip)
+{
+	if (sip->length > SIP_MAX_PAYLOAD_LEN)
+	{
+		sip_error(sip, INVALID_LENGTH_ERROR);
+		return NONE;
+	}
+
+	return sip->length != 0 ? PAYLOAD_H : CHECKSUM_H;
+}
+
+// one decoded byte of a binary frame: command, sequence, length, payload
+// then the two checksum bytes
+static void sip_frame_byte(SIP_t *sip, uint8_t byte)
+{
+	uint16_t i = sip->frame_index;
+
+	// the frame is already bad, ignore it up to the delimiter
+	if (sip->Error != NO_ERROR)
+		return;
+
+	// everything up to the checksum is covered by it
+	if (i < 3 || i < sip->frame_header + sip->length)
+		sip->crc = SIPCrc16Byte(sip->crc, byte);
+
+	if (i == 0)
+	{
+		sip->command = byte;
+	}
+	else if (i == 1)
+	{
+		sip->sequence = byte;
+	}
+	else if (i == 2)
+	{
+		sip->length = byte;
+		sip->frame_header = 3;
+
+		if (byte == SIP_LENGTH_EXTENDED)
+		{
+			sip->length = 0;
+			sip->frame_header = 5;
+		}
+		else if (sip_length_done(sip) == NONE)
+		{
+			// SIP_MAX_PAYLOAD_LEN can be set below what a short length holds
+			return;
+		}
+	}
+	else if (i < sip->frame_header)
+	{
+		sip->length = (sip->length << 8) | byte;
+
+		if (i == 4 && sip_length_done(sip) == NONE)
+			return;
+	}
+	else if (i < sip->frame_header + sip->length)
+	{
+		sip->payload[i - sip->frame_header] = byte;
+	}
+	else if (i < sip->frame_header + sip->length + 2)
+	{
+		sip->checksum = (sip->checksum << 8) | byte;
+	}
+	else
+	{
+		// runs past its checksum
+		sip_error(sip, INVALID_EFLAG_ERROR);
+		return;
+	}
+
+	sip->frame_index = i + 1;
+}
+
+static void sip_binary_input(SIP_t *sip, uint8_t ch)
+{
+	if (ch == 0)
+	{
+		// the delimiter, a frame is only complete if it ends on its checksum
+		if (sip->frame_index > 2 &&
+			sip->frame_index == sip->frame_header + sip->length + 2 &&
+			sip->cobs_remaining == 0 && sip->Error == NO_ERROR)
+		{
+			sip_frame_done(sip);
+		}
+		else if (sip->frame_index != 0 && sip->Error == NO_ERROR)
+		{
+			sip_error(sip, INVALID_EFLAG_ERROR);
+		}
+
+		sip->frame_index = 0;
+		sip->frame_header = 3;
+		sip->cobs_remaining = 0;
+		sip->cobs_zero = false;
+		return;
+	}
+
+	if (sip->cobs_remaining != 0)
+	{
+		sip_frame_byte(sip, ch);
+		sip->cobs_remaining--;
+		return;
+	}
+
+	// a code byte. Every block but a full one stands for a zero after its data,
+	// unless it's the last block of the frame
+	if (sip->cobs_zero)
+	{
+		sip_frame_byte(sip, 0);
+	}
+	else if (sip->frame_index == 0)
+	{
+		sip->Error = NO_ERROR;
+		sip->crc = SIP_CRC16_INIT;
+		sip->checksum = 0;
+	}
+
+	sip->cobs_remaining = ch - 1;
+	sip->cobs_zero = (ch != 0xFF);
+}
+
 void SIPFeedInput(SIP_t *sip, char ch)
 {
+	if (sip->Mode == SIP_MODE_BINARY)
+	{
+		sip_binary_input(sip, ch);
+		return;
+	}
+
 	// reset the state to keep sync
 	if (ch == '<')
 	{
+		// a start flag in the middle of a frame, that frame is lost
+		if (sip->State != NONE)
+			sip_error(sip, INVALID_SFLAG_ERROR);
+
 		sip->State = SFLAG;
 
 		// reset variables
 		sip->payload_counter = 0;
 		sip->Error = NO_ERROR;
+		sip->crc = SIP_CRC16_INIT;
+		sip->checksum = 0;
+		sip->checksum_bytes = 2;
 	}
 
 	switch(sip->State)
@@ -49,10 +622,32 @@ void SIPFeedInput(SIP_t *sip, char ch)
 		case COMMAND_L:
 		{
 			sip->command |= (hexchar_to_uint8(ch) & 0x0f);
-			sip->State = LENGTH_H;
+			sip->crc = SIPCrc16Byte(sip->crc, sip->command);
+			sip->State = SEQUENCE_H;
 
 #ifdef DEBUG_SIP
             printf("SIP::COMMAND_L: 0x%02x\r\n", sip->command);
+#endif
+            break;
+		}
+		case SEQUENCE_H:
+		{
+			sip->sequence = hexchar_to_uint8(ch) << 4;
+			sip->State = SEQUENCE_L;
+
+#ifdef DEBUG_SIP
+            printf("SIP::SEQUENCE_H: 0x%02x\r\n", sip->sequence);
+#endif
+            break;
+		}
+		case SEQUENCE_L:
+		{
+			sip->sequence |= (hexchar_to_uint8(ch) & 0x0f);
+			sip->crc = SIPCrc16Byte(sip->crc, sip->sequence);
+			sip->State = LENGTH_H;
+
+#ifdef DEBUG_SIP
+            printf("SIP::SEQUENCE_L: 0x%02x\r\n", sip->sequence);
 #endif
             break;
 		}
@@ -69,18 +664,51 @@ void SIPFeedInput(SIP_t *sip, char ch)
 		case LENGTH_L:
 		{
 			sip->length |= (hexchar_to_uint8(ch) & 0x0f);
+			sip->crc = SIPCrc16Byte(sip->crc, sip->length);
 
-			if (sip->length != 0) // if the length is not zero then proceed to payload state
+			if (sip->length == SIP_LENGTH_EXTENDED) // the real length follows in two bytes
 			{
-				sip->State = PAYLOAD_H;
+				sip->length = 0;
+				sip->length_bytes = 2;
+				sip->State = LENGTH_EXT_H;
 			}
-			else // otherwise proceed to checksum state
+			else // proceed to payload state, or checksum state if there's no payload
 			{
-				sip->State = CHECKSUM_H;
+				sip->State = sip_length_done(sip);
 			}
 
 #ifdef DEBUG_SIP
             printf("SIP::LENGTH_L: 0x%02x\r\n", sip->length);
+#endif
+            break;
+		}
+		case LENGTH_EXT_H:
+		{
+			sip->payload_byte = hexchar_to_uint8(ch) << 4;
+			sip->State = LENGTH_EXT_L;
+
+#ifdef DEBUG_SIP
+            printf("SIP::LENGTH_EXT_H: 0x%02x\r\n", sip->payload_byte);
+#endif
+            break;
+		}
+		case LENGTH_EXT_L:
+		{
+			sip->payload_byte |= (hexchar_to_uint8(ch) & 0x0f);
+			sip->crc = SIPCrc16Byte(sip->crc, sip->payload_byte);
+			sip->length = (sip->length << 8) | sip->payload_byte;
+
+			if (--sip->length_bytes != 0)
+			{
+				sip->State = LENGTH_EXT_H;
+			}
+			else
+			{
+				sip->State = sip_length_done(sip);
+			}
+
+#ifdef DEBUG_SIP
+            printf("SIP::LENGTH_EXT_L: 0x%04x\r\n", sip->length);
 #endif
             break;
 		}
@@ -97,6 +725,7 @@ void SIPFeedInput(SIP_t *sip, char ch)
 		case PAYLOAD_L:
 		{
 			sip->payload_byte |= (hexchar_to_uint8(ch) & 0x0f);
+			sip->crc = SIPCrc16Byte(sip->crc, sip->payload_byte);
 			sip->payload[sip->payload_counter++] = sip->payload_byte;
 
 			if (sip->payload_counter < sip->length) // append ch to payload until reaching the payload length
@@ -115,21 +744,30 @@ void SIPFeedInput(SIP_t *sip, char ch)
 		}
 		case CHECKSUM_H:
 		{
-			sip->checksum = hexchar_to_uint8(ch) << 4;
+			sip->payload_byte = hexchar_to_uint8(ch) << 4;
 			sip->State = CHECKSUM_L;
 
 #ifdef DEBUG_SIP
-            printf("SIP::CHECKSUM_H: 0x%02x\r\n", sip->checksum);
+            printf("SIP::CHECKSUM_H: 0x%02x\r\n", sip->payload_byte);
 #endif
             break;
 		}
 		case CHECKSUM_L:
 		{
-			sip->checksum |= (hexchar_to_uint8(ch) & 0x0f);
-			sip->State = EFLAG;
+			sip->payload_byte |= (hexchar_to_uint8(ch) & 0x0f);
+			sip->checksum = (sip->checksum << 8) | sip->payload_byte;
+
+			if (--sip->checksum_bytes != 0)
+			{
+				sip->State = CHECKSUM_H;
+			}
+			else
+			{
+				sip->State = EFLAG;
+			}
 
 #ifdef DEBUG_SIP
-            printf("SIP::CHECKSUM_L: 0x%02x\r\n", sip->checksum);
+            printf("SIP::CHECKSUM_L: 0x%04x\r\n", sip->checksum);
 #endif
             break;
 		}
@@ -138,17 +776,17 @@ void SIPFeedInput(SIP_t *sip, char ch)
 			sip->State = NONE;
 
 #ifdef DEBUG_SIP
-            printf("SIP::EFLAG: 0x%02x\r\n", '>');
+            printf("SIP::EFLAG: 0x%02x\r\n", ch);
 #endif
-            // execute the corresponding function
-			if (sip->CommandVectorTable[sip->command] != 0)
+			if (ch != '>')
+			{
+				sip_error(sip, INVALID_EFLAG_ERROR);
+			}
+			else
 			{
-				sip->CommandVectorTable[sip->command](
-					sip->payload,
-					sip->length
-				);
+				sip_frame_done(sip);
 			}
-			
+
             break;
 		}
 		case NONE:
@@ -164,24 +802,195 @@ void SIPFeedInput(SIP_t *sip, char ch)
 }
 
 
-uint8_t hexchar_to_uint8(uint8_t ch)
+static const uint8_t *sip_text_buffer(SIP_t *sip, const uint8_t *p, const uint8_t *end)
 {
-	uint8_t val = 0;
- 
-	if (ch >= '0' && ch <= '9')
+	while (p < end && sip->Mode == SIP_MODE_TEXT)
 	{
-		val = ch - '0';
+		uint8_t next = sip_byte_next[sip->State];
+		uint8_t hi, lo, byte;
+
+		// between frames nothing matters until the next '<'
+		if (sip->State == NONE)
+		{
+			p = memchr(p, '<', end - p);
+
+			if (p == NULL)
+				return end;
+
+			SIPFeedInput(sip, *p++);
+			continue;
+		}
+
+		// half a byte, a flag or the last char of the buffer
+		if (next == NONE || end - p < 2)
+		{
+			SIPFeedInput(sip, *p++);
+			continue;
+		}
+
+		hi = sip_hex_lut[p[0]];
+		lo = sip_hex_lut[p[1]];
+
+		// leave resyncing on a '<' to the per char path
+		if ((hi | lo) & SIP_HEX_SFLAG)
+		{
+			SIPFeedInput(sip, *p++);
+			continue;
+		}
+
+		if (sip->State == PAYLOAD_H)
+		{
+			size_t run = sip->length - sip->payload_counter;
+			uint8_t *payload = &sip->payload[sip->payload_counter];
+			size_t i;
+
+			if (run > (size_t)(end - p) / 2)
+				run = (end - p) / 2;
+
+			for (i = 0; i < run; i++, p += 2)
+			{
+				hi = sip_hex_lut[p[0]];
+				lo = sip_hex_lut[p[1]];
+
+				if ((hi | lo) & SIP_HEX_SFLAG)
+					break;
+
+				payload[i] = (hi << 4) | lo;
+			}
+
+			sip->crc = SIPCrc16(sip->crc, payload, i);
+			sip->payload_counter += i;
+
+			if (sip->payload_counter == sip->length)
+				sip->State = CHECKSUM_H;
+
+			continue;
+		}
+
+		byte = (hi << 4) | lo;
+		p += 2;
+
+		if (sip->State != CHECKSUM_H)
+			sip->crc = SIPCrc16Byte(sip->crc, byte);
+
+		switch (sip->State)
+		{
+			case COMMAND_H:
+				sip->command = byte;
+				break;
+
+			case SEQUENCE_H:
+				sip->sequence = byte;
+				break;
+
+			case LENGTH_H:
+				sip->length = byte;
+
+				if (byte == SIP_LENGTH_EXTENDED)
+				{
+					sip->length = 0;
+					sip->length_bytes = 2;
+					next = LENGTH_EXT_H;
+				}
+				else
+				{
+					next = sip_length_done(sip);
+				}
+				break;
+
+			case LENGTH_EXT_H:
+				sip->length = (sip->length << 8) | byte;
+				next = --sip->length_bytes != 0 ? LENGTH_EXT_H : sip_length_done(sip);
+				break;
+
+			case CHECKSUM_H:
+				sip->checksum = (sip->checksum << 8) | byte;
+				next = --sip->checksum_bytes != 0 ? CHECKSUM_H : EFLAG;
+				break;
+
+			default:
+				break;
+		}
+
+		sip->State = next;
 	}
-	else if (ch >= 'A' && ch <= 'F')
+
+	return p;
+}
+
+static const uint8_t *sip_binary_buffer(SIP_t *sip, const uint8_t *p, const uint8_t *end)
+{
+	while (p < end && sip->Mode == SIP_MODE_BINARY)
 	{
-		val  = ch - 'A';
-		val += 10;
+		uint16_t i = sip->frame_index;
+		size_t run = sip->cobs_remaining;
+
+		// inside a block the payload bytes are copied as they are, as far as
+		// the end of the block, the payload or the buffer
+		if (run != 0 && i > 2 && i >= sip->frame_header &&
+			i < sip->frame_header + sip->length && sip->Error == NO_ERROR)
+		{
+			const uint8_t *zero;
+
+			if (run > (size_t)(sip->frame_header + sip->length - i))
+				run = sip->frame_header + sip->length - i;
+
+			if (run > (size_t)(end - p))
+				run = end - p;
+
+			// a zero can only be a delimiter that cuts the frame short
+			zero = memchr(p, 0, run);
+
+			if (zero != NULL)
+				run = zero - p;
+
+			memcpy(&sip->payload[i - sip->frame_header], p, run);
+			sip->crc = SIPCrc16(sip->crc, p, run);
+			sip->frame_index += run;
+			sip->cobs_remaining -= run;
+			p += run;
+
+			if (run != 0)
+				continue;
+		}
+
+		sip_binary_input(sip, *p++);
 	}
-	else if (ch >= 'a' && ch <= 'f')
+
+	return p;
+}
+
+void SIPFeedBuffer(SIP_t *sip, const char *buf, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)buf;
+	const uint8_t *end = p + len;
+
+	// a frame can switch modes part way through the buffer
+	while (p < end)
 	{
-		val = ch - 'a';
-		val += 10;
+		if (sip->Mode == SIP_MODE_BINARY)
+			p = sip_binary_buffer(sip, p, end);
+		else
+			p = sip_text_buffer(sip, p, end);
 	}
- 
-	return val;
-}
\ No newline at end of file
+}
+
+size_t SIPEncodeText(char *out, uint8_t command, uint8_t sequence,
+					 const uint8_t *payload, uint16_t length)
+{
+	return sip_build_frame((uint8_t *)out, SIP_MODE_TEXT, command, sequence,
+						   payload, length);
+}
+
+size_t SIPEncodeBinary(uint8_t *out, uint8_t command, uint8_t sequence,
+					   const uint8_t *payload, uint16_t length)
+{
+	return sip_build_frame(out, SIP_MODE_BINARY, command, sequence,
+						   payload, length);
+}
+
+
+uint8_t hexchar_to_uint8(uint8_t ch)
+{
+	return sip_hex_lut[ch] & 0x0f;
+}
@@ -1,15 +1,83 @@
 #ifndef SIP_H_
 #define SIP_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 #define SIP_CMD_VECTOR_TABLE_SZ 256
-#define SIP_MAX_RESP_LEN 256
-#define SIP_MAX_PAYLOAD_LEN 256
+// response data after the status byte, small enough for a short length field
+#define SIP_MAX_RESP_LEN 253
+
+// Longest payload the parser accepts. Anything over 254 bytes is sent with
+// an extended length: a length byte of SIP_LENGTH_EXTENDED followed by the
+// real length in two bytes, big endian
+#ifndef SIP_MAX_PAYLOAD_LEN
+#define SIP_MAX_PAYLOAD_LEN 1024
+#endif
+
+#define SIP_LENGTH_EXTENDED 0xFF
+
+// Complete frames waiting for SIPProcessQueue in deferred mode, a power of 2
+#ifndef SIP_FRAME_POOL_SZ
+#define SIP_FRAME_POOL_SZ 4
+#endif
+
+// Reserved commands, handled by the parser itself unless a callback has been
+// registered for them (as it is on the host end of the link to get replies).
+//
+// SET_MODE: one SIPMode_t byte, the mode to use from the next frame on.
+//
+// BULK_START: target, total length (4 bytes). Starts a transfer into the
+// buffer registered with SIPRegisterBulkTarget.
+//
+// BULK_DATA: target, offset (4 bytes), data. Stored if it carries on exactly
+// where the transfer has got to. Each is answered with the number of bytes
+// received so far (4 bytes), so the host can keep a window of chunks in
+// flight and go back to that offset when a chunk is refused.
+#define SIP_CMD_SET_MODE 0xFF
+#define SIP_CMD_BULK_START 0xFE
+#define SIP_CMD_BULK_DATA 0xFD
+
+#define SIP_BULK_TARGETS 4
+#define SIP_BULK_HEADER_LEN 5
+#define SIP_BULK_CHUNK_MAX (SIP_MAX_PAYLOAD_LEN - SIP_BULK_HEADER_LEN)
+
+// bulk response status
+#define SIP_BULK_OK 0
+#define SIP_BULK_REFUSED 1
+#define SIP_BULK_OUT_OF_ORDER 2
+
+// command, sequence, length (1 or 3 bytes), payload and CRC-16
+#define SIP_RAW_FRAME_LEN(n) ((n) + 5 + ((n) >= SIP_LENGTH_EXTENDED ? 2 : 0))
+
+// binary frames are COBS encoded in place, from this far into the buffer
+#define SIP_COBS_OFFSET (2 + SIP_RAW_FRAME_LEN(SIP_MAX_PAYLOAD_LEN) / 254)
+
+// size of the buffer needed to encode a frame carrying n payload bytes
+#define SIP_TEXT_FRAME_LEN(n) (2 * SIP_RAW_FRAME_LEN(n) + 2)
+#define SIP_BINARY_FRAME_LEN(n) (SIP_RAW_FRAME_LEN(n) + SIP_COBS_OFFSET)
+
+// A handler's reply. data points into the TX frame itself, the handler writes
+// up to SIP_MAX_RESP_LEN bytes there and sets length. The value the handler
+// returns goes in front of them as a status byte
+typedef struct
+{
+	uint8_t command;
+	uint8_t sequence;
+	uint8_t length;
+	uint8_t *data;
+} SIPResponse_t;
 
 // define callback prototype
-typedef int (*callback_func)(uint8_t *payload, uint8_t payload_length); 
+typedef int (*callback_func)(uint8_t *payload, uint16_t payload_length,
+							 SIPResponse_t *response);
+
+// sends an encoded frame back to the host
+typedef void (*SIPTransmit_t)(const uint8_t *frame, size_t length);
+
+// free running time source for the queue latency counters, any unit
+typedef uint32_t (*SIPClock_t)(void);
 
 typedef enum
 {
@@ -17,8 +85,12 @@ typedef enum
     SFLAG,
     COMMAND_H,
     COMMAND_L,
+    SEQUENCE_H,
+    SEQUENCE_L,
     LENGTH_H,
     LENGTH_L,
+    LENGTH_EXT_H,
+    LENGTH_EXT_L,
     PAYLOAD_H,
     PAYLOAD_L,
     CHECKSUM_H,
@@ -33,30 +105,128 @@ typedef enum
     INVALID_EFLAG_ERROR,
     INVALID_CMD_ERROR,
     INVALID_CS_ERROR,
-    INVALID_EXEC_ERROR
+    INVALID_EXEC_ERROR,
+    INVALID_LENGTH_ERROR,
+    SIP_ERROR_TYPES
 } SIPError_t;
 
+// Text frames are <CCQQLL...SSSS> in ascii hex. Binary frames are the raw
+// command, sequence, length, payload and checksum bytes, COBS encoded and
+// ended by 0x00. The checksum is a CRC-16 of everything before it, big
+// endian, see sip-crc.h. Responses echo the command and sequence so the host can keep
+// several requests in flight and match the replies up
+typedef enum
+{
+    SIP_MODE_TEXT = 0,
+    SIP_MODE_BINARY
+} SIPMode_t;
+
+// a complete frame waiting to be executed
+typedef struct
+{
+	uint8_t command;
+	uint8_t sequence;
+	uint16_t length;
+	uint32_t timestamp;
+	uint8_t payload[SIP_MAX_PAYLOAD_LEN];
+} SIPFrame_t;
+
+typedef struct
+{
+	uint32_t queued;
+	uint32_t executed;
+	uint32_t dropped;		// the pool was full, the frame was lost
+	uint32_t max_depth;
+	uint32_t latency_total;	// clock ticks from EFLAG to the handler running
+	uint32_t latency_max;
+} SIPQueueStats_t;
+
+// where a bulk transfer ends up. length is set by BULK_START, received counts
+// up to it as the chunks arrive
+typedef struct
+{
+	uint8_t *buffer;
+	uint32_t size;
+	volatile uint32_t length;
+	volatile uint32_t received;
+	uint32_t refused;			// chunks that didn't carry on from received
+} SIPBulkTarget_t;
+
 typedef struct
 {
 	// public properties
 	SIPState_t State;
 	SIPError_t Error;
+	// how often each error has happened, [NO_ERROR] counts good frames
+	uint32_t ErrorCount[SIP_ERROR_TYPES];
+	SIPMode_t Mode;
+	bool Deferred;
+	SIPClock_t Clock;
+	SIPQueueStats_t QueueStats;
+	SIPTransmit_t Transmit;
+	SIPResponse_t Response;
 	callback_func CommandVectorTable[SIP_CMD_VECTOR_TABLE_SZ];
+	SIPBulkTarget_t *BulkTargets[SIP_BULK_TARGETS];
 
 	// temp variables
 	uint8_t command;
-	uint8_t length;
+	uint8_t sequence;
+	uint16_t length;
+	uint8_t length_bytes;		// extended length bytes still to come
 	uint8_t payload_byte;
 	uint8_t payload[SIP_MAX_PAYLOAD_LEN];
-	uint8_t payload_counter;
-	uint8_t checksum;
+	uint16_t payload_counter;
+	uint16_t checksum;
+	uint8_t checksum_bytes;		// checksum bytes still to come
+	uint16_t crc;				// of the frame so far
+
+	// binary mode decoder
+	uint16_t frame_index;
+	uint8_t frame_header;		// bytes in front of the payload
+	uint8_t cobs_remaining;
+	bool cobs_zero;
+
+	// deferred mode frame queue, written by the parser and read by
+	// SIPProcessQueue, each side only moves its own index
+	SIPFrame_t frame_pool[SIP_FRAME_POOL_SZ];
+	volatile uint32_t frame_head;
+	volatile uint32_t frame_tail;
+
+	// responses are built and encoded in place here
+	uint8_t response_frame[SIP_TEXT_FRAME_LEN(SIP_MAX_RESP_LEN + 1)];
 } SIP_t;
 
 void SIPRegisterCommand(SIP_t *sip, uint8_t command, callback_func f);
 void SIPDeregisterCommand(SIP_t *sip, uint8_t command);
+void SIPSetMode(SIP_t *sip, SIPMode_t mode);
+
+// Without a transmit function handlers still run but nothing is sent back
+void SIPSetTransmit(SIP_t *sip, SIPTransmit_t transmit);
+
+// With deferred set, complete frames are queued rather than executed by the
+// parser, so it can be fed from an interrupt handler. SIPProcessQueue then
+// runs up to max of the queued handlers (all of them for max < 0) and
+// returns how many it ran
+void SIPSetDeferred(SIP_t *sip, bool deferred, SIPClock_t clock);
+int SIPProcessQueue(SIP_t *sip, int max);
+
+// Bulk chunks are written into the target straight from the parser, even in
+// deferred mode. Watch target->received to see the transfer finish
+void SIPRegisterBulkTarget(SIP_t *sip, uint8_t id, SIPBulkTarget_t *target);
 
 void SIPFeedInput(SIP_t *sip, char ch);
 
+// same as calling SIPFeedInput for every char, but decodes whole bytes and
+// payload runs at a time
+void SIPFeedBuffer(SIP_t *sip, const char *buf, size_t len);
+
+// Encode a frame for the other end of the link, returning its length. out
+// must hold SIP_TEXT_FRAME_LEN / SIP_BINARY_FRAME_LEN of length bytes
+size_t SIPEncodeText(char *out, uint8_t command, uint8_t sequence,
+					 const uint8_t *payload, uint16_t length);
+size_t SIPEncodeBinary(uint8_t *out, uint8_t command, uint8_t sequence,
+					   const uint8_t *payload, uint16_t length);
+
 uint8_t hexchar_to_uint8(uint8_t ch);
 
 #endif
\ No newline at end of file
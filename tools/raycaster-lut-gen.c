@@ -0,0 +1,121 @@
+/* Writes raycaster-lut.h, the ray caster's lookup tables. It runs on the
+   build machine, so the floating point here never reaches the Pi:
+
+       raycaster-lut-gen <screen width> <fov degrees> <output header>
+
+   All the tables are Q16.16 or integer, in the formats raycaster.c expects */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define FIXED_SHIFT     16
+#define FIXED_ONE       (1 << FIXED_SHIFT)
+
+// a whole turn, a power of 2 so an angle wraps with a mask
+#define ANGLES          1024
+
+// reciprocal seeds, one per 1/512th of [0.5, 1)
+#define RECIP_BITS      8
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static void table_start(FILE *out, const char *comment, const char *type,
+						const char *name, const char *size)
+{
+	fprintf(out, "\n// %s\nstatic const %s %s[%s] =\n{", comment, type, name, size);
+}
+
+static void table_entry(FILE *out, int i, long long value)
+{
+	fprintf(out, "%s%lld,", (i % 8) == 0 ? "\n\t" : " ", value);
+}
+
+static void table_end(FILE *out)
+{
+	fprintf(out, "\n};\n");
+}
+
+int main(int argc, char **argv)
+{
+	FILE *out;
+	long width;
+	double fov;
+	long i;
+
+	if (argc != 4)
+	{
+		fprintf(stderr, "usage: %s <screen width> <fov degrees> <output header>\n", argv[0]);
+		return 1;
+	}
+
+	width = strtol(argv[1], NULL, 0);
+	fov = strtod(argv[2], NULL);
+
+	if (width < 1 || fov <= 0.0 || fov >= 180.0)
+	{
+		fprintf(stderr, "%s: width %ld or fov %g out of range\n", argv[0], width, fov);
+		return 1;
+	}
+
+	out = fopen(argv[3], "w");
+
+	if (out == NULL)
+	{
+		perror(argv[3]);
+		return 1;
+	}
+
+	fprintf(out,
+		"/* Generated by tools/raycaster-lut-gen.c for a %ld column screen with a\n"
+		"   %g degree field of view, don't edit. Included by raycaster.c only */\n\n"
+		"#ifndef RAYCASTER_LUT_H_\n"
+		"#define RAYCASTER_LUT_H_\n\n"
+		"#include <stdint.h>\n\n"
+		"#define RAYCASTER_LUT_WIDTH        %ld\n"
+		"#define RAYCASTER_LUT_ANGLES       %d\n"
+		"#define RAYCASTER_LUT_RECIP_BITS   %d\n\n"
+		"// length of the camera plane for the field of view, tan(fov / 2)\n"
+		"#define RAYCASTER_LUT_PLANE        %ld\n",
+		width, fov, width, ANGLES, RECIP_BITS,
+		lround(tan(fov * M_PI / 360.0) * FIXED_ONE));
+
+	// exactly what RayCasterCastColumn works out, so the table changes nothing
+	table_start(out, "camera space x of each column, -1 on the left to +1 on the right",
+				"int32_t", "RayCasterLutCameraX", "RAYCASTER_LUT_WIDTH");
+	for (i = 0; i < width; i++)
+		table_entry(out, i, (((int64_t)(2 * i) << FIXED_SHIFT) / width) - FIXED_ONE);
+	table_end(out);
+
+	table_start(out, "sin of angle / RAYCASTER_LUT_ANGLES turns, with a quarter turn more "
+				"so cos is sin a quarter turn on",
+				"int32_t", "RayCasterLutSin", "RAYCASTER_LUT_ANGLES + RAYCASTER_LUT_ANGLES / 4");
+	for (i = 0; i < ANGLES + ANGLES / 4; i++)
+		table_entry(out, i, lround(sin(2.0 * M_PI * i / ANGLES) * FIXED_ONE));
+	table_end(out);
+
+	// the middle of each interval, so the seed is never out by more than half
+	// an interval and one Newton step is enough
+	table_start(out, "1 / m as Q1.31 for m in [0.5, 1), the seeds for recip() in raycaster.c",
+				"uint32_t", "RayCasterLutRecip", "1 << RAYCASTER_LUT_RECIP_BITS");
+	for (i = 0; i < (1 << RECIP_BITS); i++)
+	{
+		double m = 0.5 + (i + 0.5) / (2 << RECIP_BITS);
+
+		table_entry(out, i, llround(2147483648.0 / m));
+	}
+	table_end(out);
+
+	fprintf(out, "\n#endif\n");
+
+	if (fclose(out) != 0)
+	{
+		perror(argv[3]);
+		return 1;
+	}
+
+	return 0;
+}